@@ -0,0 +1,42 @@
+#ifndef _ASYNC_COMPUTE_H_
+#define _ASYNC_COMPUTE_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Compute work of one frame slot. The graphics submit of the same frame waits on finished, so once the slot's fence
+// has signaled the command buffer and the semaphore are free again.
+struct ComputeFrame {
+    VkCommandPool cmdPool;
+    VkCommandBuffer cmdBuffer;
+    VkSemaphore finished;
+};
+
+struct AsyncCompute {
+    VkDevice device;
+    VkQueue queue;
+    uint32_t family;
+    uint32_t graphicsFamily;
+    // When false compute work is recorded into the frame's graphics command buffer instead, either because it was
+    // switched off or because the device has no queue besides the graphics one
+    bool async;
+    std::vector<ComputeFrame> frames;
+    uint64_t submits;
+};
+
+VkResult createAsyncCompute (VkDevice device, VkQueue queue, uint32_t family, VkQueue graphicsQueue, uint32_t graphicsFamily, bool enable,
+        uint32_t slotCount, AsyncCompute *compute);
+void destroyAsyncCompute (AsyncCompute *compute);
+// Families a resource shared between compute and graphics has to be created for, a single family means exclusive sharing
+std::vector<uint32_t> computeSharingFamilies (const AsyncCompute& compute);
+
+// Returns the command buffer to record this frame's compute work into, graphicsCmdBuffer when not async. Work in it is
+// ordered after everything earlier compute frames did.
+VkCommandBuffer beginComputeWork (AsyncCompute *compute, uint32_t slot, VkCommandBuffer graphicsCmdBuffer);
+// Makes the compute results visible to graphics work at consumerStages. When async, submits the compute command buffer and
+// appends the semaphore the frame's graphics submit must wait on, which therefore has to come after this call.
+VkResult submitComputeWork (AsyncCompute *compute, uint32_t slot, VkCommandBuffer graphicsCmdBuffer, VkPipelineStageFlags consumerStages,
+        std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages);
+
+#endif // _ASYNC_COMPUTE_H_
@@ -0,0 +1,30 @@
+#ifndef _COMMAND_RECORDER_H_
+#define _COMMAND_RECORDER_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Secondary command buffers handed out by one thread for one frame slot. The pool is only ever touched by its
+// thread while recording and by the frame loop while resetting, so it needs no locking.
+struct ThreadCommandPool {
+    VkCommandPool pool;
+    std::vector<VkCommandBuffer> buffers;
+    uint32_t used;
+};
+
+struct CommandRecorder {
+    VkDevice device;
+    uint32_t threadCount;
+    // Indexed by slot * threadCount + thread
+    std::vector<ThreadCommandPool> pools;
+};
+
+VkResult createCommandRecorder (VkDevice device, uint32_t queueIndex, uint32_t threadCount, uint32_t slotCount, CommandRecorder *recorder);
+void destroyCommandRecorder (CommandRecorder *recorder);
+// Recycles every secondary buffer of the slot, only once the slot's fence has signaled
+void resetCommandRecorder (CommandRecorder *recorder, uint32_t slot);
+// Returns a secondary command buffer from the calling thread's pool that is already recording with the given inheritance
+VkCommandBuffer beginSecondary (CommandRecorder *recorder, uint32_t slot, uint32_t thread, const VkCommandBufferInheritanceInfo& inheritance);
+
+#endif // _COMMAND_RECORDER_H_
@@ -0,0 +1,120 @@
+#ifndef _DESCRIPTORS_H_
+#define _DESCRIPTORS_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "memoryAllocator.h"
+#include "uploader.h"
+
+// Sets per pool of the per-frame allocator, the descriptor counts scale with it
+#define DESCRIPTOR_POOL_SETS            256
+
+#define BINDLESS_MAX_TEXTURES           16384
+#define BINDLESS_MAX_BUFFERS            16384
+// Without descriptor indexing every element of the arrays must stay valid and the arrays count against the regular
+// per-stage limits, so they are much smaller
+#define BINDLESS_FALLBACK_TEXTURES      64
+#define BINDLESS_FALLBACK_BUFFERS       64
+#define BINDLESS_TEXTURE_BINDING        0
+#define BINDLESS_BUFFER_BINDING         1
+// The minimum every implementation supports
+#define BINDLESS_PUSH_CONSTANT_SIZE     128
+#define BINDLESS_INVALID                UINT32_MAX
+
+struct DescriptorLayoutCache {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, VkDescriptorSetLayout> layouts;
+};
+
+// Returns the layout for the bindings, creating it the first time a combination is seen. Bindings may be in any order.
+VkResult getDescriptorSetLayout (VkDevice device, DescriptorLayoutCache *cache, std::vector<VkDescriptorSetLayoutBinding> bindings,
+        VkDescriptorSetLayout *layout);
+void destroyDescriptorLayoutCache (VkDevice device, DescriptorLayoutCache *cache);
+
+// Pools of one thread for one frame slot, they only ever grow and are reset together
+struct ThreadDescriptorPools {
+    std::vector<VkDescriptorPool> pools;
+    uint32_t current;
+};
+
+struct FrameDescriptors {
+    VkDevice device;
+    uint32_t threadCount;
+    // Indexed by slot * threadCount + thread
+    std::vector<ThreadDescriptorPools> threads;
+};
+
+VkResult createFrameDescriptors (VkDevice device, uint32_t threadCount, uint32_t slotCount, FrameDescriptors *descriptors);
+void destroyFrameDescriptors (FrameDescriptors *descriptors);
+// Frees every set allocated for the slot at once, only once the slot's fence has signaled
+void resetFrameDescriptors (FrameDescriptors *descriptors, uint32_t slot);
+// The set is valid until the slot is reset, it must not be freed individually
+VkResult allocateFrameDescriptorSet (FrameDescriptors *descriptors, uint32_t slot, uint32_t thread, VkDescriptorSetLayout layout,
+        VkDescriptorSet *set);
+
+struct DescriptorIndexingSupport {
+    bool supported;
+    // Chain into VkDeviceCreateInfo::pNext when supported
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT features;
+    uint32_t maxTextures;
+    uint32_t maxBuffers;
+};
+
+// Needs VK_KHR_get_physical_device_properties2 on the instance, reports no support otherwise. availableExtensions are the
+// extensions the device supports, the ones to enable are appended to extensions.
+DescriptorIndexingSupport queryDescriptorIndexing (VkInstance instance, VkPhysicalDevice physicalDevice, bool properties2Enabled,
+        const std::unordered_set<std::string>& availableExtensions, std::vector<const char*>& extensions);
+
+// Every texture and storage buffer in one descriptor set, referenced from shaders by the index passed in push constants.
+// With descriptor indexing there is a single update-after-bind set that is written immediately. Without it, every frame
+// slot has its own copy that is only written while the slot is idle, and unused elements point at default resources.
+struct BindlessTable {
+    VkDevice device;
+    bool bindless;
+    uint32_t textureCapacity;
+    uint32_t bufferCapacity;
+    VkDescriptorSetLayout layout;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorPool pool;
+    std::vector<VkDescriptorSet> sets;
+    std::vector<VkDescriptorImageInfo> textures;
+    std::vector<VkDescriptorBufferInfo> buffers;
+    std::vector<uint32_t> freeTextures;
+    std::vector<uint32_t> freeBuffers;
+    // Index and the frame it was released in, reused once that frame has completed
+    std::vector<std::pair<uint32_t, uint64_t>> releasedTextures;
+    std::vector<std::pair<uint32_t, uint64_t>> releasedBuffers;
+    // Fallback only, elements every slot's set still has to be brought up to date with
+    std::vector<std::vector<uint32_t>> dirtyTextures;
+    std::vector<std::vector<uint32_t>> dirtyBuffers;
+    VkImage defaultImage;
+    Allocation defaultImageMemory;
+    VkImageView defaultView;
+    VkSampler defaultSampler;
+    VkBuffer defaultBuffer;
+    Allocation defaultBufferMemory;
+};
+
+VkResult createBindlessTable (MemoryAllocator *allocator, Uploader *uploader, VkPhysicalDevice physicalDevice, const DescriptorIndexingSupport& support,
+        uint32_t slotCount, BindlessTable *table);
+void destroyBindlessTable (MemoryAllocator *allocator, BindlessTable *table);
+// Return BINDLESS_INVALID when the table is full. The element can be used by every frame that calls updateBindlessTable
+// after registering it.
+uint32_t registerTexture (BindlessTable *table, VkImageView view, VkSampler sampler, VkImageLayout layout);
+uint32_t registerBuffer (BindlessTable *table, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+// The resource must stay alive until frameNumber has completed
+void releaseTexture (BindlessTable *table, uint32_t index, uint64_t frameNumber);
+void releaseBuffer (BindlessTable *table, uint32_t index, uint64_t frameNumber);
+// Once per frame after the slot's fence has signaled. Returns true if the slot's set was written, which invalidates
+// command buffers that bound it before (fallback only, the bindless set is update-after-bind).
+bool updateBindlessTable (BindlessTable *table, uint32_t slot, uint64_t framesCompleted);
+void bindBindlessTable (VkCommandBuffer cmdBuffer, const BindlessTable& table, uint32_t slot, VkPipelineBindPoint bindPoint);
+
+#endif // _DESCRIPTORS_H_
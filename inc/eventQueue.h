@@ -0,0 +1,48 @@
+#ifndef _EVENT_QUEUE_H_
+#define _EVENT_QUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+
+// Must be a power of two
+#define EVENT_QUEUE_SIZE    1024
+
+enum InputEventType {
+    INPUT_EVENT_QUIT,
+    INPUT_EVENT_RESIZED,
+    INPUT_EVENT_KEY_DOWN,
+    INPUT_EVENT_KEY_UP,
+    INPUT_EVENT_MOUSE_MOTION,
+    INPUT_EVENT_MOUSE_BUTTON_DOWN,
+    INPUT_EVENT_MOUSE_BUTTON_UP
+};
+
+struct InputEvent {
+    InputEventType type;
+    // Key code, mouse button, or width for RESIZED
+    int32_t code;
+    // Mouse position, or height for RESIZED
+    int32_t x;
+    int32_t y;
+    // Steady clock nanoseconds when the event thread received the event
+    int64_t timestamp;
+};
+
+// Single producer, single consumer ring between the event thread and the render thread. Each side only writes its own
+// index, and the indices live on separate cache lines so the threads do not contend for them.
+struct EventQueue {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    // Only touched by the producer
+    uint64_t dropped;
+    InputEvent events[EVENT_QUEUE_SIZE];
+};
+
+void createEventQueue (EventQueue *queue);
+// Producer side, returns false without blocking if the queue is full
+bool pushEvent (EventQueue *queue, const InputEvent& event);
+// Consumer side, returns false if the queue is empty
+bool popEvent (EventQueue *queue, InputEvent *event);
+int64_t eventTimestamp ();
+
+#endif // _EVENT_QUEUE_H_
@@ -0,0 +1,37 @@
+#ifndef _FRAME_RING_H_
+#define _FRAME_RING_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#define DEFAULT_FRAMES_IN_FLIGHT    2
+#define MAX_FRAMES_IN_FLIGHT        8
+
+// Everything a single in-flight frame needs. A slot may only be re-recorded once its fence has signaled.
+struct FrameSlot {
+    VkSemaphore imageAvailable;
+    VkFence inFlight;
+    VkCommandPool cmdPool;
+    VkCommandBuffer cmdBuffer;
+    // Submitted after pre-recorded command buffers to close the frame
+    VkCommandBuffer finishCmdBuffer;
+};
+
+struct FrameRing {
+    std::vector<FrameSlot> slots;
+    uint32_t current;
+    uint64_t frameNumber;
+};
+
+VkResult createFrameRing (VkDevice device, uint32_t queueIndex, uint32_t frameCount, FrameRing *ring);
+void destroyFrameRing (VkDevice device, FrameRing *ring);
+
+// Waits until the next slot is no longer in use by the GPU and resets its command pool.
+// This is the only point where the CPU blocks on the GPU in the render loop.
+FrameSlot& beginFrame (VkDevice device, FrameRing *ring);
+void endFrame (FrameRing *ring);
+// Number of frames the GPU is known to have finished, valid right after beginFrame
+uint64_t framesCompleted (const FrameRing& ring);
+
+#endif // _FRAME_RING_H_
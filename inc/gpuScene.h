@@ -0,0 +1,100 @@
+#ifndef _GPU_SCENE_H_
+#define _GPU_SCENE_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "descriptors.h"
+#include "memoryAllocator.h"
+#include "pipelines.h"
+#include "uploader.h"
+
+// Matches BUCKETS in shaders/cull.comp
+#define GPU_SCENE_BUCKETS       4
+#define GPU_SCENE_GROUP_SIZE    64
+// Instance data queued for upload per frame, the staging ring is shared with everything else
+#define GPU_SCENE_UPLOAD_CHUNK  (8ull << 20)
+
+// Bounding sphere and material bucket, laid out like Instance in the shaders (std430)
+struct GpuInstance {
+    float sphere[4];
+    uint32_t bucket;
+    uint32_t padding[3];
+};
+
+// Rewritten before culling every frame: the commands with no instances, followed by the first element of every bucket's
+// range in the visible list. Laid out like Draws in shaders/cull.comp.
+struct GpuSceneDraws {
+    VkDrawIndexedIndirectCommand commands[GPU_SCENE_BUCKETS];
+    uint32_t bases[GPU_SCENE_BUCKETS];
+};
+
+// Many instances drawn without per-instance CPU work. A compute pass tests every instance's bounding sphere against the
+// view frustum and appends the visible ones to their bucket's range of the visible list, counting them in the
+// instanceCount of the bucket's indirect command. Every bucket is then drawn by one vkCmdDrawIndexedIndirect, the vertex
+// shader looks its instance up through the visible list. Needs neither multiDrawIndirect, drawIndirectFirstInstance nor
+// draw count extensions.
+struct GpuScene {
+    uint32_t instanceCount;
+    // One per frame slot when the instances move, the whole set is uploaded again every frame. Otherwise a single buffer
+    // streamed once.
+    bool moving;
+    std::vector<VkBuffer> instanceBuffers;
+    std::vector<Allocation> instanceMemory;
+    VkBuffer indexBuffer;
+    Allocation indexMemory;
+    // One of each per frame slot, written by the frame's culling pass
+    std::vector<VkBuffer> visibleBuffers;
+    std::vector<Allocation> visibleMemory;
+    std::vector<VkBuffer> drawBuffers;
+    std::vector<Allocation> drawMemory;
+    GpuSceneDraws draws;
+    float colors[GPU_SCENE_BUCKETS][4];
+    VkDescriptorSetLayout cullSetLayout;
+    VkDescriptorSetLayout drawSetLayout;
+    VkPipelineLayout cullLayout;
+    VkPipelineLayout drawLayout;
+    VkPipeline cullPipeline;
+    VkPipeline drawPipeline;
+    // Generated at creation and streamed to the GPU over as many frames as the staging ring needs. Moving instances keep
+    // these as the rest positions they move around.
+    std::vector<GpuInstance> instances;
+    uint32_t queuedInstances;
+    bool indicesQueued;
+    UploadTicket lastUpload;
+    bool resident;
+    // Frame slots whose instance buffer has been written, only for moving instances
+    std::vector<bool> slotsWritten;
+};
+
+// Everything one frame records, filled in by prepareGpuSceneFrame
+struct GpuSceneFrame {
+    const GpuScene *scene;
+    uint32_t slot;
+    VkBuffer instanceBuffer;
+    float viewProjection[16];
+    float planes[6][4];
+    VkDescriptorSet cullSet;
+    VkDescriptorSet drawSet;
+};
+
+// Instances are spread through a cube that grows with their number, every bucket has its own mesh and color. Moving
+// instances are limited to GPU_SCENE_UPLOAD_CHUNK worth of instance data.
+VkResult createGpuScene (MemoryAllocator *allocator, PipelineLibrary *library, DescriptorLayoutCache *layouts, VkRenderPass renderPass,
+        uint32_t instanceCount, bool moving, uint32_t slotCount, GpuScene *scene);
+void destroyGpuScene (MemoryAllocator *allocator, GpuScene *scene);
+// Once per frame right before the uploads are flushed, queues the next part of the instance data, or for moving instances
+// all of them at their positions at time. Returns whether the frame slot's data has arrived and the scene can be drawn.
+bool streamGpuScene (MemoryAllocator *allocator, Uploader *uploader, uint32_t slot, double time, GpuScene *scene);
+
+// The camera turns around the center of the scene as time passes
+void prepareGpuSceneFrame (const GpuScene& scene, FrameDescriptors *descriptors, uint32_t slot, double time, VkExtent2D extent, GpuSceneFrame *frame);
+// Clears the frame's indirect commands, a transfer write
+void recordGpuSceneReset (VkCommandBuffer cmdBuffer, const GpuSceneFrame& frame);
+// Compute, reads the instances and writes the frame's visible list and indirect commands
+void recordGpuSceneCull (VkCommandBuffer cmdBuffer, const GpuSceneFrame& frame);
+// Inside the render pass, one indirect draw per bucket
+void recordGpuSceneDraws (VkCommandBuffer cmdBuffer, const GpuSceneFrame& frame, VkExtent2D extent);
+
+#endif // _GPU_SCENE_H_
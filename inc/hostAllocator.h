@@ -0,0 +1,55 @@
+#ifndef _HOST_ALLOCATOR_H_
+#define _HOST_ALLOCATOR_H_
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+// COMMAND, OBJECT, CACHE, DEVICE and INSTANCE
+#define HOST_SCOPE_COUNT            5
+// Bump arena per frame for COMMAND scope allocations, allocations that don't fit fall back to the heap
+#define HOST_ARENA_SIZE             (1u << 20)
+// Size classes from HOST_POOL_MIN_SIZE to HOST_POOL_MAX_SIZE in powers of two, both including the block header.
+// Larger allocations go to the heap.
+#define HOST_POOL_MIN_SIZE          32
+#define HOST_POOL_MAX_SIZE          4096
+#define HOST_POOL_CLASSES           8
+// Pools grow by one chunk at a time and never shrink
+#define HOST_POOL_CHUNK_SIZE        (64u << 10)
+
+struct HostScopeStats {
+    // Allocation and reallocation calls, and frees
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t liveBytes;
+    uint64_t peakBytes;
+    // Allocations served straight from the heap because they were too large or the frame's arena was full
+    uint64_t heapAllocations;
+    // Memory the driver allocated itself and only reported through the internal allocation notification
+    uint64_t internalBytes;
+};
+
+struct HostAllocatorStats {
+    HostScopeStats scopes[HOST_SCOPE_COUNT];
+    // Every heap allocation the allocator made, including arenas and pool chunks
+    uint64_t heapAllocations;
+    // Arenas that were still in use by a running command when their frame came around again
+    uint64_t deferredResets;
+};
+
+// Serves the driver's host allocations by scope: COMMAND scope from the current frame's bump arena, everything else from
+// size class pools. The state is process wide since the driver allocates from whichever thread calls into it. Start it
+// before the instance is created and stop it after the instance has been destroyed.
+void startHostAllocator (uint32_t frameArenas);
+void stopHostAllocator ();
+// nullptr unless the allocator is running, so it can be passed to every create and destroy call either way
+const VkAllocationCallbacks *hostAllocator ();
+
+// Switches COMMAND scope allocations over to the arena of the given frame, which is reset first unless a command still
+// holds memory from it
+void hostAllocatorBeginFrame (uint64_t frameNumber);
+HostAllocatorStats hostAllocatorStats ();
+// Prints the totals per scope and the allocations made since the snapshot since was taken
+void logHostAllocatorStats (const HostAllocatorStats& since, uint64_t framesSince);
+
+#endif // _HOST_ALLOCATOR_H_
@@ -0,0 +1,123 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Must be a power of two, jobs submitted to a full deque run inline instead
+#define JOB_DEQUE_SIZE  4096
+
+struct JobCounter {
+    std::atomic<uint32_t> pending;
+};
+
+typedef void (*JobFunction)(void *data, uint32_t thread);
+
+struct Job {
+    JobFunction function;
+    void *data;
+    JobCounter *counter;
+};
+
+// Chase-Lev deque: the owner pushes and pops at the bottom, other threads steal from the top
+struct WorkDeque {
+    std::atomic<int64_t> top;
+    // Thieves write top and the owner writes bottom, keep them on separate cache lines
+    char padding[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom;
+    std::atomic<Job*> buffer[JOB_DEQUE_SIZE];
+};
+
+// Everything a single thread owns, allocated separately per thread
+struct JobThread {
+    WorkDeque deque;
+    uint32_t stealSeed;
+};
+
+struct JobSystem {
+    // Thread 0 is the thread that created the system, it runs jobs while it waits on a counter
+    std::vector<std::unique_ptr<JobThread>> threads;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running;
+    // Workers sleep here when there is nothing to steal
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<uint32_t> sleeping;
+};
+
+// workerCount extra threads are spawned, 0 runs every job on the calling thread
+void createJobSystem (uint32_t workerCount, JobSystem *jobs);
+void destroyJobSystem (JobSystem *jobs);
+// Index of the calling thread inside the system, 0 for the creating thread
+uint32_t currentJobThread ();
+uint32_t jobThreadCount (const JobSystem& jobs);
+
+// Must be called from the creating thread or from inside a job. The job is owned by the caller and must stay alive until
+// its counter has been waited on, the counter is incremented here and decremented once the job has run.
+void submitJob (JobSystem *jobs, Job *job);
+// Runs queued jobs on the calling thread until the counter drops to zero
+void waitForCounter (JobSystem *jobs, JobCounter *counter);
+
+template <typename F>
+struct FunctionJob {
+    Job job;
+    F function;
+};
+
+// Wraps a callable taking the thread index, for one-off jobs that would otherwise need a struct for their arguments
+template <typename F>
+FunctionJob<F> makeFunctionJob (const F& function, JobCounter *counter) {
+    return { { [] (void *data, uint32_t thread) {
+        static_cast<FunctionJob<F>*>(data)->function(thread);
+    }, nullptr, counter }, function };
+}
+
+// Same rules as submitJob, the job must stay where it is until its counter has been waited on
+template <typename F>
+void submitFunctionJob (JobSystem *jobs, FunctionJob<F> *job) {
+    job->job.data = job;
+    submitJob(jobs, &job->job);
+}
+
+template <typename F>
+struct ParallelForJob {
+    Job job;
+    const F *function;
+    uint32_t begin;
+    uint32_t end;
+};
+
+// Splits [0, count) into chunks of at most grain items and calls function(begin, end, thread) for every chunk,
+// returns once all of them are done. Nothing is allocated, the chunks live on the caller's stack in batches.
+template <typename F>
+void parallelFor (JobSystem *jobs, uint32_t count, uint32_t grain, const F& function) {
+    const uint32_t batch = 256;
+    ParallelForJob<F> chunks[batch];
+    JobCounter counter;
+    uint32_t begin = 0;
+    while (begin < count) {
+        uint32_t chunkCount = 0;
+        counter.pending.store(0, std::memory_order_relaxed);
+        for (; chunkCount < batch && begin < count; chunkCount++, begin += grain) {
+            ParallelForJob<F>& chunk = chunks[chunkCount];
+            chunk.job = { [] (void *data, uint32_t thread) {
+                ParallelForJob<F> *chunk = static_cast<ParallelForJob<F>*>(data);
+                (*chunk->function)(chunk->begin, chunk->end, thread);
+            }, &chunk, &counter };
+            chunk.function = &function;
+            chunk.begin = begin;
+            chunk.end = std::min(begin + grain, count);
+        }
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            submitJob(jobs, &chunks[i].job);
+        }
+        waitForCounter(jobs, &counter);
+    }
+}
+
+#endif // _JOB_SYSTEM_H_
@@ -0,0 +1,42 @@
+#ifndef _KTX2_H_
+#define _KTX2_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#define KTX2_HEADER_SIZE    80
+
+struct Ktx2Level {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Texel block of a format, 1x1 for uncompressed formats
+struct FormatBlock {
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes;
+};
+
+// A KTX2 file mapped read only. Only 2D textures without array layers, cube faces or supercompression are accepted,
+// the data of every level can be copied into an image as it is. Level 0 is the largest.
+struct Ktx2File {
+    const uint8_t *data;
+    size_t size;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    std::vector<Ktx2Level> levels;
+};
+
+// Returns false for formats the loader does not know the block size of
+bool formatBlock (VkFormat format, FormatBlock *block);
+VkExtent3D levelExtent (const Ktx2File& file, uint32_t level);
+
+VkResult openKtx2File (const std::string& path, Ktx2File *file);
+void closeKtx2File (Ktx2File *file);
+
+#endif // _KTX2_H_
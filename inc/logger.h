@@ -0,0 +1,39 @@
+#ifndef _LOGGER_H_
+#define _LOGGER_H_
+
+#include <cstdint>
+
+// Must be a power of two. Messages go into fixed size records, longer ones take several consecutive records.
+#define LOG_RING_RECORDS        1024
+#define LOG_RECORD_SIZE         256
+// Longer messages are truncated
+#define LOG_MAX_MESSAGE_RECORDS 64
+// Driver and layer messages with the same ID are printed this many times, further repeats are only counted
+#define LOG_REPEAT_LIMIT        3
+// Must be a power of two, once full every new ID is printed without limit
+#define LOG_REPEAT_SLOTS        256
+
+enum LogSeverity {
+    LOG_SEVERITY_DEBUG,
+    LOG_SEVERITY_INFO,
+    LOG_SEVERITY_WARNING,
+    LOG_SEVERITY_ERROR,
+    LOG_SEVERITY_COUNT
+};
+
+bool parseLogSeverity (const char *name, LogSeverity *severity);
+
+// Until the logger is started and after it has been stopped, messages are written synchronously from the calling thread
+void startLogger (LogSeverity minSeverity);
+// Writes every queued message and joins the writer thread. Safe to call more than once and from several threads at once.
+void stopLogger ();
+bool logEnabled (LogSeverity severity);
+
+// Never blocks and never allocates, the message is dropped if the ring is full. Callable from any thread, including
+// driver threads inside debug messenger callbacks.
+void logMessage (LogSeverity severity, const char *msg);
+// For driver and layer messages, repeats of the same non-zero messageId past LOG_REPEAT_LIMIT are suppressed and reported
+// as a count when the logger stops
+void logRepeatedMessage (LogSeverity severity, int32_t messageId, const char *msg);
+
+#endif // _LOGGER_H_
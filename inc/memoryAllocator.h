@@ -0,0 +1,149 @@
+#ifndef _MEMORY_ALLOCATOR_H_
+#define _MEMORY_ALLOCATOR_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// TLSF index sizes: 2^4 second level lists per power of two
+#define TLSF_SL_LOG2        4
+#define TLSF_SL_COUNT       (1u << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT       64
+#define TLSF_NONE           UINT32_MAX
+// Every offset and size handed out by the TLSF allocator is a multiple of this, so the smallest list is never searched
+#define TLSF_MIN_ALIGNMENT  16
+
+#define DEFAULT_DEVICE_BLOCK_SIZE       (64ull << 20)
+#define DEFAULT_HOST_BLOCK_SIZE         (16ull << 20)
+#define DEFAULT_TRANSIENT_BLOCK_SIZE    (4ull << 20)
+
+enum AllocationUsage {
+    // Lives until freed, served by a TLSF allocator inside large blocks
+    ALLOCATION_PERSISTENT,
+    // Lives until the frame slot it was allocated in comes around again, served by a bump allocator. Never freed individually.
+    ALLOCATION_TRANSIENT
+};
+
+// Linear (buffers, linearly tiled images) and optimally tiled resources are kept in separate pools whenever
+// bufferImageGranularity is larger than 1, so neighbours inside a block can never violate it
+enum ResourceKind {
+    RESOURCE_LINEAR,
+    RESOURCE_OPTIMAL,
+    RESOURCE_KIND_COUNT
+};
+
+struct Allocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    // Points at offset inside the persistently mapped block, nullptr for memory that is not host visible
+    void *mapped;
+    uint32_t memoryType;
+    AllocationUsage usage;
+    ResourceKind kind;
+    uint32_t block;     // TLSF_NONE for dedicated allocations
+    uint32_t node;
+};
+
+struct TlsfNode {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t prevPhysical;
+    uint32_t nextPhysical;
+    uint32_t prevFree;
+    uint32_t nextFree;
+    bool free;
+};
+
+struct TlsfBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void *mapped;
+    std::vector<TlsfNode> nodes;
+    std::vector<uint32_t> unusedNodes;
+    uint64_t flBitmap;
+    uint32_t slBitmap[TLSF_FL_COUNT];
+    uint32_t freeHeads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    VkDeviceSize usedBytes;
+    uint32_t allocationCount;
+};
+
+struct LinearBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize head;
+    void *mapped;
+};
+
+// Per frame slot bump arenas, one list of blocks per memory type and resource kind
+struct TransientArena {
+    std::vector<LinearBlock> blocks[VK_MAX_MEMORY_TYPES][RESOURCE_KIND_COUNT];
+};
+
+struct MemoryTypeStats {
+    uint32_t blockCount;
+    VkDeviceSize blockBytes;
+    VkDeviceSize usedBytes;
+    uint32_t allocationCount;
+    uint32_t freeRangeCount;
+    VkDeviceSize largestFreeRange;
+    // 0 when all free memory is one contiguous range, approaches 1 as it gets split into many small ranges
+    float fragmentation;
+    uint32_t dedicatedCount;
+    VkDeviceSize dedicatedBytes;
+    VkDeviceSize transientBytes;
+    VkDeviceSize transientUsedBytes;
+};
+
+struct AllocatorStats {
+    MemoryTypeStats types[VK_MAX_MEMORY_TYPES];
+    uint32_t memoryTypeCount;
+    uint32_t deviceMemoryObjects;
+    uint32_t maxMemoryAllocationCount;
+};
+
+struct MemoryAllocator {
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    VkDeviceSize nonCoherentAtomSize;
+    uint32_t maxMemoryAllocationCount;
+    uint32_t deviceMemoryObjects;
+    std::vector<std::unique_ptr<TlsfBlock>> blocks[VK_MAX_MEMORY_TYPES][RESOURCE_KIND_COUNT];
+    std::vector<TransientArena> transient;
+    uint32_t currentSlot;
+    uint32_t dedicatedCount[VK_MAX_MEMORY_TYPES];
+    VkDeviceSize dedicatedBytes[VK_MAX_MEMORY_TYPES];
+    std::mutex mutex;
+};
+
+VkResult createMemoryAllocator (VkPhysicalDevice physicalDevice, VkDevice device, uint32_t frameSlots, MemoryAllocator *allocator);
+void destroyMemoryAllocator (MemoryAllocator *allocator);
+
+// Picks a memory type that has all of the required flags, preferring ones that also have the preferred flags
+VkResult allocateMemory (MemoryAllocator *allocator, const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred, AllocationUsage usage, ResourceKind kind, Allocation *allocation);
+void freeMemory (MemoryAllocator *allocator, Allocation *allocation);
+// Recycles every transient allocation made the last time this frame slot was used. Call once the slot's fence has signaled.
+void beginTransientFrame (MemoryAllocator *allocator, uint32_t slot);
+// No-op for coherent memory. offset and size are relative to the allocation and get widened to nonCoherentAtomSize.
+VkResult flushAllocation (MemoryAllocator *allocator, const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+VkResult invalidateAllocation (MemoryAllocator *allocator, const Allocation& allocation, VkDeviceSize offset = 0,
+        VkDeviceSize size = VK_WHOLE_SIZE);
+
+// Buffers used by more than one of sharingFamilies are created with concurrent sharing
+VkResult createAllocatedBuffer (MemoryAllocator *allocator, VkDeviceSize size, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred, AllocationUsage usage, VkBuffer *buffer, Allocation *allocation,
+        const std::vector<uint32_t>& sharingFamilies = std::vector<uint32_t>());
+void destroyAllocatedBuffer (MemoryAllocator *allocator, VkBuffer buffer, Allocation *allocation);
+VkResult createAllocatedImage (MemoryAllocator *allocator, const VkImageCreateInfo& imageCreateInfo, VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred, VkImage *image, Allocation *allocation);
+void destroyAllocatedImage (MemoryAllocator *allocator, VkImage image, Allocation *allocation);
+
+AllocatorStats getAllocatorStats (MemoryAllocator *allocator);
+void logAllocatorStats (MemoryAllocator *allocator);
+
+#endif // _MEMORY_ALLOCATOR_H_
@@ -0,0 +1,55 @@
+#ifndef _MESH_FILE_H_
+#define _MESH_FILE_H_
+
+#include <cstdint>
+
+// Binary mesh container written by tools/meshConvert and mapped as it is at runtime. A header is followed by the vertex,
+// index and meshlet sections, each one starting on a page boundary so they can be handed to the uploader straight out of
+// the mapping. Everything is little endian.
+#define MESH_FILE_MAGIC         0x4853454du     // "MESH"
+#define MESH_FILE_VERSION       1
+#define MESH_FILE_ALIGNMENT     4096
+// Limits of every meshlet, chosen to fit a 64 wide workgroup and a 128 primitive mesh shader output
+#define MESHLET_MAX_VERTICES    64
+#define MESHLET_MAX_TRIANGLES   124
+
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+// A range of the index buffer referencing at most MESHLET_MAX_VERTICES distinct vertices, with its bounding sphere
+struct Meshlet {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+    uint32_t padding;
+    float sphere[4];
+};
+
+struct MeshFileSection {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;        // 32 bit indices
+    uint32_t meshletCount;
+    uint32_t vertexStride;
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphere[4];
+    MeshFileSection vertices;
+    MeshFileSection indices;
+    MeshFileSection meshlets;
+};
+
+static_assert(sizeof(MeshVertex) == 32, "MeshVertex must match the file layout");
+static_assert(sizeof(Meshlet) == 32, "Meshlet must match the file layout");
+static_assert(sizeof(MeshFileHeader) == 112, "MeshFileHeader must match the file layout");
+
+#endif // _MESH_FILE_H_
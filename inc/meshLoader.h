@@ -0,0 +1,90 @@
+#ifndef _MESH_LOADER_H_
+#define _MESH_LOADER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "memoryAllocator.h"
+#include "meshFile.h"
+#include "uploader.h"
+
+// Largest piece of a section handed to the uploader at once, the staging ring is shared with everything else
+#define MESH_UPLOAD_CHUNK       (4ull << 20)
+// How long the loader thread sleeps when the staging ring is full
+#define MESH_LOADER_RETRY_MS    1
+
+// A mesh file mapped read only, sections point straight into the mapping
+struct MappedMesh {
+    const uint8_t *data;
+    size_t size;
+    const MeshFileHeader *header;
+};
+
+// Device local copy of a mesh file. Usable once resident is set, which only the render loop does.
+struct Mesh {
+    MeshFileHeader header;
+    VkBuffer vertexBuffer;
+    Allocation vertexMemory;
+    VkBuffer indexBuffer;
+    Allocation indexMemory;
+    VkBuffer meshletBuffer;
+    Allocation meshletMemory;
+    bool resident;
+    VkResult result;
+};
+
+struct MeshLoad {
+    std::string path;
+    Mesh *mesh;
+    // Steady clock nanoseconds
+    int64_t requested;
+    int64_t mapped;
+    int64_t queued;
+    UploadTicket lastUpload;
+    VkResult result;
+};
+
+// Maps mesh files on a background thread and copies their sections from the mapping straight into the staging ring,
+// without reading them into memory of its own first. Pages are faulted in before the uploader is locked, so the
+// render loop never waits on the disk.
+struct MeshLoader {
+    MemoryAllocator *allocator;
+    Uploader *uploader;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running;
+    // Guarded by mutex
+    std::deque<MeshLoad> requests;
+    std::vector<MeshLoad> queued;
+    // Only touched by the render loop
+    std::vector<MeshLoad> uploading;
+    // Requested and neither resident nor failed yet
+    uint32_t pending;
+    uint64_t bytesLoaded;
+    uint32_t meshesLoaded;
+};
+
+// Validates the header and every section against the file size
+VkResult mapMeshFile (const std::string& path, MappedMesh *mesh);
+void unmapMeshFile (MappedMesh *mesh);
+
+void createMeshLoader (MemoryAllocator *allocator, Uploader *uploader, MeshLoader *loader);
+// Finishes the mesh being copied and drops the remaining requests
+void destroyMeshLoader (MeshLoader *loader);
+// Called by the render loop. The mesh has to stay alive until it is resident or has failed.
+void loadMesh (MeshLoader *loader, const std::string& path, Mesh *mesh);
+// Once per frame, marks meshes whose uploads have completed as resident and logs their throughput. Failed meshes release
+// their buffers once the copies already queued into them have completed. Returns the number of meshes that are still
+// loading.
+uint32_t updateMeshLoads (MeshLoader *loader);
+void destroyMesh (MemoryAllocator *allocator, Mesh *mesh);
+
+#endif // _MESH_LOADER_H_
@@ -0,0 +1,44 @@
+#ifndef _OFFSCREEN_H_
+#define _OFFSCREEN_H_
+
+#include <vector>
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+#include "memoryAllocator.h"
+
+// Stand-in for a swapchain image when running without a window. Frame slot i always renders into target i,
+// so the slot's fence also guards the target and its readback buffer.
+struct OffscreenTarget {
+    VkImage image;
+    Allocation memory;
+    VkImageView view;
+    VkFramebuffer framebuffer;
+    VkBuffer readbackBuffer;
+    // Persistently mapped by the allocator
+    Allocation readbackMemory;
+    int64_t pendingFrame;
+};
+
+struct OffscreenTargets {
+    std::vector<OffscreenTarget> targets;
+    VkFormat format;
+    VkExtent2D extent;
+    bool readback;
+};
+
+VkResult createOffscreenTargets (MemoryAllocator *allocator, VkExtent2D extent, uint32_t count, bool readback, OffscreenTargets *res);
+VkResult createOffscreenFramebuffers (VkDevice device, VkRenderPass renderPass, OffscreenTargets *targets);
+void destroyOffscreenTargets (MemoryAllocator *allocator, OffscreenTargets *targets);
+
+// Copies the target into its host visible buffer if readback is enabled. Expects the image in TRANSFER_SRC_OPTIMAL,
+// the caller makes the copy visible to the host.
+void recordOffscreenReadback (VkCommandBuffer cmdBuffer, const OffscreenTargets& targets, uint32_t index);
+
+// Must only be called once the fence of the frame that rendered into the target has signaled.
+// Returns a pointer to tightly packed RGBA8 pixels, or nullptr if nothing was read back.
+const uint8_t* mapOffscreenReadback (MemoryAllocator *allocator, const OffscreenTargets& targets, uint32_t index);
+bool writeFramePPM (const std::string& path, const uint8_t *rgba, VkExtent2D extent);
+
+#endif // _OFFSCREEN_H_
@@ -0,0 +1,37 @@
+#ifndef _PARTICLES_H_
+#define _PARTICLES_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "descriptors.h"
+#include "memoryAllocator.h"
+#include "pipelines.h"
+
+#define PARTICLE_GROUP_SIZE 64
+// Specialization constant ID of the workgroup size in particles.comp
+#define PARTICLE_GROUP_SIZE_ID 0
+
+// Particle simulation used as a compute workload. Every frame slot owns a state buffer, a frame reads the state of the
+// previous frame and writes its own, so the buffer being written is never one graphics work still in flight reads.
+struct ParticleSystem {
+    uint32_t count;
+    uint32_t groupSize;
+    VkDescriptorSetLayout setLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    std::vector<VkBuffer> buffers;
+    std::vector<Allocation> memory;
+};
+
+// Uses the prebuilt variant shaders/particles.comp.group<groupSize>.spv if there is one, otherwise specializes the
+// generic shader. desc receives the pipeline description, for rebuilding the pipeline later.
+VkResult createParticleSystem (MemoryAllocator *allocator, PipelineLibrary *library, DescriptorLayoutCache *layouts, uint32_t count, uint32_t groupSize,
+        uint32_t slotCount, const std::vector<uint32_t>& sharingFamilies, ParticleSystem *particles, ComputePipelineDesc *desc);
+void destroyParticleSystem (MemoryAllocator *allocator, ParticleSystem *particles);
+// The first frame seeds the state instead of integrating it
+void recordParticleUpdate (const ParticleSystem& particles, FrameDescriptors *descriptors, VkCommandBuffer cmdBuffer, uint32_t slot, uint32_t previousSlot,
+        uint64_t frameNumber, float dt);
+
+#endif // _PARTICLES_H_
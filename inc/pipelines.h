@@ -0,0 +1,85 @@
+#ifndef _PIPELINES_H_
+#define _PIPELINES_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+struct SpecializationConstant {
+    uint32_t id;
+    uint32_t value;
+};
+
+// Everything that identifies a graphics pipeline. Two descriptions with the same state and shader code hash
+// to the same key and share one VkPipeline.
+struct GraphicsPipelineDesc {
+    std::string vertexShader;       // Paths to SPIR-V binaries
+    std::string fragmentShader;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    VkBool32 blendEnable = VK_FALSE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+    // Applied to both stages
+    std::vector<SpecializationConstant> specialization;
+};
+
+struct ComputePipelineDesc {
+    std::string computeShader;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    std::vector<SpecializationConstant> specialization;
+};
+
+struct ShaderModule {
+    VkShaderModule module;
+    uint64_t codeHash;
+};
+
+// Pipelines keyed by state hash, backed by a VkPipelineCache that persists across runs. Pipelines can be requested from
+// several threads at once, they are compiled in parallel.
+struct PipelineLibrary {
+    VkPipelineCache cache;
+    std::string cachePath;
+    // Whether the cache was primed from disk, i.e. whether pipeline creation should mostly hit the driver cache
+    bool warm;
+    size_t loadedBytes;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    std::unordered_map<uint64_t, VkPipeline> pipelines;
+    std::unordered_map<std::string, ShaderModule> shaders;
+    // Guards the maps only, the VkPipelineCache is internally synchronized and compilation happens outside of the lock
+    std::mutex mutex;
+};
+
+// Loads the cache from cachePath if it was written by the same device and driver, otherwise starts out cold.
+// An empty cachePath disables persistence.
+VkResult createPipelineLibrary (VkPhysicalDevice physicalDevice, VkDevice device, const std::string& cachePath, PipelineLibrary *library);
+// Serializes the cache to disk. Written to a temporary file first so a crash never leaves a truncated cache behind.
+VkResult savePipelineLibrary (VkDevice device, const PipelineLibrary& library);
+void destroyPipelineLibrary (VkDevice device, PipelineLibrary *library);
+
+uint64_t hashPipelineDesc (VkDevice device, PipelineLibrary *library, const GraphicsPipelineDesc& desc);
+VkResult getGraphicsPipeline (VkDevice device, PipelineLibrary *library, const GraphicsPipelineDesc& desc, VkPipeline *pipeline);
+uint64_t hashPipelineDesc (VkDevice device, PipelineLibrary *library, const ComputePipelineDesc& desc);
+VkResult getComputePipeline (VkDevice device, PipelineLibrary *library, const ComputePipelineDesc& desc, VkPipeline *pipeline);
+
+// Reads the SPIR-V at path again and replaces the library's module for it, later pipeline requests use the new code.
+// Pipelines created from the old module are unaffected. Must not run while other threads create pipelines from path.
+VkResult reloadShaderModule (VkDevice device, PipelineLibrary *library, const std::string& path);
+// Removes the pipeline from the library without destroying it, the caller destroys it once nothing uses it anymore.
+// Returns VK_NULL_HANDLE if the library does not own a pipeline with that key.
+VkPipeline takePipeline (PipelineLibrary *library, uint64_t key);
+
+// Single subpass, single color attachment render pass that clears on load. The attachment has to be in
+// COLOR_ATTACHMENT_OPTIMAL before the pass and stays in it.
+VkResult createRenderPass (VkDevice device, VkFormat format, VkRenderPass *renderPass);
+
+#endif // _PIPELINES_H_
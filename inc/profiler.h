@@ -0,0 +1,96 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Number of frames kept for reports and exports, older frames are overwritten
+#define PROFILER_HISTORY    8192
+
+enum CpuScope {
+    CPU_SCOPE_EVENTS,
+    CPU_SCOPE_ACQUIRE,
+    CPU_SCOPE_RECORD,
+    CPU_SCOPE_SUBMIT,
+    CPU_SCOPE_FENCE_WAIT,
+    CPU_SCOPE_PRESENT,
+    CPU_SCOPE_COUNT
+};
+
+// All times are in nanoseconds relative to Profiler::origin, -1 means the interval was not recorded this frame
+struct FrameSample {
+    uint64_t frameNumber;
+    int64_t frameStart;
+    int64_t frameEnd;
+    int64_t scopeStart[CPU_SCOPE_COUNT];
+    int64_t scopeEnd[CPU_SCOPE_COUNT];
+    int64_t gpuStart;
+    int64_t gpuEnd;
+    // Device memory of streamed textures, sampled once per frame
+    uint64_t textureBytes;
+};
+
+struct Profiler {
+    // Sized once at creation, nothing on the per-frame path allocates
+    std::vector<FrameSample> samples;
+    std::vector<int64_t> slotFrame;
+    uint64_t frameCount;
+    std::chrono::steady_clock::time_point origin;
+
+    VkQueryPool queryPool;
+    bool gpuTimestamps;
+    double timestampPeriod;
+    uint64_t timestampMask;
+    // GPU timestamps live in their own time domain, they are aligned to the CPU clock using the first frame
+    bool gpuOffsetKnown;
+    int64_t gpuOffset;
+
+    // Nanoseconds from an input event to the submit of the first frame that applied it, the last PROFILER_HISTORY ones
+    std::vector<int64_t> inputLatency;
+    uint64_t inputCount;
+};
+
+VkResult createProfiler (VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t slotCount, Profiler *profiler);
+void destroyProfiler (VkDevice device, Profiler *profiler);
+
+void profilerBeginFrame (Profiler *profiler, uint64_t frameNumber);
+void profilerEndFrame (Profiler *profiler);
+void profilerBeginScope (Profiler *profiler, CpuScope scope);
+void profilerEndScope (Profiler *profiler, CpuScope scope);
+void profilerInputLatency (Profiler *profiler, int64_t latency);
+void profilerTextureMemory (Profiler *profiler, uint64_t bytes);
+
+// Brackets the GPU work of a frame slot's command buffer. Must be recorded outside of any render pass.
+void profilerCmdBegin (Profiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot);
+void profilerCmdEnd (Profiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot);
+// Reads back the timestamps written by the slot's previous frame. Only call once the slot's fence has signaled.
+void profilerCollect (Profiler *profiler, VkDevice device, uint32_t slot);
+
+// Prints p50/p95/p99 CPU frame times, GPU times and input latencies over the retained history, and the peak of resident
+// texture memory
+void profilerReport (const Profiler& profiler);
+bool profilerExportChromeTrace (const Profiler& profiler, const std::string& path);
+bool profilerExportCsv (const Profiler& profiler, const std::string& path);
+
+// Wall clock time of the startup phases, every phase lasts from the previous mark to its own. Phases that run on other
+// threads are only visible through the time the main thread spent waiting for them.
+struct StartupTimer {
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point last;
+    std::vector<std::pair<const char*, double>> phases;
+};
+
+void startupBegin (StartupTimer *timer);
+void startupMark (StartupTimer *timer, const char *phase);
+// Prints every phase and the total, meant to be called once the first frame has been submitted
+void startupReport (const StartupTimer& timer);
+
+// Writes a flat JSON object for benchmark runs: throughput, CPU and GPU frame time percentiles, time to first frame and
+// the peak resident memory of the process
+bool profilerExportBenchmark (const Profiler& profiler, const StartupTimer& startup, uint64_t frames, double seconds, const std::string& path);
+
+#endif // _PROFILER_H_
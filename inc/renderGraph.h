@@ -0,0 +1,153 @@
+#ifndef _RENDER_GRAPH_H_
+#define _RENDER_GRAPH_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "memoryAllocator.h"
+
+#define GRAPH_NONE  UINT32_MAX
+
+// How a pass uses a resource, each one maps to the stages, accesses and (for images) the layout it needs
+enum GraphUsage {
+    GRAPH_USAGE_NONE,               // Contents are undefined, nothing to wait for
+    GRAPH_USAGE_ACQUIRED,           // Swapchain image whose acquire semaphore is waited on at COLOR_ATTACHMENT_OUTPUT
+    GRAPH_USAGE_COLOR_ATTACHMENT,   // Written by a render pass that clears it
+    GRAPH_USAGE_SAMPLED,
+    GRAPH_USAGE_STORAGE_READ,
+    GRAPH_USAGE_STORAGE_WRITE,
+    GRAPH_USAGE_VERTEX_BUFFER,
+    GRAPH_USAGE_VERTEX_STORAGE_READ,    // Storage buffer read by a vertex shader
+    GRAPH_USAGE_INDIRECT_BUFFER,
+    GRAPH_USAGE_TRANSFER_SRC,
+    GRAPH_USAGE_TRANSFER_DST,
+    GRAPH_USAGE_HOST_READ,
+    GRAPH_USAGE_PRESENT,
+    GRAPH_USAGE_COUNT
+};
+
+typedef void (*GraphPassFunction)(VkCommandBuffer cmdBuffer, void *data);
+
+struct GraphResourceUse {
+    uint32_t resource;
+    GraphUsage usage;
+};
+
+struct GraphPass {
+    const char *name;
+    GraphPassFunction function;
+    void *data;
+    std::vector<GraphResourceUse> uses;
+    bool culled;
+};
+
+// Tracked per resource while the graph is executed
+struct GraphResourceState {
+    VkImageLayout layout;
+    // Last write that has not been made visible to every later reader yet
+    VkPipelineStageFlags writeStages;
+    VkAccessFlags writeAccess;
+    // Readers since the last write, a later write has to wait for them
+    VkPipelineStageFlags readStages;
+    // Stages and accesses the last write is already visible to
+    VkPipelineStageFlags visibleStages;
+    VkAccessFlags visibleAccess;
+};
+
+struct GraphResource {
+    VkImage image;
+    VkBuffer buffer;
+    VkImageAspectFlags aspect;
+    GraphUsage initialUsage;
+    // GRAPH_USAGE_NONE leaves the resource in whatever state its last pass left it
+    GraphUsage finalUsage;
+    // Read after the graph (presented, read back, ...), passes only writing other resources are culled
+    bool output;
+    // Scratch for culling, a later kept pass reads the current contents
+    bool needed;
+    uint32_t transient;
+    // Passes using the resource after culling, GRAPH_NONE if none does
+    uint32_t firstPass;
+    uint32_t lastPass;
+    GraphResourceState state;
+};
+
+// What a transient is declared with, compared against the live transients when compiling
+struct TransientDesc {
+    VkImageCreateInfo createInfo;
+    // Color attachments used by this render pass get a view and a framebuffer, VK_NULL_HANDLE for none
+    VkRenderPass renderPass;
+};
+
+// Graph owned image, only alive for the passes that use it and sharing memory with transients that are not alive at
+// the same time
+struct TransientImage {
+    VkImageCreateInfo createInfo;
+    VkRenderPass renderPass;
+    VkImage image;
+    VkImageView view;
+    VkFramebuffer framebuffer;
+    VkMemoryRequirements requirements;
+    VkDeviceSize offset;
+    // Lifetime the placement was computed for, in passes after culling
+    uint32_t firstPass;
+    uint32_t lastPass;
+    // Stages and accesses of every transient sharing memory with this one, the first use waits on them, including
+    // the uses of the previous frame
+    VkPipelineStageFlags aliasStages;
+    VkAccessFlags aliasAccess;
+};
+
+struct RetiredTransients {
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    std::vector<VkFramebuffer> framebuffers;
+    Allocation memory;
+    uint64_t retiredAtFrame;
+};
+
+// Passes are declared anew every frame together with the resources they use. Compiling culls the passes whose
+// results are never read, places transient images in shared memory and executing records every pass preceded by
+// a single barrier batch with every transition and hazard it needs.
+struct RenderGraph {
+    MemoryAllocator *allocator;
+    std::vector<GraphResource> resources;
+    std::vector<GraphPass> passes;
+    uint32_t passCount;
+    std::vector<TransientImage> transients;
+    // Declared since beginRenderGraph
+    std::vector<TransientDesc> declaredTransients;
+    Allocation transientMemory;
+    // Memory the transients would need without aliasing
+    VkDeviceSize unaliasedBytes;
+    std::vector<RetiredTransients> retired;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    uint64_t culledPasses;
+    uint64_t barrierBatches;
+};
+
+void createRenderGraph (MemoryAllocator *allocator, RenderGraph *graph);
+void destroyRenderGraph (RenderGraph *graph);
+
+// Forgets every pass and resource of the previous frame, transients are kept for reuse
+void beginRenderGraph (RenderGraph *graph);
+uint32_t importImage (RenderGraph *graph, VkImage image, VkImageAspectFlags aspect, GraphUsage initialUsage, GraphUsage finalUsage, bool output);
+uint32_t importBuffer (RenderGraph *graph, VkBuffer buffer, GraphUsage finalUsage, bool output);
+// The image is created by compileRenderGraph, identical descriptions in the same order reuse last frame's images. With a
+// render pass it also gets a framebuffer with the image as the only attachment.
+uint32_t createTransientImage (RenderGraph *graph, const VkImageCreateInfo& createInfo, VkRenderPass renderPass = VK_NULL_HANDLE);
+uint32_t addGraphPass (RenderGraph *graph, const char *name, GraphPassFunction function, void *data);
+void useGraphResource (RenderGraph *graph, uint32_t pass, uint32_t resource, GraphUsage usage);
+
+// Replaced transients stay alive until frameNumber has completed. Replacing them invalidates command buffers that
+// recorded the graph before, which only happens when the transient descriptions or their lifetimes change.
+VkResult compileRenderGraph (RenderGraph *graph, uint64_t frameNumber);
+// Valid after compileRenderGraph
+VkImage graphImage (const RenderGraph& graph, uint32_t resource);
+VkFramebuffer graphFramebuffer (const RenderGraph& graph, uint32_t resource);
+void executeRenderGraph (RenderGraph *graph, VkCommandBuffer cmdBuffer);
+// Once per frame with the number of completed frames
+void releaseRenderGraphTransients (RenderGraph *graph, uint64_t framesCompleted);
+
+#endif // _RENDER_GRAPH_H_
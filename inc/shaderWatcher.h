@@ -0,0 +1,88 @@
+#ifndef _SHADER_WATCHER_H_
+#define _SHADER_WATCHER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "pipelines.h"
+
+#define SHADER_WATCH_INTERVAL_MS    250
+// Used when the GLSLC environment variable is not set, the flags match what the Makefile passes
+#define DEFAULT_SHADER_COMPILER     "glslc"
+#define SHADER_COMPILE_FLAGS        "--target-env=vulkan1.0 -O"
+
+struct WatchedShader {
+    std::string source;     // GLSL, the SPIR-V path without its extension
+    std::string spirv;
+    int64_t modified;       // Nanoseconds since the epoch, -1 if the source could not be found
+};
+
+struct WatchedPipeline {
+    bool compute;
+    GraphicsPipelineDesc graphicsDesc;
+    ComputePipelineDesc computeDesc;
+    // Key of the latest build, only touched by the watcher thread once it is started
+    uint64_t key;
+    // The owner's handle, only written by applyShaderReloads
+    VkPipeline *pipeline;
+};
+
+struct ReloadedPipeline {
+    uint32_t watched;
+    VkPipeline pipeline;
+    // Library key of the pipeline it replaces
+    uint64_t previousKey;
+};
+
+struct RetiredPipeline {
+    VkPipeline pipeline;
+    uint64_t retiredAtFrame;
+};
+
+// Polls the GLSL sources of the watched pipelines on a background thread. A changed source is compiled to SPIR-V and
+// every pipeline using it is rebuilt on that thread, the render loop only swaps the handles at a frame boundary.
+// Replaced pipelines are destroyed once every frame that could have used them has completed.
+struct ShaderWatcher {
+    VkDevice device;
+    PipelineLibrary *library;
+    std::string compiler;
+    std::vector<WatchedShader> shaders;
+    // Fixed once the watcher is started
+    std::vector<WatchedPipeline> pipelines;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running;
+    // Guarded by mutex
+    std::vector<ReloadedPipeline> ready;
+    std::atomic<bool> pending;
+    // Only touched by the render loop
+    std::vector<RetiredPipeline> retired;
+    std::atomic<uint64_t> reloads;
+    std::atomic<uint64_t> failures;
+};
+
+void createShaderWatcher (VkDevice device, PipelineLibrary *library, ShaderWatcher *watcher);
+// Stops the thread and destroys every retired pipeline, the device has to be idle. Pipelines that were rebuilt but
+// never swapped in belong to the library.
+void destroyShaderWatcher (ShaderWatcher *watcher);
+
+// Only before startShaderWatcher. The pipeline has to come from the watcher's library and every holder of the handle
+// has to be watched, the replaced pipeline is destroyed.
+void watchGraphicsPipeline (ShaderWatcher *watcher, const GraphicsPipelineDesc& desc, VkPipeline *pipeline);
+void watchComputePipeline (ShaderWatcher *watcher, const ComputePipelineDesc& desc, VkPipeline *pipeline);
+void startShaderWatcher (ShaderWatcher *watcher);
+
+// Once per frame before anything is recorded. Swaps in the pipelines rebuilt since the last call and returns whether
+// there were any, command buffers recorded before have to be recorded again.
+bool applyShaderReloads (ShaderWatcher *watcher, uint64_t frameNumber);
+// Once per frame with the number of completed frames
+void destroyRetiredPipelines (ShaderWatcher *watcher, uint64_t framesCompleted);
+
+#endif // _SHADER_WATCHER_H_
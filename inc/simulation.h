@@ -0,0 +1,43 @@
+#ifndef _SIMULATION_H_
+#define _SIMULATION_H_
+
+#include <vector>
+
+#include "eventQueue.h"
+
+#define SIMULATION_TICK_RATE    60
+#define SIMULATION_TICK_SECONDS (1.0 / SIMULATION_TICK_RATE)
+// A render thread that fell this far behind drops the rest of the time instead of trying to catch up
+#define SIMULATION_MAX_TICKS    8
+
+struct SimulationState {
+    uint64_t tick;
+    // Simulated seconds, they do not advance while paused
+    double time;
+    bool paused;
+};
+
+// Fixed rate simulation driven by the render thread. Input is applied at the start of the next tick, and rendering
+// interpolates between the last two ticks so that motion stays smooth at any frame rate.
+struct Simulation {
+    int64_t tickLength;
+    int64_t accumulator;
+    int64_t lastTime;
+    SimulationState previous;
+    SimulationState current;
+    // Received since the last tick
+    std::vector<InputEvent> pending;
+    // Timestamps of the inputs the ticks of the last advanceSimulation call applied
+    std::vector<int64_t> applied;
+    uint64_t droppedTicks;
+};
+
+// now is in nanoseconds of the same clock later calls use
+void createSimulation (Simulation *simulation, int64_t now);
+void queueSimulationInput (Simulation *simulation, const InputEvent& event);
+// Runs every tick that has become due since the last call and returns how many ran
+uint32_t advanceSimulation (Simulation *simulation, int64_t now);
+// Simulated time between the previous and the current tick, matching how far the clock is past the current one
+double simulationTime (const Simulation& simulation);
+
+#endif // _SIMULATION_H_
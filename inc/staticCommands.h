@@ -0,0 +1,47 @@
+#ifndef _STATIC_COMMANDS_H_
+#define _STATIC_COMMANDS_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "frameRing.h"
+
+struct StaticCommandBuffer {
+    VkCommandBuffer cmdBuffer;
+    bool dirty;
+    bool submitted;
+    // Last frame that submitted the buffer, it is pending until that frame has completed
+    uint64_t lastFrame;
+};
+
+// Command buffers for work that does not change between frames, recorded once per render target (swapchain image or
+// offscreen target) and resubmitted as they are until they are invalidated. When the recorded work depends on the
+// frame slot (the fallback resource table has one set per slot) there is one buffer per target and slot.
+struct StaticCommands {
+    VkDevice device;
+    VkCommandPool pool;
+    uint32_t slotCount;
+    // Indexed by target * slotCount + slot
+    std::vector<StaticCommandBuffer> buffers;
+    uint64_t recordings;
+};
+
+// slotCount is 1 if the recorded work is the same for every frame slot
+VkResult createStaticCommands (VkDevice device, uint32_t queueIndex, uint32_t targetCount, uint32_t slotCount, StaticCommands *commands);
+void destroyStaticCommands (StaticCommands *commands);
+// After a scene change, every buffer is recorded again the next time it is used
+void invalidateStaticCommands (StaticCommands *commands);
+// After something only one slot's buffers reference has changed
+void invalidateStaticCommandsForSlot (StaticCommands *commands, uint32_t slot);
+// For a new number of targets after swapchain recreation, every buffer becomes dirty
+VkResult resizeStaticCommands (StaticCommands *commands, const FrameRing& ring, uint32_t targetCount);
+
+// Returns the buffer to submit for the target in the ring's current frame. A dirty buffer is returned in the recording
+// state with recording set, the caller records it and ends it. Only waits if the buffer is still pending from an earlier
+// frame that is not known to have completed.
+VkCommandBuffer acquireStaticCommands (StaticCommands *commands, const FrameRing& ring, uint32_t target, bool *recording);
+// After the current frame was submitted with the target's buffer
+void submittedStaticCommands (StaticCommands *commands, const FrameRing& ring, uint32_t target);
+
+#endif // _STATIC_COMMANDS_H_
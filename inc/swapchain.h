@@ -0,0 +1,67 @@
+#ifndef _SWAPCHAIN_H_
+#define _SWAPCHAIN_H_
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <SDL2/SDL.h>
+
+// Trades input-to-photon latency against throughput. Each profile maps to an ordered list of present modes
+// (the first one the surface supports wins, FIFO is always available) and a swapchain image count.
+enum LatencyProfile {
+    LATENCY_VSYNC,          // FIFO, one image more than the minimum
+    LATENCY_ADAPTIVE,       // FIFO_RELAXED, tears instead of stuttering when a frame is late
+    LATENCY_LOW,            // MAILBOX with three images, newest frame always wins, no tearing
+    LATENCY_THROUGHPUT      // IMMEDIATE, never waits for vblank, may tear
+};
+
+struct SwapchainConfig {
+    LatencyProfile profile = LATENCY_VSYNC;
+    // Optional overrides for the values picked by the profile
+    bool forcePresentMode = false;
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    uint32_t imageCount = 0;
+};
+
+struct Swapchain {
+    VkSwapchainKHR handle;
+    std::vector<VkImage> images;
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> framebuffers;
+    // Signaled by the submit rendering into an image and waited on by its present. Per image rather than per frame slot,
+    // only acquiring the image again guarantees the previous present has consumed the semaphore.
+    std::vector<VkSemaphore> renderFinished;
+    VkFormat format;
+    VkColorSpaceKHR colorSpace;
+    VkExtent2D extent;
+    VkPresentModeKHR presentMode;
+    // Always a color attachment, also a transfer destination where the surface supports it
+    VkImageUsageFlags imageUsage;
+};
+
+// A replaced swapchain has to outlive every frame that was submitted before it was replaced
+struct RetiredSwapchain {
+    Swapchain swapchain;
+    uint64_t retiredAtFrame;
+};
+
+bool parseLatencyProfile (const char *name, LatencyProfile *profile);
+bool parsePresentMode (const char *name, VkPresentModeKHR *mode);
+const char* presentModeName (VkPresentModeKHR mode);
+
+VkResult createSwapchain (VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, SDL_Window* window,
+        uint32_t graphicsQueueIndex, uint32_t presentQueueIndex, const SwapchainConfig& config, VkSwapchainKHR oldSwapchain, Swapchain *swapchain);
+// One view, framebuffer and render finished semaphore per swapchain image, destroyed together with the swapchain
+VkResult createSwapchainFramebuffers (VkDevice device, VkRenderPass renderPass, Swapchain *swapchain);
+void destroySwapchain (VkDevice device, Swapchain *swapchain);
+
+// Creates a new swapchain from the current one and retires the old one instead of idling the device.
+// Returns VK_NOT_READY without touching anything while the window has a zero sized drawable area (e.g. minimized).
+VkResult recreateSwapchain (VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, SDL_Window* window,
+        uint32_t graphicsQueueIndex, uint32_t presentQueueIndex, const SwapchainConfig& config, uint64_t frameNumber,
+        Swapchain *swapchain, std::vector<RetiredSwapchain>& retired);
+// Destroys every retired swapchain that is no longer referenced by a frame older than completedFrames
+void destroyRetiredSwapchains (VkDevice device, std::vector<RetiredSwapchain>& retired, uint64_t completedFrames);
+
+#endif // _SWAPCHAIN_H_
@@ -0,0 +1,89 @@
+#ifndef _TEXTURE_STREAMER_H_
+#define _TEXTURE_STREAMER_H_
+
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "descriptors.h"
+#include "ktx2.h"
+#include "memoryAllocator.h"
+#include "uploader.h"
+
+#define TEXTURE_DEFAULT_BUDGET          (256ull << 20)
+// Mips this size and smaller are loaded with the texture and never evicted
+#define TEXTURE_MIN_RESIDENT_SIZE       64
+// Texture data handed to the uploader per frame, one texture may exceed it on its own
+#define TEXTURE_STREAM_BYTES_PER_FRAME  (16ull << 20)
+
+// Holds mips [topLevel, levelCount) of a texture, its level 0 is the texture's topLevel
+struct TextureImage {
+    VkImage image;
+    Allocation memory;
+    VkImageView view;
+    uint32_t topLevel;
+};
+
+struct StreamedTexture {
+    std::string path;
+    Ktx2File file;
+    // Sampled through the bindless table, VK_NULL_HANDLE until the smallest mips have arrived
+    TextureImage resident;
+    uint32_t bindlessIndex;
+    // Replaces resident once every level has been uploaded, VK_NULL_HANDLE when nothing is streaming
+    TextureImage pending;
+    // Levels of pending that still have to be queued, the smallest go first
+    uint32_t pendingLevels;
+    UploadTicket pendingUpload;
+    // Finest level that fits into the staging ring, finer ones are never loaded
+    uint32_t firstLevel;
+    // First of the levels that are always resident
+    uint32_t tailLevel;
+    // Finest level any use asked for since the last update, and the frame of that use
+    uint32_t wantedLevel;
+    uint64_t lastUsed;
+};
+
+struct RetiredTextureImage {
+    TextureImage image;
+    uint64_t retiredAtFrame;
+};
+
+// Textures start out with only their smallest mips and stream finer ones in as their on-screen size asks for them.
+// Every change of residency uploads a new image holding the wanted levels straight from the mapped file, smallest mip
+// first, and swaps it in once complete. Vulkan 1.0 has no way to grow or shrink an image in place without sparse
+// residency. When the budget would be exceeded the least recently used textures fall back to their tail first.
+struct TextureStreamer {
+    MemoryAllocator *allocator;
+    Uploader *uploader;
+    BindlessTable *table;
+    VkPhysicalDevice physicalDevice;
+    VkDeviceSize budget;
+    // Indexed by the handles loadTexture returns
+    std::vector<StreamedTexture> textures;
+    std::vector<RetiredTextureImage> retired;
+    // Memory of every live image, including pending and retired ones
+    VkDeviceSize residentBytes;
+    VkDeviceSize peakBytes;
+    uint64_t streamedBytes;
+    uint32_t evictions;
+};
+
+void createTextureStreamer (MemoryAllocator *allocator, Uploader *uploader, BindlessTable *table, VkPhysicalDevice physicalDevice, VkDeviceSize budget,
+        TextureStreamer *streamer);
+// The device has to be idle
+void destroyTextureStreamer (TextureStreamer *streamer);
+
+// Maps the file, the next update queues its smallest mips. Fails if the file can't be read or the device can't sample its
+// format, block compressed formats included.
+VkResult loadTexture (TextureStreamer *streamer, const std::string& path, uint32_t *texture);
+// Reports that the texture covers screenSize pixels along its longer axis in frameNumber
+void useTexture (TextureStreamer *streamer, uint32_t texture, float screenSize, uint64_t frameNumber);
+// BINDLESS_INVALID until the smallest mips are resident
+uint32_t textureIndex (const TextureStreamer& streamer, uint32_t texture);
+// Once per frame before the bindless table is updated. Swaps in finished images, retires the replaced ones, evicts and
+// queues the next uploads.
+void updateTextureStreaming (TextureStreamer *streamer, uint64_t frameNumber, uint64_t framesCompleted);
+
+#endif // _TEXTURE_STREAMER_H_
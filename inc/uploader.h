@@ -0,0 +1,109 @@
+#ifndef _UPLOADER_H_
+#define _UPLOADER_H_
+
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "memoryAllocator.h"
+
+#define DEFAULT_STAGING_SIZE    (32ull << 20)
+// Number of batches that can be in flight on the transfer queue at once
+#define UPLOAD_BATCH_COUNT      4
+
+typedef uint64_t UploadTicket;
+
+struct BufferUpload {
+    VkBuffer buffer;
+    VkBufferCopy region;
+};
+
+// Always covers a whole mip level of a single layer, which keeps every copy legal regardless of the transfer queue's
+// minImageTransferGranularity
+struct ImageUpload {
+    VkImage image;
+    VkBufferImageCopy region;
+    VkImageLayout finalLayout;
+};
+
+struct UploadBatch {
+    VkCommandPool cmdPool;
+    VkCommandBuffer cmdBuffer;
+    VkFence fence;
+    // Signaled when the batch releases resources to the graphics family, consumed by the frame that acquires them
+    VkSemaphore released;
+    UploadTicket ticket;
+    uint64_t stagingEnd;
+    bool pending;
+    // framesCompleted value after which the frame that waited on released has finished, UINT64_MAX until a frame waits on it
+    uint64_t semaphoreFreeAt;
+};
+
+// Uploads may be queued from any thread, every entry point takes the mutex. Flushing, retiring and acquiring stay with
+// the render loop.
+struct Uploader {
+    mutable std::mutex mutex;
+    VkDevice device;
+    VkQueue transferQueue;
+    uint32_t transferFamily;
+    uint32_t graphicsFamily;
+    VkBuffer stagingBuffer;
+    Allocation stagingMemory;
+    VkDeviceSize stagingSize;
+    VkDeviceSize copyAlignment;
+    // Monotonic byte counters into the staging ring, the offset is the counter modulo stagingSize
+    uint64_t stagingHead;
+    uint64_t stagingTail;
+    uint64_t stagingFlushed;
+    UploadBatch batches[UPLOAD_BATCH_COUNT];
+    uint32_t nextBatch;
+    // Ticket of the batch that is currently being filled, every earlier ticket has been submitted
+    UploadTicket openTicket;
+    UploadTicket completedTicket;
+    uint64_t framesCompleted;
+    std::vector<BufferUpload> bufferUploads;
+    std::vector<ImageUpload> imageUploads;
+    // Acquire half of the ownership transfers of submitted batches, recorded by the next frame
+    std::vector<VkBufferMemoryBarrier> bufferAcquires;
+    std::vector<VkImageMemoryBarrier> imageAcquires;
+    std::vector<VkSemaphore> acquireWaits;
+    uint64_t bytesUploaded;
+    uint64_t batchesSubmitted;
+};
+
+VkResult createUploader (MemoryAllocator *allocator, VkPhysicalDevice physicalDevice, VkQueue transferQueue, uint32_t transferFamily,
+        uint32_t graphicsFamily, VkDeviceSize stagingSize, Uploader *uploader);
+// Waits for every submitted batch, anything queued but not flushed is dropped
+void destroyUploader (MemoryAllocator *allocator, Uploader *uploader);
+
+// Copy data into the staging ring and queue a copy into the destination. Neither blocks: VK_NOT_READY means the ring is
+// full of data the GPU hasn't consumed yet and the upload should be retried on a later frame. The destination must not be
+// used by the graphics queue until a frame has called recordUploadAcquires after the upload was flushed.
+VkResult uploadBuffer (MemoryAllocator *allocator, Uploader *uploader, VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+        UploadTicket *ticket);
+VkResult uploadImage (MemoryAllocator *allocator, Uploader *uploader, VkImage image, VkImageAspectFlags aspect, uint32_t mipLevel,
+        uint32_t arrayLayer, VkExtent3D extent, const void *data, VkDeviceSize size, VkImageLayout finalLayout, UploadTicket *ticket);
+// Reserves staging space for the caller to fill in place, avoiding an extra copy when data is produced on the fly.
+// Must be followed by queueBufferCopy/queueImageCopy with the returned offset before the next flush, so only the thread
+// that flushes may use it.
+VkResult reserveStaging (Uploader *uploader, VkDeviceSize size, VkDeviceSize *offset, void **mapped);
+void queueBufferCopy (Uploader *uploader, VkBuffer buffer, VkDeviceSize dstOffset, VkDeviceSize stagingOffset, VkDeviceSize size);
+void queueImageCopy (Uploader *uploader, VkImage image, VkImageAspectFlags aspect, uint32_t mipLevel, uint32_t arrayLayer, VkExtent3D extent,
+        VkDeviceSize stagingOffset, VkImageLayout finalLayout);
+
+// Submits everything queued since the last flush as one batch. Returns VK_NOT_READY if all batches are still in flight,
+// in which case the uploads stay queued for the next call.
+VkResult flushUploads (MemoryAllocator *allocator, Uploader *uploader);
+// Whether the next flushUploads will submit. Only the flushing thread may rely on it, so an upload it queues right before
+// flushing is known to reach the GPU with this frame.
+bool uploadBatchReady (Uploader *uploader);
+// Polls batch fences and recycles their staging space, never waits. framesCompleted comes from the frame ring.
+void retireUploads (Uploader *uploader, uint64_t framesCompleted);
+bool uploadComplete (const Uploader& uploader, UploadTicket ticket);
+// Records the graphics side of pending ownership transfers into the command buffer of frameNumber and appends the
+// semaphores its submit must wait on
+void recordUploadAcquires (Uploader *uploader, VkCommandBuffer cmdBuffer, uint64_t frameNumber, std::vector<VkSemaphore>& waitSemaphores,
+        std::vector<VkPipelineStageFlags>& waitStages);
+
+#endif // _UPLOADER_H_
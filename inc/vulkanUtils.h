@@ -1,11 +1,23 @@
 #ifndef _VULKAN_UTILS_H_
 #define _VULKAN_UTILS_H_
 
+#include <string>
+#include <vector>
+
 #include <vulkan/vulkan.h>
 
 #define CLAMP(x, lo, hi)    ((x) < (lo) ? (lo) : (x) > (hi) ? (hi) : (x))
 
-#define ASSERT_RESULT(funCall, res, errorMsg) if (funCall != res) { panic(errorMsg); }
+#define LIKELY(x)           __builtin_expect(!!(x), 1)
+#define UNLIKELY(x)         __builtin_expect(!!(x), 0)
+
+// Kept in every build, a failing call is one predicted branch and the message only exists in the cold path
+#define ASSERT_RESULT(funCall, res, errorMsg) \
+    do { \
+        if (UNLIKELY((funCall) != (res))) { \
+            panic(errorMsg); \
+        } \
+    } while (0)
 
 #define ENUMERATE_OBJECTS(container, funCall1, funCall2, errorMsg) \
     { \
@@ -18,12 +30,31 @@
                 res = funCall2; \
             } \
         } \
-        if (res != VK_SUCCESS) { \
+        if (UNLIKELY(res != VK_SUCCESS)) { \
             panic(errorMsg); \
         } \
     }
 
-void panic (const char *msg);
+[[noreturn]] __attribute__((cold, noinline)) void panic (const char *msg);
 void log (const char *msg);
 
+VkResult createSemaphore (VkDevice device, VkSemaphore *semaphore);
+VkResult createFence (VkDevice device, VkFenceCreateFlags flags, VkFence *fence);
+VkResult createCommandPool (VkDevice device, uint32_t queueIndex, VkCommandPool *pool);
+VkResult allocateCommandBuffer (VkDevice device, VkCommandPool pool, VkCommandBuffer *buffer,
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+VkResult createImageView (VkDevice device, VkImage image, VkFormat format, VkImageView *view, uint32_t levelCount = 1);
+VkResult createFramebuffer (VkDevice device, VkRenderPass renderPass, VkImageView view, VkExtent2D extent, VkFramebuffer *framebuffer);
+// Returns UINT32_MAX if no memory type allowed by typeBits has all the requested properties
+uint32_t findMemoryType (VkPhysicalDevice physicalDevice, uint32_t typeBits, VkMemoryPropertyFlags properties);
+
+#define HASH_SEED   14695981039346656037ull
+
+// 64 bit FNV-1a, chain calls by passing the previous result as the seed
+uint64_t hashBytes (const void *data, size_t size, uint64_t seed = HASH_SEED);
+bool readFile (const std::string& path, std::vector<char>& contents);
+// Maps the whole file read only and advises the kernel it will be read front to back. Returns nullptr on failure.
+const uint8_t *mapFile (const std::string& path, size_t *size);
+void unmapFile (const uint8_t *data, size_t size);
+
 #endif // _VULKAN_UTILS_H_
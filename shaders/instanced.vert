@@ -0,0 +1,40 @@
+#version 450
+
+struct Instance {
+    vec4 sphere;
+    uint bucket;
+};
+
+layout(set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(set = 0, binding = 1) readonly buffer Visible {
+    uint visible[];
+};
+
+layout(push_constant) uniform Push {
+    mat4 viewProjection;
+    vec4 color;
+    uint base;
+} push;
+
+layout(location = 0) out vec3 fragColor;
+
+// A triangle at 0-2 and a quad at 3-6, selected by the bucket's index range
+const vec3 positions[7] = vec3[](
+    vec3(0.0, -1.0, 0.0),
+    vec3(0.87, 0.5, 0.0),
+    vec3(-0.87, 0.5, 0.0),
+    vec3(-0.7, -0.7, 0.0),
+    vec3(0.7, -0.7, 0.0),
+    vec3(0.7, 0.7, 0.0),
+    vec3(-0.7, 0.7, 0.0)
+);
+
+void main () {
+    Instance instance = instances[visible[push.base + gl_InstanceIndex]];
+    vec3 position = instance.sphere.xyz + positions[gl_VertexIndex] * instance.sphere.w;
+    gl_Position = push.viewProjection * vec4(position, 1.0);
+    fragColor = push.color.rgb;
+}
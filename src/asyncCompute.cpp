@@ -0,0 +1,103 @@
+#include "asyncCompute.h"
+#include "hostAllocator.h"
+#include "vulkanUtils.h"
+
+VkResult createAsyncCompute (VkDevice device, VkQueue queue, uint32_t family, VkQueue graphicsQueue, uint32_t graphicsFamily, bool enable,
+        uint32_t slotCount, AsyncCompute *compute) {
+    VkResult res = VK_SUCCESS;
+    compute->device = device;
+    compute->async = enable && queue != graphicsQueue;
+    compute->queue = compute->async ? queue : graphicsQueue;
+    compute->family = compute->async ? family : graphicsFamily;
+    compute->graphicsFamily = graphicsFamily;
+    compute->submits = 0;
+    compute->frames.resize(compute->async ? slotCount : 0);
+    for (ComputeFrame& frame : compute->frames) {
+        if ((res = createCommandPool(device, compute->family, &frame.cmdPool)) != VK_SUCCESS) return res;
+        if ((res = allocateCommandBuffer(device, frame.cmdPool, &frame.cmdBuffer)) != VK_SUCCESS) return res;
+        if ((res = createSemaphore(device, &frame.finished)) != VK_SUCCESS) return res;
+    }
+    return res;
+}
+
+void destroyAsyncCompute (AsyncCompute *compute) {
+    vkQueueWaitIdle(compute->queue);
+    for (ComputeFrame& frame : compute->frames) {
+        vkDestroySemaphore(compute->device, frame.finished, hostAllocator());
+        vkDestroyCommandPool(compute->device, frame.cmdPool, hostAllocator());
+    }
+    compute->frames.clear();
+}
+
+std::vector<uint32_t> computeSharingFamilies (const AsyncCompute& compute) {
+    if (compute.family == compute.graphicsFamily) {
+        return { compute.graphicsFamily };
+    }
+    return { compute.graphicsFamily, compute.family };
+}
+
+VkCommandBuffer beginComputeWork (AsyncCompute *compute, uint32_t slot, VkCommandBuffer graphicsCmdBuffer) {
+    VkCommandBuffer cmdBuffer = graphicsCmdBuffer;
+    if (compute->async) {
+        ComputeFrame& frame = compute->frames[slot];
+        ASSERT_RESULT(vkResetCommandPool(compute->device, frame.cmdPool, 0), VK_SUCCESS, "Failed to reset compute command pool");
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = nullptr
+        };
+        ASSERT_RESULT(vkBeginCommandBuffer(frame.cmdBuffer, &beginInfo), VK_SUCCESS, "Failed to begin compute command buffer");
+        cmdBuffer = frame.cmdBuffer;
+    }
+    // Covers writes of earlier frames' compute work, which ran on the same queue
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    return cmdBuffer;
+}
+
+VkResult submitComputeWork (AsyncCompute *compute, uint32_t slot, VkCommandBuffer graphicsCmdBuffer, VkPipelineStageFlags consumerStages,
+        std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages) {
+    if (!compute->async) {
+        VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                VK_ACCESS_INDEX_READ_BIT
+        };
+        vkCmdPipelineBarrier(graphicsCmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, consumerStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        return VK_SUCCESS;
+    }
+
+    ComputeFrame& frame = compute->frames[slot];
+    VkResult res = vkEndCommandBuffer(frame.cmdBuffer);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = nullptr,
+        .pWaitDstStageMask = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &frame.cmdBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &frame.finished
+    };
+    // No fence, the graphics submit waits on the semaphore and its fence covers both
+    if ((res = vkQueueSubmit(compute->queue, 1, &submitInfo, VK_NULL_HANDLE)) != VK_SUCCESS) {
+        return res;
+    }
+    compute->submits++;
+    // A semaphore wait is a full memory dependency, shared resources are created concurrent so no ownership transfer is needed
+    waitSemaphores.push_back(frame.finished);
+    waitStages.push_back(consumerStages);
+    return res;
+}
@@ -0,0 +1,56 @@
+#include "commandRecorder.h"
+#include "hostAllocator.h"
+#include "vulkanUtils.h"
+
+VkResult createCommandRecorder (VkDevice device, uint32_t queueIndex, uint32_t threadCount, uint32_t slotCount, CommandRecorder *recorder) {
+    VkResult res = VK_SUCCESS;
+    recorder->device = device;
+    recorder->threadCount = threadCount;
+    recorder->pools.resize(threadCount * slotCount);
+    for (ThreadCommandPool& pool : recorder->pools) {
+        pool.used = 0;
+        if ((res = createCommandPool(device, queueIndex, &pool.pool)) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    return res;
+}
+
+void destroyCommandRecorder (CommandRecorder *recorder) {
+    for (ThreadCommandPool& pool : recorder->pools) {
+        // Destroying the pool frees its buffers
+        vkDestroyCommandPool(recorder->device, pool.pool, hostAllocator());
+    }
+    recorder->pools.clear();
+}
+
+void resetCommandRecorder (CommandRecorder *recorder, uint32_t slot) {
+    for (uint32_t thread = 0; thread < recorder->threadCount; thread++) {
+        ThreadCommandPool& pool = recorder->pools[slot * recorder->threadCount + thread];
+        if (pool.used > 0) {
+            ASSERT_RESULT(vkResetCommandPool(recorder->device, pool.pool, 0), VK_SUCCESS, "Failed to reset thread command pool");
+            pool.used = 0;
+        }
+    }
+}
+
+VkCommandBuffer beginSecondary (CommandRecorder *recorder, uint32_t slot, uint32_t thread, const VkCommandBufferInheritanceInfo& inheritance) {
+    ThreadCommandPool& pool = recorder->pools[slot * recorder->threadCount + thread];
+    // Buffers are kept across resets, so after the first few frames this never allocates
+    if (pool.used == pool.buffers.size()) {
+        VkCommandBuffer buffer;
+        ASSERT_RESULT(allocateCommandBuffer(recorder->device, pool.pool, &buffer, VK_COMMAND_BUFFER_LEVEL_SECONDARY), VK_SUCCESS,
+                "Failed to allocate secondary command buffer");
+        pool.buffers.push_back(buffer);
+    }
+    VkCommandBuffer buffer = pool.buffers[pool.used++];
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+            (inheritance.renderPass != VK_NULL_HANDLE ? static_cast<VkCommandBufferUsageFlags>(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT) : 0u),
+        .pInheritanceInfo = &inheritance
+    };
+    ASSERT_RESULT(vkBeginCommandBuffer(buffer, &beginInfo), VK_SUCCESS, "Failed to begin secondary command buffer");
+    return buffer;
+}
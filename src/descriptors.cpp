@@ -0,0 +1,527 @@
+#include <algorithm>
+
+#include "descriptors.h"
+#include "hostAllocator.h"
+#include "vulkanUtils.h"
+
+VkResult getDescriptorSetLayout (VkDevice device, DescriptorLayoutCache *cache, std::vector<VkDescriptorSetLayoutBinding> bindings,
+        VkDescriptorSetLayout *layout) {
+    std::sort(bindings.begin(), bindings.end(), [] (const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+        return a.binding < b.binding;
+    });
+    // Hashed field by field, the structs have padding and a pointer that only matters through what it points to
+    uint64_t key = HASH_SEED;
+    for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+        key = hashBytes(&binding.binding, sizeof(binding.binding), key);
+        key = hashBytes(&binding.descriptorType, sizeof(binding.descriptorType), key);
+        key = hashBytes(&binding.descriptorCount, sizeof(binding.descriptorCount), key);
+        key = hashBytes(&binding.stageFlags, sizeof(binding.stageFlags), key);
+        if (binding.pImmutableSamplers != nullptr) {
+            key = hashBytes(binding.pImmutableSamplers, binding.descriptorCount * sizeof(VkSampler), key);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    auto it = cache->layouts.find(key);
+    if (it != cache->layouts.end()) {
+        *layout = it->second;
+        return VK_SUCCESS;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data()
+    };
+    VkResult res = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, hostAllocator(), layout);
+    if (res == VK_SUCCESS) {
+        cache->layouts[key] = *layout;
+    }
+    return res;
+}
+
+void destroyDescriptorLayoutCache (VkDevice device, DescriptorLayoutCache *cache) {
+    for (auto& entry : cache->layouts) {
+        vkDestroyDescriptorSetLayout(device, entry.second, hostAllocator());
+    }
+    cache->layouts.clear();
+}
+
+static VkResult createFramePool (VkDevice device, VkDescriptorPool *pool) {
+    // Rough mix of what a typical set uses, a pool running out of one type just moves on to the next pool
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 * DESCRIPTOR_POOL_SETS },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, DESCRIPTOR_POOL_SETS },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * DESCRIPTOR_POOL_SETS },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 * DESCRIPTOR_POOL_SETS },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2 * DESCRIPTOR_POOL_SETS },
+        { VK_DESCRIPTOR_TYPE_SAMPLER, DESCRIPTOR_POOL_SETS },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, DESCRIPTOR_POOL_SETS }
+    };
+    // No FREE_DESCRIPTOR_SET_BIT, sets are only ever released by resetting the whole pool
+    VkDescriptorPoolCreateInfo poolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .maxSets = DESCRIPTOR_POOL_SETS,
+        .poolSizeCount = sizeof(poolSizes) / sizeof(poolSizes[0]),
+        .pPoolSizes = poolSizes
+    };
+    return vkCreateDescriptorPool(device, &poolCreateInfo, hostAllocator(), pool);
+}
+
+VkResult createFrameDescriptors (VkDevice device, uint32_t threadCount, uint32_t slotCount, FrameDescriptors *descriptors) {
+    VkResult res = VK_SUCCESS;
+    descriptors->device = device;
+    descriptors->threadCount = threadCount;
+    descriptors->threads.resize(static_cast<size_t>(threadCount) * slotCount);
+    for (ThreadDescriptorPools& thread : descriptors->threads) {
+        thread.current = 0;
+        thread.pools.resize(1);
+        if ((res = createFramePool(device, &thread.pools[0])) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    return res;
+}
+
+void destroyFrameDescriptors (FrameDescriptors *descriptors) {
+    for (ThreadDescriptorPools& thread : descriptors->threads) {
+        for (VkDescriptorPool pool : thread.pools) {
+            vkDestroyDescriptorPool(descriptors->device, pool, hostAllocator());
+        }
+    }
+    descriptors->threads.clear();
+}
+
+void resetFrameDescriptors (FrameDescriptors *descriptors, uint32_t slot) {
+    for (uint32_t i = 0; i < descriptors->threadCount; i++) {
+        ThreadDescriptorPools& thread = descriptors->threads[slot * descriptors->threadCount + i];
+        for (uint32_t j = 0; j <= thread.current; j++) {
+            ASSERT_RESULT(vkResetDescriptorPool(descriptors->device, thread.pools[j], 0), VK_SUCCESS, "Failed to reset descriptor pool");
+        }
+        thread.current = 0;
+    }
+}
+
+VkResult allocateFrameDescriptorSet (FrameDescriptors *descriptors, uint32_t slot, uint32_t thread, VkDescriptorSetLayout layout,
+        VkDescriptorSet *set) {
+    ThreadDescriptorPools& pools = descriptors->threads[slot * descriptors->threadCount + thread];
+    VkDescriptorSetAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = VK_NULL_HANDLE,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout
+    };
+    bool freshPool = false;
+    while (true) {
+        allocateInfo.descriptorPool = pools.pools[pools.current];
+        VkResult res = vkAllocateDescriptorSets(descriptors->device, &allocateInfo, set);
+        // Drivers without VK_KHR_maintenance1 report an exhausted pool as fragmented. A set that doesn't fit into a new pool
+        // never will.
+        if ((res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL) || freshPool) {
+            return res;
+        }
+        if (pools.current + 1 == pools.pools.size()) {
+            VkDescriptorPool pool;
+            if ((res = createFramePool(descriptors->device, &pool)) != VK_SUCCESS) {
+                return res;
+            }
+            pools.pools.push_back(pool);
+            freshPool = true;
+        }
+        pools.current++;
+    }
+}
+
+DescriptorIndexingSupport queryDescriptorIndexing (VkInstance instance, VkPhysicalDevice physicalDevice, bool properties2Enabled,
+        const std::unordered_set<std::string>& availableExtensions, std::vector<const char*>& extensions) {
+    DescriptorIndexingSupport support = {};
+    support.features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    if (!properties2Enabled) {
+        return support;
+    }
+
+    bool indexing = availableExtensions.count(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) != 0;
+    bool maintenance3 = availableExtensions.count(VK_KHR_MAINTENANCE3_EXTENSION_NAME) != 0;
+    PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR) vkGetInstanceProcAddr(instance,
+            "vkGetPhysicalDeviceFeatures2KHR");
+    PFN_vkGetPhysicalDeviceProperties2KHR getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR) vkGetInstanceProcAddr(instance,
+            "vkGetPhysicalDeviceProperties2KHR");
+    if (!indexing || !maintenance3 || getFeatures2 == nullptr || getProperties2 == nullptr) {
+        return support;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT available = {};
+    available.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2KHR features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &available,
+        .features = {}
+    };
+    getFeatures2(physicalDevice, &features2);
+    // Descriptors are written while earlier frames are still in flight and most of the table is never written at all
+    if (available.descriptorBindingPartiallyBound != VK_TRUE || available.descriptorBindingUpdateUnusedWhilePending != VK_TRUE ||
+            available.descriptorBindingSampledImageUpdateAfterBind != VK_TRUE || available.descriptorBindingStorageBufferUpdateAfterBind != VK_TRUE) {
+        return support;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2KHR properties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &indexingProperties,
+        .properties = {}
+    };
+    getProperties2(physicalDevice, &properties2);
+    uint32_t maxTextures = std::min({ static_cast<uint32_t>(BINDLESS_MAX_TEXTURES), indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSamplers });
+    uint32_t maxBuffers = std::min({ static_cast<uint32_t>(BINDLESS_MAX_BUFFERS), indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+            indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+    // Both arrays are visible to every stage and share the per-stage resource budget
+    uint32_t resources = indexingProperties.maxPerStageUpdateAfterBindResources;
+    if (maxTextures + maxBuffers > resources) {
+        maxTextures = std::min(maxTextures, resources / 2);
+        maxBuffers = std::min(maxBuffers, resources - maxTextures);
+    }
+    if (maxTextures == 0 || maxBuffers == 0) {
+        return support;
+    }
+
+    support.supported = true;
+    support.maxTextures = maxTextures;
+    support.maxBuffers = maxBuffers;
+    support.features.descriptorBindingPartiallyBound = VK_TRUE;
+    support.features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    support.features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    support.features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    // Not required, only lets shaders index with values that differ between invocations
+    support.features.shaderSampledImageArrayNonUniformIndexing = available.shaderSampledImageArrayNonUniformIndexing;
+    support.features.shaderStorageBufferArrayNonUniformIndexing = available.shaderStorageBufferArrayNonUniformIndexing;
+    support.features.runtimeDescriptorArray = available.runtimeDescriptorArray;
+    extensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    return support;
+}
+
+static void writeTableElements (BindlessTable *table, VkDescriptorSet set, const std::vector<uint32_t>& textures, const std::vector<uint32_t>& buffers) {
+    std::vector<VkWriteDescriptorSet> writes;
+    writes.reserve(textures.size() + buffers.size());
+    for (uint32_t index : textures) {
+        writes.push_back({
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = set,
+            .dstBinding = BINDLESS_TEXTURE_BINDING,
+            .dstArrayElement = index,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &table->textures[index],
+            .pBufferInfo = nullptr,
+            .pTexelBufferView = nullptr
+        });
+    }
+    for (uint32_t index : buffers) {
+        writes.push_back({
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = set,
+            .dstBinding = BINDLESS_BUFFER_BINDING,
+            .dstArrayElement = index,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = nullptr,
+            .pBufferInfo = &table->buffers[index],
+            .pTexelBufferView = nullptr
+        });
+    }
+    if (!writes.empty()) {
+        vkUpdateDescriptorSets(table->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+static VkResult createDefaultResources (MemoryAllocator *allocator, Uploader *uploader, BindlessTable *table) {
+    VkResult res = VK_SUCCESS;
+    VkImageCreateInfo imageCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = { 1, 1, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices = nullptr,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    if ((res = createAllocatedImage(allocator, imageCreateInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &table->defaultImage,
+                    &table->defaultImageMemory)) != VK_SUCCESS) {
+        return res;
+    }
+    if ((res = createImageView(table->device, table->defaultImage, imageCreateInfo.format, &table->defaultView)) != VK_SUCCESS) {
+        return res;
+    }
+    // Opaque white, so a missing texture multiplies to a no-op instead of showing up as garbage
+    const uint32_t white = 0xffffffffu;
+    UploadTicket ticket;
+    if ((res = uploadImage(allocator, uploader, table->defaultImage, VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, imageCreateInfo.extent, &white, sizeof(white),
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &ticket)) != VK_SUCCESS) {
+        return res;
+    }
+
+    VkSamplerCreateInfo samplerCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .mipLodBias = 0.0f,
+        .anisotropyEnable = VK_FALSE,
+        .maxAnisotropy = 1.0f,
+        .compareEnable = VK_FALSE,
+        .compareOp = VK_COMPARE_OP_ALWAYS,
+        .minLod = 0.0f,
+        .maxLod = 1000.0f,
+        .borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+        .unnormalizedCoordinates = VK_FALSE
+    };
+    if ((res = vkCreateSampler(table->device, &samplerCreateInfo, hostAllocator(), &table->defaultSampler)) != VK_SUCCESS) {
+        return res;
+    }
+    // Read as zeros, the contents are never written
+    return createAllocatedBuffer(allocator, 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT,
+            &table->defaultBuffer, &table->defaultBufferMemory);
+}
+
+VkResult createBindlessTable (MemoryAllocator *allocator, Uploader *uploader, VkPhysicalDevice physicalDevice, const DescriptorIndexingSupport& support,
+        uint32_t slotCount, BindlessTable *table) {
+    VkResult res = VK_SUCCESS;
+    table->device = allocator->device;
+    table->bindless = support.supported;
+    if (table->bindless) {
+        table->textureCapacity = support.maxTextures;
+        table->bufferCapacity = support.maxBuffers;
+    } else {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        const VkPhysicalDeviceLimits& limits = properties.limits;
+        table->textureCapacity = std::min({ static_cast<uint32_t>(BINDLESS_FALLBACK_TEXTURES), limits.maxPerStageDescriptorSampledImages,
+                limits.maxPerStageDescriptorSamplers, limits.maxDescriptorSetSampledImages, limits.maxDescriptorSetSamplers });
+        table->bufferCapacity = std::min({ static_cast<uint32_t>(BINDLESS_FALLBACK_BUFFERS), limits.maxPerStageDescriptorStorageBuffers,
+                limits.maxDescriptorSetStorageBuffers });
+        uint32_t resources = limits.maxPerStageResources;
+        if (table->textureCapacity + table->bufferCapacity > resources) {
+            table->textureCapacity = std::min(table->textureCapacity, resources / 2);
+            table->bufferCapacity = std::min(table->bufferCapacity, resources - table->textureCapacity);
+        }
+    }
+
+    if ((res = createDefaultResources(allocator, uploader, table)) != VK_SUCCESS) {
+        return res;
+    }
+    VkDescriptorImageInfo defaultTexture = { table->defaultSampler, table->defaultView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkDescriptorBufferInfo defaultBuffer = { table->defaultBuffer, 0, VK_WHOLE_SIZE };
+    table->textures.assign(table->textureCapacity, defaultTexture);
+    table->buffers.assign(table->bufferCapacity, defaultBuffer);
+    // Handed out lowest index first
+    table->freeTextures.resize(table->textureCapacity);
+    for (uint32_t i = 0; i < table->textureCapacity; i++) {
+        table->freeTextures[i] = table->textureCapacity - 1 - i;
+    }
+    table->freeBuffers.resize(table->bufferCapacity);
+    for (uint32_t i = 0; i < table->bufferCapacity; i++) {
+        table->freeBuffers[i] = table->bufferCapacity - 1 - i;
+    }
+
+    VkShaderStageFlags stages = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutBinding bindings[] = {
+        { BINDLESS_TEXTURE_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, table->textureCapacity, stages, nullptr },
+        { BINDLESS_BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, table->bufferCapacity, stages, nullptr }
+    };
+    VkDescriptorBindingFlagsEXT bindingFlags[] = {
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT,
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+        .pNext = nullptr,
+        .bindingCount = 2,
+        .pBindingFlags = bindingFlags
+    };
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = table->bindless ? &bindingFlagsInfo : nullptr,
+        .flags = table->bindless ? static_cast<VkDescriptorSetLayoutCreateFlags>(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT) : 0u,
+        .bindingCount = 2,
+        .pBindings = bindings
+    };
+    if ((res = vkCreateDescriptorSetLayout(table->device, &layoutCreateInfo, hostAllocator(), &table->layout)) != VK_SUCCESS) {
+        return res;
+    }
+
+    VkPushConstantRange pushConstants = { stages, 0, BINDLESS_PUSH_CONSTANT_SIZE };
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &table->layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstants
+    };
+    if ((res = vkCreatePipelineLayout(table->device, &pipelineLayoutCreateInfo, hostAllocator(), &table->pipelineLayout)) != VK_SUCCESS) {
+        return res;
+    }
+
+    uint32_t setCount = table->bindless ? 1 : slotCount;
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, table->textureCapacity * setCount },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, table->bufferCapacity * setCount }
+    };
+    VkDescriptorPoolCreateInfo poolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = table->bindless ? static_cast<VkDescriptorPoolCreateFlags>(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT) : 0u,
+        .maxSets = setCount,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes
+    };
+    if ((res = vkCreateDescriptorPool(table->device, &poolCreateInfo, hostAllocator(), &table->pool)) != VK_SUCCESS) {
+        return res;
+    }
+    std::vector<VkDescriptorSetLayout> layouts(setCount, table->layout);
+    VkDescriptorSetAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = table->pool,
+        .descriptorSetCount = setCount,
+        .pSetLayouts = layouts.data()
+    };
+    table->sets.resize(setCount);
+    if ((res = vkAllocateDescriptorSets(table->device, &allocateInfo, table->sets.data())) != VK_SUCCESS) {
+        return res;
+    }
+
+    // Partially bound arrays may stay empty, otherwise every element has to point at something valid before the first bind
+    if (!table->bindless) {
+        std::vector<uint32_t> allTextures(table->textureCapacity), allBuffers(table->bufferCapacity);
+        for (uint32_t i = 0; i < table->textureCapacity; i++) {
+            allTextures[i] = i;
+        }
+        for (uint32_t i = 0; i < table->bufferCapacity; i++) {
+            allBuffers[i] = i;
+        }
+        for (VkDescriptorSet set : table->sets) {
+            writeTableElements(table, set, allTextures, allBuffers);
+        }
+        table->dirtyTextures.resize(setCount);
+        table->dirtyBuffers.resize(setCount);
+    }
+    return res;
+}
+
+void destroyBindlessTable (MemoryAllocator *allocator, BindlessTable *table) {
+    vkDestroyDescriptorPool(table->device, table->pool, hostAllocator());
+    vkDestroyPipelineLayout(table->device, table->pipelineLayout, hostAllocator());
+    vkDestroyDescriptorSetLayout(table->device, table->layout, hostAllocator());
+    vkDestroySampler(table->device, table->defaultSampler, hostAllocator());
+    vkDestroyImageView(table->device, table->defaultView, hostAllocator());
+    destroyAllocatedImage(allocator, table->defaultImage, &table->defaultImageMemory);
+    destroyAllocatedBuffer(allocator, table->defaultBuffer, &table->defaultBufferMemory);
+}
+
+// Bindless tables are written right away, fallback tables once per slot whenever the slot comes around again
+static void markDirty (BindlessTable *table, uint32_t index, bool texture) {
+    if (table->bindless) {
+        std::vector<uint32_t> indices = { index };
+        writeTableElements(table, table->sets[0], texture ? indices : std::vector<uint32_t>(), texture ? std::vector<uint32_t>() : indices);
+        return;
+    }
+    for (uint32_t i = 0; i < table->sets.size(); i++) {
+        (texture ? table->dirtyTextures : table->dirtyBuffers)[i].push_back(index);
+    }
+}
+
+uint32_t registerTexture (BindlessTable *table, VkImageView view, VkSampler sampler, VkImageLayout layout) {
+    if (table->freeTextures.empty()) {
+        return BINDLESS_INVALID;
+    }
+    uint32_t index = table->freeTextures.back();
+    table->freeTextures.pop_back();
+    table->textures[index] = { sampler != VK_NULL_HANDLE ? sampler : table->defaultSampler, view, layout };
+    markDirty(table, index, true);
+    return index;
+}
+
+uint32_t registerBuffer (BindlessTable *table, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    if (table->freeBuffers.empty()) {
+        return BINDLESS_INVALID;
+    }
+    uint32_t index = table->freeBuffers.back();
+    table->freeBuffers.pop_back();
+    table->buffers[index] = { buffer, offset, range };
+    markDirty(table, index, false);
+    return index;
+}
+
+void releaseTexture (BindlessTable *table, uint32_t index, uint64_t frameNumber) {
+    table->releasedTextures.push_back({ index, frameNumber });
+    // Frames that are recorded from now on must not see the resource anymore, a partially bound table can simply leave
+    // the stale descriptor in place since nothing reads it
+    if (!table->bindless) {
+        table->textures[index] = { table->defaultSampler, table->defaultView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        markDirty(table, index, true);
+    }
+}
+
+void releaseBuffer (BindlessTable *table, uint32_t index, uint64_t frameNumber) {
+    table->releasedBuffers.push_back({ index, frameNumber });
+    if (!table->bindless) {
+        table->buffers[index] = { table->defaultBuffer, 0, VK_WHOLE_SIZE };
+        markDirty(table, index, false);
+    }
+}
+
+static void recycleReleased (std::vector<std::pair<uint32_t, uint64_t>>& released, std::vector<uint32_t>& freeList, uint64_t framesCompleted) {
+    size_t kept = 0;
+    for (const std::pair<uint32_t, uint64_t>& entry : released) {
+        if (entry.second < framesCompleted) {
+            freeList.push_back(entry.first);
+        } else {
+            released[kept++] = entry;
+        }
+    }
+    released.resize(kept);
+}
+
+bool updateBindlessTable (BindlessTable *table, uint32_t slot, uint64_t framesCompleted) {
+    recycleReleased(table->releasedTextures, table->freeTextures, framesCompleted);
+    recycleReleased(table->releasedBuffers, table->freeBuffers, framesCompleted);
+    bool written = false;
+    if (!table->bindless) {
+        // The slot's last frame has finished, so its set is idle. Elements that changed several times are written once
+        // per change, the last write wins.
+        writeTableElements(table, table->sets[slot], table->dirtyTextures[slot], table->dirtyBuffers[slot]);
+        written = !table->dirtyTextures[slot].empty() || !table->dirtyBuffers[slot].empty();
+        table->dirtyTextures[slot].clear();
+        table->dirtyBuffers[slot].clear();
+    }
+    return written;
+}
+
+void bindBindlessTable (VkCommandBuffer cmdBuffer, const BindlessTable& table, uint32_t slot, VkPipelineBindPoint bindPoint) {
+    VkDescriptorSet set = table.sets[table.bindless ? 0 : slot];
+    vkCmdBindDescriptorSets(cmdBuffer, bindPoint, table.pipelineLayout, 0, 1, &set, 0, nullptr);
+}
@@ -0,0 +1,33 @@
+#include <chrono>
+
+#include "eventQueue.h"
+
+void createEventQueue (EventQueue *queue) {
+    queue->head.store(0, std::memory_order_relaxed);
+    queue->tail.store(0, std::memory_order_relaxed);
+    queue->dropped = 0;
+}
+
+bool pushEvent (EventQueue *queue, const InputEvent& event) {
+    uint64_t head = queue->head.load(std::memory_order_relaxed);
+    if (head - queue->tail.load(std::memory_order_acquire) == EVENT_QUEUE_SIZE) {
+        return false;
+    }
+    queue->events[head & (EVENT_QUEUE_SIZE - 1)] = event;
+    queue->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool popEvent (EventQueue *queue, InputEvent *event) {
+    uint64_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail == queue->head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    *event = queue->events[tail & (EVENT_QUEUE_SIZE - 1)];
+    queue->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+int64_t eventTimestamp () {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,53 @@
+#include "frameRing.h"
+#include "hostAllocator.h"
+#include "vulkanUtils.h"
+
+VkResult createFrameRing (VkDevice device, uint32_t queueIndex, uint32_t frameCount, FrameRing *ring) {
+    VkResult res = VK_SUCCESS;
+    ring->slots.resize(CLAMP(frameCount, 1u, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT)));
+    ring->current = 0;
+    ring->frameNumber = 0;
+
+    for (FrameSlot& slot : ring->slots) {
+        if ((res = createSemaphore(device, &slot.imageAvailable)) != VK_SUCCESS) return res;
+        // Created signaled so the first wait on every slot returns immediately
+        if ((res = createFence(device, VK_FENCE_CREATE_SIGNALED_BIT, &slot.inFlight)) != VK_SUCCESS) return res;
+        if ((res = createCommandPool(device, queueIndex, &slot.cmdPool)) != VK_SUCCESS) return res;
+        if ((res = allocateCommandBuffer(device, slot.cmdPool, &slot.cmdBuffer)) != VK_SUCCESS) return res;
+        if ((res = allocateCommandBuffer(device, slot.cmdPool, &slot.finishCmdBuffer)) != VK_SUCCESS) return res;
+    }
+    return res;
+}
+
+void destroyFrameRing (VkDevice device, FrameRing *ring) {
+    for (FrameSlot& slot : ring->slots) {
+        vkWaitForFences(device, 1, &slot.inFlight, VK_TRUE, UINT64_MAX);
+    }
+    for (FrameSlot& slot : ring->slots) {
+        vkFreeCommandBuffers(device, slot.cmdPool, 1, &slot.cmdBuffer);
+        vkFreeCommandBuffers(device, slot.cmdPool, 1, &slot.finishCmdBuffer);
+        vkDestroyCommandPool(device, slot.cmdPool, hostAllocator());
+        vkDestroyFence(device, slot.inFlight, hostAllocator());
+        vkDestroySemaphore(device, slot.imageAvailable, hostAllocator());
+    }
+    ring->slots.clear();
+}
+
+FrameSlot& beginFrame (VkDevice device, FrameRing *ring) {
+    FrameSlot& slot = ring->slots[ring->current];
+    ASSERT_RESULT(vkWaitForFences(device, 1, &slot.inFlight, VK_TRUE, UINT64_MAX), VK_SUCCESS, "Failed to wait for frame slot fence");
+    // The pool only ever holds this slot's buffers, resetting it wholesale is cheaper than resetting the buffers
+    ASSERT_RESULT(vkResetCommandPool(device, slot.cmdPool, 0), VK_SUCCESS, "Failed to reset frame slot command pool");
+    return slot;
+}
+
+void endFrame (FrameRing *ring) {
+    ring->current = (ring->current + 1) % ring->slots.size();
+    ring->frameNumber++;
+}
+
+uint64_t framesCompleted (const FrameRing& ring) {
+    // The fence beginFrame waited on belonged to frameNumber - slots, and fences signal in submission order
+    uint64_t slots = ring.slots.size();
+    return ring.frameNumber + 1 >= slots ? ring.frameNumber + 1 - slots : 0;
+}
@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "gpuScene.h"
+#include "hostAllocator.h"
+#include "jobSystem.h"
+#include "vulkanUtils.h"
+
+#define GPU_SCENE_FOV           1.0471976f  // 60 degrees
+#define GPU_SCENE_NEAR          0.1f
+#define GPU_SCENE_TURN_RATE     0.3         // Radians per simulated second
+// Moving instances bob up and down around their rest position, each with its own phase
+#define GPU_SCENE_BOB_RATE      2.0         // Radians per simulated second
+#define GPU_SCENE_BOB_HEIGHT    0.5f
+
+// Mesh vertices are generated from the index in shaders/instanced.vert: a triangle at 0-2, a quad at 3-6
+static const uint32_t meshIndices[] = { 0, 1, 2, 3, 4, 5, 3, 5, 6 };
+
+struct CullPushConstants {
+    float planes[6][4];
+    uint32_t count;
+};
+
+struct DrawPushConstants {
+    float viewProjection[16];
+    float color[4];
+    uint32_t base;
+};
+
+// Column major, like GLSL
+static void multiply (const float *a, const float *b, float *result) {
+    for (uint32_t column = 0; column < 4; column++) {
+        for (uint32_t row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (uint32_t k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            result[column * 4 + row] = sum;
+        }
+    }
+}
+
+// Vulkan clip space: y points down and depth goes from 0 to 1
+static void perspective (float fov, float aspect, float near, float far, float *m) {
+    float f = 1.0f / tanf(fov * 0.5f);
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = f / aspect;
+    m[5] = -f;
+    m[10] = far / (near - far);
+    m[11] = -1.0f;
+    m[14] = near * far / (near - far);
+}
+
+// Camera at the origin looking along the horizontal direction yaw
+static void lookFrom (float yaw, float *m) {
+    float forward[3] = { sinf(yaw), 0.0f, -cosf(yaw) };
+    float side[3] = { -forward[2], 0.0f, forward[0] };
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = side[0];
+    m[4] = side[1];
+    m[8] = side[2];
+    m[5] = 1.0f;
+    m[2] = -forward[0];
+    m[6] = -forward[1];
+    m[10] = -forward[2];
+    m[15] = 1.0f;
+}
+
+// Gribb-Hartmann: every plane is a sum or difference of rows of the matrix, normalized so that the distance to a sphere's
+// center can be compared against its radius
+static void extractPlanes (const float *m, float planes[6][4]) {
+    auto row = [m] (uint32_t i, uint32_t column) {
+        return m[column * 4 + i];
+    };
+    for (uint32_t column = 0; column < 4; column++) {
+        planes[0][column] = row(3, column) + row(0, column);
+        planes[1][column] = row(3, column) - row(0, column);
+        planes[2][column] = row(3, column) + row(1, column);
+        planes[3][column] = row(3, column) - row(1, column);
+        planes[4][column] = row(2, column);
+        planes[5][column] = row(3, column) - row(2, column);
+    }
+    for (uint32_t i = 0; i < 6; i++) {
+        float length = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+        for (uint32_t column = 0; column < 4; column++) {
+            planes[i][column] /= length;
+        }
+    }
+}
+
+// Half the edge length of the cube the instances are spread through, about one instance per unit cube
+static float sceneExtent (uint32_t instanceCount) {
+    return std::max(cbrtf(static_cast<float>(instanceCount)) * 0.5f, 4.0f);
+}
+
+static VkResult createLayouts (VkDevice device, DescriptorLayoutCache *layouts, GpuScene *scene) {
+    VkResult res = VK_SUCCESS;
+    std::vector<VkDescriptorSetLayoutBinding> cullBindings = {
+        { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+        { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+        { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+    };
+    std::vector<VkDescriptorSetLayoutBinding> drawBindings = {
+        { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+        { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr }
+    };
+    if ((res = getDescriptorSetLayout(device, layouts, cullBindings, &scene->cullSetLayout)) != VK_SUCCESS ||
+            (res = getDescriptorSetLayout(device, layouts, drawBindings, &scene->drawSetLayout)) != VK_SUCCESS) {
+        return res;
+    }
+
+    VkPushConstantRange cullPushConstants = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants) };
+    VkPipelineLayoutCreateInfo layoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &scene->cullSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &cullPushConstants
+    };
+    if ((res = vkCreatePipelineLayout(device, &layoutCreateInfo, hostAllocator(), &scene->cullLayout)) != VK_SUCCESS) {
+        return res;
+    }
+    VkPushConstantRange drawPushConstants = { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants) };
+    layoutCreateInfo.pSetLayouts = &scene->drawSetLayout;
+    layoutCreateInfo.pPushConstantRanges = &drawPushConstants;
+    return vkCreatePipelineLayout(device, &layoutCreateInfo, hostAllocator(), &scene->drawLayout);
+}
+
+// Deterministic, so every run culls the same scene
+static void generateInstances (GpuScene *scene) {
+    float extent = sceneExtent(scene->instanceCount);
+    uint32_t state = 0x9e3779b9u;
+    auto random = [&state] () {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return static_cast<float>(state) / 4294967295.0f;
+    };
+    uint32_t bucketSizes[GPU_SCENE_BUCKETS] = {};
+    scene->instances.resize(scene->instanceCount);
+    for (GpuInstance& instance : scene->instances) {
+        instance.sphere[0] = (random() * 2.0f - 1.0f) * extent;
+        instance.sphere[1] = (random() * 2.0f - 1.0f) * extent;
+        instance.sphere[2] = (random() * 2.0f - 1.0f) * extent;
+        instance.sphere[3] = 0.2f + random() * 0.3f;
+        instance.bucket = std::min(static_cast<uint32_t>(random() * GPU_SCENE_BUCKETS), GPU_SCENE_BUCKETS - 1u);
+        instance.padding[0] = instance.padding[1] = instance.padding[2] = 0;
+        bucketSizes[instance.bucket]++;
+    }
+
+    // Buckets alternate between the two meshes, each one gets as much of the visible list as it has instances
+    static const float colors[GPU_SCENE_BUCKETS][4] = {
+        { 0.9f, 0.3f, 0.2f, 1.0f }, { 0.2f, 0.8f, 0.3f, 1.0f }, { 0.2f, 0.4f, 0.9f, 1.0f }, { 0.9f, 0.8f, 0.2f, 1.0f }
+    };
+    uint32_t base = 0;
+    for (uint32_t i = 0; i < GPU_SCENE_BUCKETS; i++) {
+        bool quad = (i % 2) == 1;
+        scene->draws.commands[i] = { quad ? 6u : 3u, 0, quad ? 3u : 0u, 0, 0 };
+        scene->draws.bases[i] = base;
+        base += bucketSizes[i];
+        memcpy(scene->colors[i], colors[i], sizeof(colors[i]));
+    }
+}
+
+VkResult createGpuScene (MemoryAllocator *allocator, PipelineLibrary *library, DescriptorLayoutCache *layouts, VkRenderPass renderPass,
+        uint32_t instanceCount, bool moving, uint32_t slotCount, GpuScene *scene) {
+    VkResult res = VK_SUCCESS;
+    VkDevice device = allocator->device;
+    scene->instanceCount = instanceCount;
+    scene->moving = moving;
+    scene->slotsWritten.assign(moving ? slotCount : 0, false);
+    scene->queuedInstances = 0;
+    scene->indicesQueued = false;
+    scene->lastUpload = 0;
+    scene->resident = false;
+    generateInstances(scene);
+    if ((res = createLayouts(device, layouts, scene)) != VK_SUCCESS) {
+        return res;
+    }
+
+    ComputePipelineDesc cullDesc;
+    cullDesc.computeShader = "shaders/cull.comp.spv";
+    cullDesc.layout = scene->cullLayout;
+    cullDesc.specialization = { { 0, GPU_SCENE_GROUP_SIZE } };
+    GraphicsPipelineDesc drawDesc;
+    drawDesc.vertexShader = "shaders/instanced.vert.spv";
+    drawDesc.fragmentShader = "shaders/triangle.frag.spv";
+    drawDesc.layout = scene->drawLayout;
+    drawDesc.renderPass = renderPass;
+    if ((res = getComputePipeline(device, library, cullDesc, &scene->cullPipeline)) != VK_SUCCESS ||
+            (res = getGraphicsPipeline(device, library, drawDesc, &scene->drawPipeline)) != VK_SUCCESS) {
+        return res;
+    }
+
+    scene->instanceBuffers.resize(moving ? slotCount : 1);
+    scene->instanceMemory.resize(scene->instanceBuffers.size());
+    for (uint32_t i = 0; i < scene->instanceBuffers.size(); i++) {
+        if ((res = createAllocatedBuffer(allocator, static_cast<VkDeviceSize>(instanceCount) * sizeof(GpuInstance),
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        ALLOCATION_PERSISTENT, &scene->instanceBuffers[i], &scene->instanceMemory[i])) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    if ((res = createAllocatedBuffer(allocator, sizeof(meshIndices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, &scene->indexBuffer, &scene->indexMemory)) != VK_SUCCESS) {
+        return res;
+    }
+    scene->visibleBuffers.resize(slotCount);
+    scene->visibleMemory.resize(slotCount);
+    scene->drawBuffers.resize(slotCount);
+    scene->drawMemory.resize(slotCount);
+    for (uint32_t i = 0; i < slotCount; i++) {
+        if ((res = createAllocatedBuffer(allocator, std::max(instanceCount, 1u) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, &scene->visibleBuffers[i], &scene->visibleMemory[i])) != VK_SUCCESS ||
+                (res = createAllocatedBuffer(allocator, sizeof(GpuSceneDraws),
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, &scene->drawBuffers[i], &scene->drawMemory[i])) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    return res;
+}
+
+void destroyGpuScene (MemoryAllocator *allocator, GpuScene *scene) {
+    for (uint32_t i = 0; i < scene->visibleBuffers.size(); i++) {
+        destroyAllocatedBuffer(allocator, scene->visibleBuffers[i], &scene->visibleMemory[i]);
+        destroyAllocatedBuffer(allocator, scene->drawBuffers[i], &scene->drawMemory[i]);
+    }
+    scene->visibleBuffers.clear();
+    scene->drawBuffers.clear();
+    for (uint32_t i = 0; i < scene->instanceBuffers.size(); i++) {
+        destroyAllocatedBuffer(allocator, scene->instanceBuffers[i], &scene->instanceMemory[i]);
+    }
+    scene->instanceBuffers.clear();
+    destroyAllocatedBuffer(allocator, scene->indexBuffer, &scene->indexMemory);
+    // The pipelines belong to the library and the set layouts to the layout cache
+    vkDestroyPipelineLayout(allocator->device, scene->cullLayout, hostAllocator());
+    vkDestroyPipelineLayout(allocator->device, scene->drawLayout, hostAllocator());
+    scene->instances.clear();
+}
+
+// The slot's buffer was last read by the slot's previous frame, which has completed. The copy is only queued when this
+// frame's flush is sure to submit it, a copy left queued could land while this frame reads the buffer.
+static bool moveGpuScene (Uploader *uploader, uint32_t slot, double time, GpuScene *scene) {
+    VkDeviceSize size = static_cast<VkDeviceSize>(scene->instanceCount) * sizeof(GpuInstance);
+    VkDeviceSize offset;
+    void *mapped;
+    // A busy uploader or a full ring leaves the slot with the positions of its previous frame
+    if (uploadBatchReady(uploader) && reserveStaging(uploader, size, &offset, &mapped) == VK_SUCCESS) {
+        GpuInstance *moved = static_cast<GpuInstance*>(mapped);
+        float phase = static_cast<float>(fmod(time * GPU_SCENE_BOB_RATE, 2.0 * M_PI));
+        for (uint32_t i = 0; i < scene->instanceCount; i++) {
+            moved[i] = scene->instances[i];
+            moved[i].sphere[1] += sinf(phase + static_cast<float>(i)) * GPU_SCENE_BOB_HEIGHT;
+        }
+        queueBufferCopy(uploader, scene->instanceBuffers[slot], 0, offset, size);
+        scene->slotsWritten[slot] = true;
+    }
+    return scene->slotsWritten[slot];
+}
+
+bool streamGpuScene (MemoryAllocator *allocator, Uploader *uploader, uint32_t slot, double time, GpuScene *scene) {
+    if (scene->resident) {
+        return true;
+    }
+    if (!scene->indicesQueued) {
+        if (uploadBuffer(allocator, uploader, scene->indexBuffer, 0, meshIndices, sizeof(meshIndices), &scene->lastUpload) != VK_SUCCESS) {
+            return false;
+        }
+        scene->indicesQueued = true;
+    }
+    if (scene->moving) {
+        // The indices were queued no later than the slot's first instances, so they have arrived whenever those have
+        return moveGpuScene(uploader, slot, time, scene);
+    }
+    uint32_t chunk = static_cast<uint32_t>(GPU_SCENE_UPLOAD_CHUNK / sizeof(GpuInstance));
+    if (scene->queuedInstances < scene->instanceCount) {
+        uint32_t count = std::min(chunk, scene->instanceCount - scene->queuedInstances);
+        // A full ring just means trying again next frame
+        if (uploadBuffer(allocator, uploader, scene->instanceBuffers[0], static_cast<VkDeviceSize>(scene->queuedInstances) * sizeof(GpuInstance),
+                    &scene->instances[scene->queuedInstances], static_cast<VkDeviceSize>(count) * sizeof(GpuInstance), &scene->lastUpload) == VK_SUCCESS) {
+            scene->queuedInstances += count;
+        }
+        return false;
+    }
+    // Completed batches have been acquired by an earlier frame, see recordUploadAcquires
+    if (uploadComplete(*uploader, scene->lastUpload)) {
+        scene->resident = true;
+        std::vector<GpuInstance>().swap(scene->instances);
+    }
+    return scene->resident;
+}
+
+void prepareGpuSceneFrame (const GpuScene& scene, FrameDescriptors *descriptors, uint32_t slot, double time, VkExtent2D extent, GpuSceneFrame *frame) {
+    frame->scene = &scene;
+    frame->slot = slot;
+    frame->instanceBuffer = scene.instanceBuffers[scene.moving ? slot : 0];
+    float projection[16], view[16];
+    perspective(GPU_SCENE_FOV, static_cast<float>(extent.width) / extent.height, GPU_SCENE_NEAR, sceneExtent(scene.instanceCount) * 2.0f, projection);
+    lookFrom(static_cast<float>(fmod(time * GPU_SCENE_TURN_RATE, 2.0 * M_PI)), view);
+    multiply(projection, view, frame->viewProjection);
+    extractPlanes(frame->viewProjection, frame->planes);
+
+    uint32_t thread = currentJobThread();
+    ASSERT_RESULT(allocateFrameDescriptorSet(descriptors, slot, thread, scene.cullSetLayout, &frame->cullSet), VK_SUCCESS,
+            "Failed to allocate culling descriptor set");
+    ASSERT_RESULT(allocateFrameDescriptorSet(descriptors, slot, thread, scene.drawSetLayout, &frame->drawSet), VK_SUCCESS,
+            "Failed to allocate instance descriptor set");
+    VkDescriptorBufferInfo bufferInfos[] = {
+        { frame->instanceBuffer, 0, VK_WHOLE_SIZE },
+        { scene.visibleBuffers[slot], 0, VK_WHOLE_SIZE },
+        { scene.drawBuffers[slot], 0, VK_WHOLE_SIZE }
+    };
+    // Both sets start with the instances and the visible list, consecutive bindings in one write each
+    VkWriteDescriptorSet writes[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = frame->cullSet,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 3,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = nullptr,
+            .pBufferInfo = bufferInfos,
+            .pTexelBufferView = nullptr
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = frame->drawSet,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = nullptr,
+            .pBufferInfo = bufferInfos,
+            .pTexelBufferView = nullptr
+        }
+    };
+    vkUpdateDescriptorSets(descriptors->device, 2, writes, 0, nullptr);
+}
+
+void recordGpuSceneReset (VkCommandBuffer cmdBuffer, const GpuSceneFrame& frame) {
+    vkCmdUpdateBuffer(cmdBuffer, frame.scene->drawBuffers[frame.slot], 0, sizeof(GpuSceneDraws), &frame.scene->draws);
+}
+
+void recordGpuSceneCull (VkCommandBuffer cmdBuffer, const GpuSceneFrame& frame) {
+    const GpuScene& scene = *frame.scene;
+    CullPushConstants pushConstants;
+    memcpy(pushConstants.planes, frame.planes, sizeof(pushConstants.planes));
+    pushConstants.count = scene.instanceCount;
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scene.cullPipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scene.cullLayout, 0, 1, &frame.cullSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, scene.cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(cmdBuffer, (scene.instanceCount + GPU_SCENE_GROUP_SIZE - 1) / GPU_SCENE_GROUP_SIZE, 1, 1);
+}
+
+void recordGpuSceneDraws (VkCommandBuffer cmdBuffer, const GpuSceneFrame& frame, VkExtent2D extent) {
+    const GpuScene& scene = *frame.scene;
+    VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+    VkRect2D scissor = { { 0, 0 }, extent };
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.drawPipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.drawLayout, 0, 1, &frame.drawSet, 0, nullptr);
+    vkCmdBindIndexBuffer(cmdBuffer, scene.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+    DrawPushConstants pushConstants;
+    memcpy(pushConstants.viewProjection, frame.viewProjection, sizeof(pushConstants.viewProjection));
+    for (uint32_t i = 0; i < GPU_SCENE_BUCKETS; i++) {
+        memcpy(pushConstants.color, scene.colors[i], sizeof(pushConstants.color));
+        pushConstants.base = scene.draws.bases[i];
+        vkCmdPushConstants(cmdBuffer, scene.drawLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+        vkCmdDrawIndexedIndirect(cmdBuffer, scene.drawBuffers[frame.slot], i * sizeof(VkDrawIndexedIndirectCommand), 1,
+                sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
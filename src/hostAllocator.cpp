@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hostAllocator.h"
+#include "logger.h"
+#include "vulkanUtils.h"
+
+// Alignment of every block and of the allocations in it unless the driver asks for more
+#define HOST_BLOCK_ALIGNMENT    16
+
+enum HostBlockSource {
+    HOST_BLOCK_ARENA,
+    HOST_BLOCK_POOL,
+    HOST_BLOCK_HEAP
+};
+
+// Placed right in front of every allocation handed to the driver
+struct HostBlock {
+    size_t size;
+    // From the start of the block to the allocation, larger than the header when the driver asked for more alignment
+    uint32_t offset;
+    uint8_t source;
+    // Arena or size class the block came from
+    uint8_t index;
+    uint8_t scope;
+    uint8_t padding;
+};
+
+static_assert(sizeof(HostBlock) == HOST_BLOCK_ALIGNMENT, "HostBlock must keep allocations aligned");
+
+struct HostArena {
+    uint8_t *memory;
+    size_t top;
+    // Allocations not freed yet, the arena is only reset once there are none
+    uint32_t live;
+};
+
+static const char *scopeNames[HOST_SCOPE_COUNT] = { "command", "object", "cache", "device", "instance" };
+
+// The driver calls in from any thread, one lock covers the arenas, the pools and the statistics
+static std::mutex mutex;
+static bool running;
+static VkAllocationCallbacks callbacks;
+static std::vector<HostArena> arenas;
+static uint32_t currentArena;
+// Free blocks of every size class, linked through their first bytes
+static void *freeLists[HOST_POOL_CLASSES];
+static std::vector<void*> chunks;
+static HostAllocatorStats stats;
+
+static uint32_t sizeClass (size_t size) {
+    uint32_t index = 0;
+    for (size_t classSize = HOST_POOL_MIN_SIZE; classSize < size && index < HOST_POOL_CLASSES; classSize <<= 1) {
+        index++;
+    }
+    return index;
+}
+
+static bool growPool (uint32_t index) {
+    size_t classSize = static_cast<size_t>(HOST_POOL_MIN_SIZE) << index;
+    // Aligned to the largest class, so every block is aligned to its own size
+    uint8_t *chunk = static_cast<uint8_t*>(aligned_alloc(HOST_POOL_MAX_SIZE, HOST_POOL_CHUNK_SIZE));
+    if (chunk == nullptr) {
+        return false;
+    }
+    stats.heapAllocations++;
+    chunks.push_back(chunk);
+    for (size_t offset = HOST_POOL_CHUNK_SIZE; offset >= classSize; offset -= classSize) {
+        void *block = chunk + offset - classSize;
+        *static_cast<void**>(block) = freeLists[index];
+        freeLists[index] = block;
+    }
+    return true;
+}
+
+static void *allocateLocked (size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    alignment = std::max<size_t>(alignment, HOST_BLOCK_ALIGNMENT);
+    // Blocks start aligned to HOST_BLOCK_ALIGNMENT, larger alignments may need padding in front of the header
+    size_t needed = sizeof(HostBlock) + size + alignment - HOST_BLOCK_ALIGNMENT;
+    HostScopeStats& scopeStats = stats.scopes[scope];
+    uint8_t *start = nullptr;
+    HostBlockSource source = HOST_BLOCK_HEAP;
+    uint32_t index = 0;
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+        HostArena& arena = arenas[currentArena];
+        size_t top = (arena.top + HOST_BLOCK_ALIGNMENT - 1) & ~static_cast<size_t>(HOST_BLOCK_ALIGNMENT - 1);
+        if (needed <= HOST_ARENA_SIZE - std::min<size_t>(top, HOST_ARENA_SIZE)) {
+            start = arena.memory + top;
+            source = HOST_BLOCK_ARENA;
+            index = currentArena;
+        }
+    } else if ((index = sizeClass(needed)) < HOST_POOL_CLASSES) {
+        if (freeLists[index] != nullptr || growPool(index)) {
+            start = static_cast<uint8_t*>(freeLists[index]);
+            freeLists[index] = *static_cast<void**>(freeLists[index]);
+            source = HOST_BLOCK_POOL;
+        }
+    }
+    if (start == nullptr) {
+        start = static_cast<uint8_t*>(malloc(needed));
+        if (start == nullptr) {
+            return nullptr;
+        }
+        stats.heapAllocations++;
+        scopeStats.heapAllocations++;
+        source = HOST_BLOCK_HEAP;
+        index = 0;
+    }
+
+    uintptr_t address = (reinterpret_cast<uintptr_t>(start) + sizeof(HostBlock) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    HostBlock *block = reinterpret_cast<HostBlock*>(address) - 1;
+    *block = {
+        .size = size,
+        .offset = static_cast<uint32_t>(address - reinterpret_cast<uintptr_t>(start)),
+        .source = static_cast<uint8_t>(source),
+        .index = static_cast<uint8_t>(index),
+        .scope = static_cast<uint8_t>(scope),
+        .padding = 0
+    };
+    if (source == HOST_BLOCK_ARENA) {
+        // Ends exactly at the allocation, so freeing the most recent allocation can move the top back
+        arenas[index].top = address + size - reinterpret_cast<uintptr_t>(arenas[index].memory);
+        arenas[index].live++;
+    }
+    scopeStats.allocations++;
+    scopeStats.liveBytes += size;
+    scopeStats.peakBytes = std::max(scopeStats.peakBytes, scopeStats.liveBytes);
+    return reinterpret_cast<void*>(address);
+}
+
+static void freeLocked (void *memory) {
+    HostBlock *block = static_cast<HostBlock*>(memory) - 1;
+    uint8_t *start = static_cast<uint8_t*>(memory) - block->offset;
+    HostScopeStats& scopeStats = stats.scopes[block->scope];
+    scopeStats.frees++;
+    scopeStats.liveBytes -= block->size;
+    switch (block->source) {
+        case HOST_BLOCK_ARENA: {
+            HostArena& arena = arenas[block->index];
+            if (static_cast<uint8_t*>(memory) + block->size == arena.memory + arena.top) {
+                arena.top = start - arena.memory;
+            }
+            arena.live--;
+            break;
+        }
+        case HOST_BLOCK_POOL:
+            *reinterpret_cast<void**>(start) = freeLists[block->index];
+            freeLists[block->index] = start;
+            break;
+        default:
+            free(start);
+            break;
+    }
+}
+
+static VKAPI_ATTR void* VKAPI_CALL allocationCallback (void *userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocateLocked(size, alignment, scope);
+}
+
+static VKAPI_ATTR void* VKAPI_CALL reallocationCallback (void *userData, void *original, size_t size, size_t alignment,
+        VkSystemAllocationScope scope) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (original == nullptr) {
+        return allocateLocked(size, alignment, scope);
+    }
+    if (size == 0) {
+        freeLocked(original);
+        return nullptr;
+    }
+    // Blocks never grow in place, the driver rarely reallocates
+    void *memory = allocateLocked(size, alignment, scope);
+    if (memory != nullptr) {
+        memcpy(memory, original, std::min(size, (static_cast<HostBlock*>(original) - 1)->size));
+        freeLocked(original);
+    }
+    return memory;
+}
+
+static VKAPI_ATTR void VKAPI_CALL freeCallback (void *userData, void *memory) {
+    if (memory == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    freeLocked(memory);
+}
+
+static VKAPI_ATTR void VKAPI_CALL internalAllocationCallback (void *userData, size_t size, VkInternalAllocationType type,
+        VkSystemAllocationScope scope) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.scopes[scope].internalBytes += size;
+}
+
+static VKAPI_ATTR void VKAPI_CALL internalFreeCallback (void *userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.scopes[scope].internalBytes -= size;
+}
+
+void startHostAllocator (uint32_t frameArenas) {
+    std::lock_guard<std::mutex> lock(mutex);
+    arenas.resize(std::max(frameArenas, 1u));
+    for (HostArena& arena : arenas) {
+        arena.memory = static_cast<uint8_t*>(aligned_alloc(HOST_BLOCK_ALIGNMENT, HOST_ARENA_SIZE));
+        if (arena.memory == nullptr) {
+            panic("Failed to allocate host allocator arenas");
+        }
+        arena.top = 0;
+        arena.live = 0;
+    }
+    currentArena = 0;
+    std::fill(freeLists, freeLists + HOST_POOL_CLASSES, nullptr);
+    stats = {};
+    stats.heapAllocations = arenas.size();
+    callbacks = {
+        .pUserData = nullptr,
+        .pfnAllocation = allocationCallback,
+        .pfnReallocation = reallocationCallback,
+        .pfnFree = freeCallback,
+        .pfnInternalAllocation = internalAllocationCallback,
+        .pfnInternalFree = internalFreeCallback
+    };
+    running = true;
+}
+
+void stopHostAllocator () {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) {
+        return;
+    }
+    for (uint32_t scope = 0; scope < HOST_SCOPE_COUNT; scope++) {
+        if (stats.scopes[scope].liveBytes > 0) {
+            logMessage(LOG_SEVERITY_WARNING, ("The driver never freed " + std::to_string(stats.scopes[scope].liveBytes) + " bytes of " +
+                        scopeNames[scope] + " scope host memory").c_str());
+        }
+    }
+    // Anything still live is leaked along with its chunk, nothing may call into the allocator anymore
+    for (HostArena& arena : arenas) {
+        free(arena.memory);
+    }
+    arenas.clear();
+    for (void *chunk : chunks) {
+        free(chunk);
+    }
+    chunks.clear();
+    running = false;
+}
+
+const VkAllocationCallbacks *hostAllocator () {
+    return running ? &callbacks : nullptr;
+}
+
+void hostAllocatorBeginFrame (uint64_t frameNumber) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) {
+        return;
+    }
+    currentArena = static_cast<uint32_t>(frameNumber % arenas.size());
+    HostArena& arena = arenas[currentArena];
+    if (arena.live == 0) {
+        arena.top = 0;
+    } else {
+        // A command on another thread spans frames, the arena keeps filling up behind it and falls back to the heap if full
+        stats.deferredResets++;
+    }
+}
+
+HostAllocatorStats hostAllocatorStats () {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void logHostAllocatorStats (const HostAllocatorStats& since, uint64_t framesSince) {
+    HostAllocatorStats now = hostAllocatorStats();
+    uint64_t allocations = 0;
+    for (uint32_t scope = 0; scope < HOST_SCOPE_COUNT; scope++) {
+        const HostScopeStats& scopeStats = now.scopes[scope];
+        allocations += scopeStats.allocations - since.scopes[scope].allocations;
+        if (scopeStats.allocations == 0 && scopeStats.internalBytes == 0) {
+            continue;
+        }
+        log(("Host memory in " + std::string(scopeNames[scope]) + " scope: " + std::to_string(scopeStats.allocations) + " allocations, " +
+                    std::to_string(scopeStats.heapAllocations) + " from the heap, " + std::to_string(scopeStats.liveBytes) + " bytes live, peak " +
+                    std::to_string(scopeStats.peakBytes) + " bytes, " + std::to_string(scopeStats.internalBytes) + " bytes internal").c_str());
+    }
+    log(("Host allocations over the last " + std::to_string(framesSince) + " frames: " + std::to_string(allocations) + " by the driver, " +
+                std::to_string(now.heapAllocations - since.heapAllocations) + " from the heap, " +
+                std::to_string(now.deferredResets - since.deferredResets) + " deferred arena resets").c_str());
+}
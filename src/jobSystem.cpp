@@ -0,0 +1,143 @@
+#include "jobSystem.h"
+
+static thread_local uint32_t threadIndex = 0;
+
+static void pushJob (WorkDeque *deque, Job *job) {
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed);
+    deque->buffer[bottom & (JOB_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+static Job* popJob (WorkDeque *deque) {
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_relaxed);
+    // Orders the bottom store before the top load, otherwise a thief and the owner could both take the last job
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = deque->top.load(std::memory_order_relaxed);
+    if (top > bottom) {
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job *job = deque->buffer[bottom & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // Last job, race the thieves for it
+        if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+static Job* stealJob (WorkDeque *deque) {
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = deque->bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return nullptr;
+    }
+    Job *job = deque->buffer[top & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+static void runJob (Job *job) {
+    job->function(job->data, threadIndex);
+    job->counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+// Own deque first (LIFO keeps caches warm), then steal from the others starting at a pseudo random victim
+static Job* findJob (JobSystem *jobs) {
+    JobThread *self = jobs->threads[threadIndex].get();
+    Job *job = popJob(&self->deque);
+    if (job != nullptr) {
+        return job;
+    }
+    uint32_t count = static_cast<uint32_t>(jobs->threads.size());
+    self->stealSeed = self->stealSeed * 1664525u + 1013904223u;
+    uint32_t start = self->stealSeed % count;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t victim = (start + i) % count;
+        if (victim != threadIndex && (job = stealJob(&jobs->threads[victim]->deque)) != nullptr) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+static void workerMain (JobSystem *jobs, uint32_t index) {
+    threadIndex = index;
+    while (jobs->running.load(std::memory_order_acquire)) {
+        Job *job = findJob(jobs);
+        if (job != nullptr) {
+            runJob(job);
+            continue;
+        }
+        // The timeout covers the wakeup that races with going to sleep, it is rare enough not to need anything stronger
+        std::unique_lock<std::mutex> lock(jobs->sleepMutex);
+        jobs->sleeping.fetch_add(1, std::memory_order_relaxed);
+        jobs->wake.wait_for(lock, std::chrono::milliseconds(1));
+        jobs->sleeping.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void createJobSystem (uint32_t workerCount, JobSystem *jobs) {
+    threadIndex = 0;
+    jobs->running.store(true, std::memory_order_release);
+    jobs->sleeping.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i <= workerCount; i++) {
+        std::unique_ptr<JobThread> thread(new JobThread());
+        thread->deque.top.store(0, std::memory_order_relaxed);
+        thread->deque.bottom.store(0, std::memory_order_relaxed);
+        thread->stealSeed = i * 2654435761u + 1;
+        jobs->threads.push_back(std::move(thread));
+    }
+    for (uint32_t i = 1; i <= workerCount; i++) {
+        jobs->workers.emplace_back(workerMain, jobs, i);
+    }
+}
+
+void destroyJobSystem (JobSystem *jobs) {
+    jobs->running.store(false, std::memory_order_release);
+    jobs->wake.notify_all();
+    for (std::thread& worker : jobs->workers) {
+        worker.join();
+    }
+    jobs->workers.clear();
+    jobs->threads.clear();
+}
+
+uint32_t currentJobThread () {
+    return threadIndex;
+}
+
+uint32_t jobThreadCount (const JobSystem& jobs) {
+    return static_cast<uint32_t>(jobs.threads.size());
+}
+
+void submitJob (JobSystem *jobs, Job *job) {
+    JobThread *self = jobs->threads[threadIndex].get();
+    job->counter->pending.fetch_add(1, std::memory_order_relaxed);
+    if (self->deque.bottom.load(std::memory_order_relaxed) - self->deque.top.load(std::memory_order_acquire) >= JOB_DEQUE_SIZE) {
+        runJob(job);
+        return;
+    }
+    pushJob(&self->deque, job);
+    if (jobs->sleeping.load(std::memory_order_relaxed) > 0) {
+        jobs->wake.notify_one();
+    }
+}
+
+void waitForCounter (JobSystem *jobs, JobCounter *counter) {
+    while (counter->pending.load(std::memory_order_acquire) > 0) {
+        Job *job = findJob(jobs);
+        if (job != nullptr) {
+            runJob(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
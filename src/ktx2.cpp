@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cstring>
+
+#include "ktx2.h"
+#include "logger.h"
+#include "vulkanUtils.h"
+
+static const uint8_t ktx2Identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+// Header fields following the identifier, then the index of the data format descriptor and key/value data. The 64 bit
+// offset and length of the supercompression data that follow are not needed and would misalign the struct.
+struct Ktx2Header {
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+};
+
+struct Ktx2LevelIndex {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+static_assert(sizeof(ktx2Identifier) + sizeof(Ktx2Header) + 2 * sizeof(uint64_t) == KTX2_HEADER_SIZE, "Ktx2Header must match the file layout");
+
+bool formatBlock (VkFormat format, FormatBlock *block) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+            *block = { 1, 1, 1 };
+            return true;
+        case VK_FORMAT_R8G8_UNORM:
+            *block = { 1, 1, 2 };
+            return true;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            *block = { 1, 1, 4 };
+            return true;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            *block = { 1, 1, 8 };
+            return true;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            *block = { 1, 1, 16 };
+            return true;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+            *block = { 4, 4, 8 };
+            return true;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+        case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+        case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+            *block = { 4, 4, 16 };
+            return true;
+        default:
+            return false;
+    }
+}
+
+VkExtent3D levelExtent (const Ktx2File& file, uint32_t level) {
+    return { std::max(file.width >> level, 1u), std::max(file.height >> level, 1u), 1 };
+}
+
+static VkResult invalidFile (const std::string& path, const std::string& reason, Ktx2File *file) {
+    logMessage(LOG_SEVERITY_WARNING, ("Not loading \"" + path + "\": " + reason).c_str());
+    closeKtx2File(file);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+}
+
+VkResult openKtx2File (const std::string& path, Ktx2File *file) {
+    file->data = mapFile(path, &file->size);
+    if (file->data == nullptr) {
+        logMessage(LOG_SEVERITY_WARNING, ("Failed to map texture \"" + path + "\"").c_str());
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    if (file->size < KTX2_HEADER_SIZE || memcmp(file->data, ktx2Identifier, sizeof(ktx2Identifier)) != 0) {
+        return invalidFile(path, "not a KTX2 file", file);
+    }
+    Ktx2Header header;
+    memcpy(&header, file->data + sizeof(ktx2Identifier), sizeof(header));
+    if (header.supercompressionScheme != 0) {
+        return invalidFile(path, "supercompressed data is not supported", file);
+    }
+    if (header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+        return invalidFile(path, "only 2D textures without layers or faces are supported", file);
+    }
+    FormatBlock block;
+    if (!formatBlock(static_cast<VkFormat>(header.vkFormat), &block)) {
+        return invalidFile(path, "format " + std::to_string(header.vkFormat) + " is not supported", file);
+    }
+    file->format = static_cast<VkFormat>(header.vkFormat);
+    file->width = header.pixelWidth;
+    file->height = header.pixelHeight;
+    // A level count of 0 asks for mips to be generated at load time, only the base level is stored
+    uint32_t levelCount = std::max(header.levelCount, 1u);
+    if (levelCount > 32 || (header.pixelWidth | header.pixelHeight) >> (levelCount - 1) == 0) {
+        return invalidFile(path, "too many mip levels", file);
+    }
+    if (file->size < KTX2_HEADER_SIZE + levelCount * sizeof(Ktx2LevelIndex)) {
+        return invalidFile(path, "truncated level index", file);
+    }
+
+    file->levels.resize(levelCount);
+    for (uint32_t i = 0; i < levelCount; i++) {
+        Ktx2LevelIndex index;
+        memcpy(&index, file->data + KTX2_HEADER_SIZE + i * sizeof(Ktx2LevelIndex), sizeof(index));
+        VkExtent3D extent = levelExtent(*file, i);
+        uint64_t expected = static_cast<uint64_t>((extent.width + block.width - 1) / block.width) * ((extent.height + block.height - 1) / block.height) *
+            block.bytes;
+        if (index.byteLength != expected || index.byteOffset > file->size || index.byteLength > file->size - index.byteOffset) {
+            return invalidFile(path, "level " + std::to_string(i) + " has the wrong size or lies outside the file", file);
+        }
+        file->levels[i] = { index.byteOffset, index.byteLength };
+    }
+    return VK_SUCCESS;
+}
+
+void closeKtx2File (Ktx2File *file) {
+    if (file->data != nullptr) {
+        unmapFile(file->data, file->size);
+    }
+    file->data = nullptr;
+    file->levels.clear();
+}
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "logger.h"
+
+#define LOG_RECORD_TEXT         (LOG_RECORD_SIZE - sizeof(uint64_t) - sizeof(uint32_t))
+#define LOG_WRITE_BUFFER_SIZE   (64 * 1024)
+
+// Bounded queue after Dmitry Vyukov: sequence tells which position the record can be claimed for (equal to the position)
+// or read at (position + 1). Records are cache line aligned so producers filling neighbours do not share lines.
+struct alignas(64) LogRecord {
+    std::atomic<uint64_t> sequence;
+    uint32_t length;
+    char text[LOG_RECORD_TEXT];
+};
+
+struct RepeatCounter {
+    std::atomic<int32_t> messageId;
+    std::atomic<uint32_t> count;
+};
+
+static const char *severityNames[LOG_SEVERITY_COUNT] = { "debug", "info", "warning", "error" };
+static const char *severityPrefixes[LOG_SEVERITY_COUNT] = { "Debug: ", "Info: ", "Warning: ", "Error: " };
+
+static LogRecord ring[LOG_RING_RECORDS];
+// Producers claim positions at head, only the writer thread touches tail
+static std::atomic<uint64_t> head;
+static uint64_t tail;
+static std::atomic<bool> accepting;
+static std::atomic<bool> running;
+// Producers currently between checking accepting and publishing their records
+static std::atomic<uint32_t> producers;
+static std::atomic<uint64_t> dropped;
+static std::atomic<int> minimumSeverity(LOG_SEVERITY_INFO);
+static RepeatCounter repeats[LOG_REPEAT_SLOTS];
+static std::thread writer;
+static std::mutex stopMutex;
+
+static void writeDirect (const char *prefix, const char *msg) {
+    std::string line = std::string(prefix) + msg + "\n";
+    fwrite(line.data(), 1, line.size(), stderr);
+}
+
+// Copies length bytes starting at offset of the line prefix + msg + '\n'
+static void copyLine (const char *prefix, size_t prefixLength, const char *msg, size_t msgLength, size_t offset, char *dst, size_t length) {
+    while (length > 0) {
+        size_t count = 1;
+        if (offset < prefixLength) {
+            count = std::min(length, prefixLength - offset);
+            memcpy(dst, prefix + offset, count);
+        } else if (offset < prefixLength + msgLength) {
+            count = std::min(length, prefixLength + msgLength - offset);
+            memcpy(dst, msg + offset - prefixLength, count);
+        } else {
+            *dst = '\n';
+        }
+        dst += count;
+        offset += count;
+        length -= count;
+    }
+}
+
+static bool pushMessage (const char *prefix, const char *msg) {
+    size_t prefixLength = strlen(prefix);
+    size_t lineLength = std::min(prefixLength + strlen(msg) + 1, LOG_MAX_MESSAGE_RECORDS * LOG_RECORD_TEXT);
+    size_t msgLength = lineLength - prefixLength - 1;
+    uint64_t count = (lineLength + LOG_RECORD_TEXT - 1) / LOG_RECORD_TEXT;
+
+    // The writer frees records in order, so if the last one is free for this lap all records before it are as well
+    uint64_t position = head.load(std::memory_order_relaxed);
+    for (;;) {
+        uint64_t last = position + count - 1;
+        uint64_t sequence = ring[last & (LOG_RING_RECORDS - 1)].sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence - last);
+        if (difference == 0) {
+            if (head.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        LogRecord& record = ring[(position + i) & (LOG_RING_RECORDS - 1)];
+        size_t offset = i * LOG_RECORD_TEXT;
+        record.length = static_cast<uint32_t>(std::min(LOG_RECORD_TEXT, lineLength - offset));
+        copyLine(prefix, prefixLength, msg, msgLength, offset, record.text, record.length);
+        record.sequence.store(position + i + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+// Batches everything that is ready into one write, a message that is still being filled in just ends the batch
+static void writeRecords () {
+    static char buffer[LOG_WRITE_BUFFER_SIZE];
+    for (;;) {
+        bool stopping = !running.load(std::memory_order_acquire);
+        size_t size = 0;
+        for (;;) {
+            LogRecord& record = ring[tail & (LOG_RING_RECORDS - 1)];
+            if (record.sequence.load(std::memory_order_acquire) != tail + 1) {
+                break;
+            }
+            if (size + record.length > sizeof(buffer)) {
+                fwrite(buffer, 1, size, stderr);
+                size = 0;
+            }
+            memcpy(buffer + size, record.text, record.length);
+            size += record.length;
+            record.sequence.store(tail + LOG_RING_RECORDS, std::memory_order_release);
+            tail++;
+        }
+        if (size > 0) {
+            fwrite(buffer, 1, size, stderr);
+            fflush(stderr);
+        } else if (stopping) {
+            return;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+// Message IDs of the validation layers are already hashes of the VUID, so they index the table directly
+static bool allowRepeat (int32_t messageId) {
+    if (messageId == 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < LOG_REPEAT_SLOTS; i++) {
+        RepeatCounter& counter = repeats[(static_cast<uint32_t>(messageId) + i) & (LOG_REPEAT_SLOTS - 1)];
+        int32_t id = counter.messageId.load(std::memory_order_acquire);
+        if (id == 0 && counter.messageId.compare_exchange_strong(id, messageId, std::memory_order_acq_rel)) {
+            id = messageId;
+        }
+        if (id == messageId) {
+            return counter.count.fetch_add(1, std::memory_order_relaxed) < LOG_REPEAT_LIMIT;
+        }
+    }
+    return true;
+}
+
+bool parseLogSeverity (const char *name, LogSeverity *severity) {
+    for (int i = 0; i < LOG_SEVERITY_COUNT; i++) {
+        if (strcmp(name, severityNames[i]) == 0) {
+            *severity = static_cast<LogSeverity>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void startLogger (LogSeverity minSeverity) {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    if (writer.joinable()) {
+        return;
+    }
+    minimumSeverity.store(minSeverity, std::memory_order_relaxed);
+    for (uint64_t i = 0; i < LOG_RING_RECORDS; i++) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    for (RepeatCounter& counter : repeats) {
+        counter.messageId.store(0, std::memory_order_relaxed);
+        counter.count.store(0, std::memory_order_relaxed);
+    }
+    head.store(0, std::memory_order_relaxed);
+    tail = 0;
+    dropped.store(0, std::memory_order_relaxed);
+    running.store(true, std::memory_order_release);
+    writer = std::thread(writeRecords);
+    accepting.store(true, std::memory_order_seq_cst);
+}
+
+void stopLogger () {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    if (!writer.joinable()) {
+        return;
+    }
+    // New messages go straight to stderr from here on, the ones already being pushed still make it into the ring
+    accepting.store(false, std::memory_order_seq_cst);
+    while (producers.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+    running.store(false, std::memory_order_release);
+    writer.join();
+
+    for (RepeatCounter& counter : repeats) {
+        uint32_t count = counter.count.load(std::memory_order_relaxed);
+        if (count > LOG_REPEAT_LIMIT) {
+            char id[16];
+            snprintf(id, sizeof(id), "0x%08x", static_cast<uint32_t>(counter.messageId.load(std::memory_order_relaxed)));
+            writeDirect(severityPrefixes[LOG_SEVERITY_INFO],
+                    ("Suppressed " + std::to_string(count - LOG_REPEAT_LIMIT) + " repeats of message " + id).c_str());
+        }
+    }
+    if (dropped.load(std::memory_order_relaxed) > 0) {
+        writeDirect(severityPrefixes[LOG_SEVERITY_WARNING],
+                ("Dropped " + std::to_string(dropped.load(std::memory_order_relaxed)) + " log messages, the ring was full").c_str());
+    }
+    fflush(stderr);
+}
+
+bool logEnabled (LogSeverity severity) {
+    return severity >= minimumSeverity.load(std::memory_order_relaxed);
+}
+
+void logMessage (LogSeverity severity, const char *msg) {
+    if (!logEnabled(severity)) {
+        return;
+    }
+    // Pairs with stopLogger: either the stop sees this producer and waits for it, or this producer sees the stop
+    producers.fetch_add(1, std::memory_order_seq_cst);
+    if (accepting.load(std::memory_order_seq_cst)) {
+        pushMessage(severityPrefixes[severity], msg);
+    } else {
+        writeDirect(severityPrefixes[severity], msg);
+    }
+    producers.fetch_sub(1, std::memory_order_release);
+}
+
+void logRepeatedMessage (LogSeverity severity, int32_t messageId, const char *msg) {
+    if (logEnabled(severity) && allowRepeat(messageId)) {
+        logMessage(severity, msg);
+    }
+}
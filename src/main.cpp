@@ -2,6 +2,13 @@
 #include <vector>
 #include <cstring>
 #include <cinttypes>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <unordered_set>
 
 #include <vulkan/vulkan.h>
 
@@ -9,63 +16,125 @@
 #include <SDL2/SDL_vulkan.h>
 
 #include "vulkanUtils.h"
+#include "asyncCompute.h"
+#include "frameRing.h"
+#include "hostAllocator.h"
+#include "jobSystem.h"
+#include "commandRecorder.h"
+#include "logger.h"
+#include "descriptors.h"
+#include "eventQueue.h"
+#include "gpuScene.h"
+#include "memoryAllocator.h"
+#include "meshLoader.h"
+#include "offscreen.h"
+#include "particles.h"
+#include "profiler.h"
+#include "renderGraph.h"
+#include "shaderWatcher.h"
+#include "simulation.h"
+#include "staticCommands.h"
+#include "swapchain.h"
+#include "textureStreamer.h"
+#include "pipelines.h"
+#include "uploader.h"
 
 std::vector<const char*> requiredDeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-std::vector<const char*> requiredInstanceExtensions = { VK_EXT_DEBUG_UTILS_EXTENSION_NAME };
-std::vector<const char*> requiredLayers = { "VK_LAYER_KHRONOS_validation" };
+std::vector<const char*> requiredInstanceExtensions;
+// Validation adds its layer and the debug utils extension at startup when enabled
+std::vector<const char*> requiredLayers;
 
+#define DEFAULT_HEADLESS_FRAMES     600
+// Host allocations are counted from this frame on, startup work such as pipeline creation is done by then
+#define HOST_ALLOCATOR_WARMUP_FRAMES    60
+// Frames with more draws than this are recorded in parallel, one secondary command buffer per chunk
+#define DRAWS_PER_JOB                   256
+#define DEFAULT_PIPELINE_CACHE_PATH "pipeline_cache.bin"
+// Smallest fraction of the target size the scene can be rendered at
+#define MIN_RENDER_SCALE            0.25f
+// How long the event thread waits for an event before checking whether the render thread is done
+#define EVENT_WAIT_MS               10
+#define MINIMIZED_WAIT_MS           10
+#define VALIDATION_LAYER            "VK_LAYER_KHRONOS_validation"
+
+// Only relative to the other queues of the device, implementations are free to ignore them
+struct QueuePriorities {
+    float graphics = 1.0f;
+    float transfer = 1.0f;
+    float compute = 0.5f;
+};
+
+#ifdef ENABLE_VALIDATION
 VkBool32 debugCallback (VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT messageTypes,
         const VkDebugUtilsMessengerCallbackDataEXT* callbackData, void* userData) {
-    std::cerr << callbackData->pMessage << std::endl;
+    // Called from inside Vulkan commands, possibly on driver threads, so it must never wait on the output
+    LogSeverity logSeverity = LOG_SEVERITY_DEBUG;
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        logSeverity = LOG_SEVERITY_ERROR;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        logSeverity = LOG_SEVERITY_WARNING;
+    }
+    logRepeatedMessage(logSeverity, callbackData->messageIdNumber, callbackData->pMessage);
     return VK_FALSE;
 }
+#endif
+
+// Instance layers and extensions, enumerated while SDL is still starting up since the first loader call has to find and
+// parse every layer and driver manifest
+struct InstanceSupport {
+    std::unordered_set<std::string> layers;
+    std::unordered_set<std::string> extensions;
+};
 
-VkResult createVulkanInstance (SDL_Window* window, VkInstance* res) {
+void enumerateInstanceSupport (InstanceSupport *support) {
     std::vector<VkLayerProperties> layerProperties;
     ENUMERATE_OBJECTS(layerProperties, vkEnumerateInstanceLayerProperties(&size, nullptr),
             vkEnumerateInstanceLayerProperties(&size, layerProperties.data()), "Failed to enumerate instance layers");
-
-    for (const char *layerName : requiredLayers) {
-        bool found = false;
-        for (VkLayerProperties layerProps : layerProperties) {
-            if (strcmp(layerName, layerProps.layerName) == 0) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            panic(("Required layer \"" + std::string(layerName) + "\" not availbale").c_str());
-        }
+    for (const VkLayerProperties& layerProps : layerProperties) {
+        support->layers.insert(layerProps.layerName);
     }
 
     std::vector<VkExtensionProperties> extProps;
     ENUMERATE_OBJECTS(extProps, vkEnumerateInstanceExtensionProperties(nullptr, &size, NULL),
             vkEnumerateInstanceExtensionProperties(nullptr, &size, extProps.data()), "Failed to enumerate instance extensions");
+    for (const VkExtensionProperties& extProp : extProps) {
+        support->extensions.insert(extProp.extensionName);
+    }
+}
 
-    std::vector<const char*> sdlRequiredInstanceExtensions;
-    uint32_t size = 0;
-    ASSERT_RESULT(SDL_Vulkan_GetInstanceExtensions(window, &size, nullptr), SDL_TRUE, "Failed to get number of instance extensions required by SDL2");
-    sdlRequiredInstanceExtensions.resize(size);
-    ASSERT_RESULT(SDL_Vulkan_GetInstanceExtensions(window, &size, sdlRequiredInstanceExtensions.data()), SDL_TRUE,
-            "Failed to enumerate instance extensions required by SDL2");
+VkResult createVulkanInstance (SDL_Window* window, const InstanceSupport& support, VkInstance* res, bool& properties2Enabled) {
+    for (const char *layerName : requiredLayers) {
+        if (support.layers.count(layerName) == 0) {
+            panic(("Required layer \"" + std::string(layerName) + "\" not availbale").c_str());
+        }
+    }
+
+    // Headless runs have no window and therefore need no WSI extensions at all
+    if (window != nullptr) {
+        std::vector<const char*> sdlRequiredInstanceExtensions;
+        uint32_t size = 0;
+        ASSERT_RESULT(SDL_Vulkan_GetInstanceExtensions(window, &size, nullptr), SDL_TRUE, "Failed to get number of instance extensions required by SDL2");
+        sdlRequiredInstanceExtensions.resize(size);
+        ASSERT_RESULT(SDL_Vulkan_GetInstanceExtensions(window, &size, sdlRequiredInstanceExtensions.data()), SDL_TRUE,
+                "Failed to enumerate instance extensions required by SDL2");
 
-    for (const char * extName : sdlRequiredInstanceExtensions) {
-        requiredInstanceExtensions.push_back(extName);
+        for (const char * extName : sdlRequiredInstanceExtensions) {
+            requiredInstanceExtensions.push_back(extName);
+        }
     }
 
     for (const char *extensionName : requiredInstanceExtensions) {
-        bool found = false;
-        for (VkExtensionProperties extProp : extProps) {
-            if (strcmp(extProp.extensionName, extensionName) == 0) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
+        if (support.extensions.count(extensionName) == 0) {
             panic(("Required instance extension \"" + std::string(extensionName) + "\" not availbale").c_str());
         }
     }
 
+    // Optional, only needed to query descriptor indexing support
+    properties2Enabled = support.extensions.count(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != 0;
+    if (properties2Enabled) {
+        requiredInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
     VkApplicationInfo applicationInfo = {
         .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
         .pNext = nullptr,
@@ -87,15 +156,24 @@ VkResult createVulkanInstance (SDL_Window* window, VkInstance* res) {
         .ppEnabledExtensionNames = requiredInstanceExtensions.data()
     };
 
-    return vkCreateInstance(&instanceCreateInfo, nullptr, res);
+    return vkCreateInstance(&instanceCreateInfo, hostAllocator(), res);
 }
 
+#ifdef ENABLE_VALIDATION
 VkResult createDebugMessenger (VkInstance instance, PFN_vkDebugUtilsMessengerCallbackEXT callback, VkDebugUtilsMessengerEXT* debugMessenger) {
+    // Only ask for what the logger would print anyway, info and verbose messages of the layers count as debug output
+    VkDebugUtilsMessageSeverityFlagsEXT severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    if (logEnabled(LOG_SEVERITY_WARNING)) {
+        severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+    }
+    if (logEnabled(LOG_SEVERITY_DEBUG)) {
+        severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+    }
     VkDebugUtilsMessengerCreateInfoEXT debugMessengerCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
         .pNext = nullptr,
         .flags = 0,
-        .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+        .messageSeverity = severities,
         .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
         .pfnUserCallback = callback,
         .pUserData = nullptr
@@ -109,7 +187,7 @@ VkResult createDebugMessenger (VkInstance instance, PFN_vkDebugUtilsMessengerCal
         panic("Failed to get function pointer for vkCreateDebugUtilsMessengerEXT");
     }
 
-    return vkCreateDebugUtilsMessengerEXT(instance, &debugMessengerCreateInfo, nullptr, debugMessenger);
+    return vkCreateDebugUtilsMessengerEXT(instance, &debugMessengerCreateInfo, hostAllocator(), debugMessenger);
 }
 
 void destroyDebugMessenger (VkInstance instance, VkDebugUtilsMessengerEXT messenger) {
@@ -120,95 +198,153 @@ void destroyDebugMessenger (VkInstance instance, VkDebugUtilsMessengerEXT messen
         panic("Failed to get function pointer for vkCreateDebugUtilsMessengerEXT");
     }
 
-    vkDestroyDebugUtilsMessengerEXT(instance, messenger, nullptr);
+    vkDestroyDebugUtilsMessengerEXT(instance, messenger, hostAllocator());
 }
+#endif
 
-void pickPhysicalDevice (VkInstance instance, VkSurfaceKHR surface, VkPhysicalDevice *physicalDevice,
-        uint32_t& graphicsQueueIndex, uint32_t& presentQueueIndex) {
-    std::vector<VkPhysicalDevice> devices;
-    ENUMERATE_OBJECTS(devices, vkEnumeratePhysicalDevices(instance, &size, NULL), vkEnumeratePhysicalDevices(instance, &size, devices.data()),
-            "Failed to enumerate physical devices");
+// Everything learned about a physical device while scoring it, score 0 means unsuitable
+struct DeviceCandidate {
+    VkPhysicalDevice device;
+    uint32_t score;
+    uint32_t graphicsFamily;
+    uint32_t presentFamily;
+    uint32_t transferFamily;
+    uint32_t computeFamily;
+    uint32_t computeQueueInFamily;
+    // Kept so later extension checks don't have to enumerate again
+    std::unordered_set<std::string> extensions;
+};
 
-    uint32_t maxScore = 0;
-    for (VkPhysicalDevice device : devices) {
-        bool suitable = true;
-        uint32_t graphicsFamilyIndex = 0, presentFamilyIndex = 0;
-        bool supportsGraphics = false, supportsPresent = false;
-        uint32_t queueFaimilyCount = 0;
-        std::vector<VkQueueFamilyProperties> queueFamilyProperties;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFaimilyCount, NULL);
-        queueFamilyProperties.resize(queueFaimilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFaimilyCount, queueFamilyProperties.data());
-
-        for (uint32_t i = 0; i < queueFamilyProperties.size(); i++) {
-            VkQueueFamilyProperties familyProperties = queueFamilyProperties[i];
-            if (!supportsGraphics && (familyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) {
-                graphicsFamilyIndex = i;
-                supportsGraphics = true;
-            }
-            VkBool32 wsiSupported = VK_FALSE;
-            ASSERT_RESULT(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &wsiSupported), VK_SUCCESS, "Failed to query queue family for WSI support");
-            if (!supportsPresent && wsiSupported == VK_TRUE) {
-                presentFamilyIndex = i;
-                supportsPresent = true;
+static void scorePhysicalDevice (VkPhysicalDevice device, VkSurfaceKHR surface, DeviceCandidate *candidate) {
+    candidate->device = device;
+    candidate->score = 0;
+    bool suitable = true;
+    uint32_t graphicsFamilyIndex = 0, presentFamilyIndex = 0, transferFamilyIndex = UINT32_MAX, computeFamilyIndex = UINT32_MAX;
+    bool supportsGraphics = false, supportsPresent = false;
+    uint32_t queueFaimilyCount = 0;
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFaimilyCount, NULL);
+    queueFamilyProperties.resize(queueFaimilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFaimilyCount, queueFamilyProperties.data());
+
+    for (uint32_t i = 0; i < queueFamilyProperties.size(); i++) {
+        VkQueueFamilyProperties familyProperties = queueFamilyProperties[i];
+        if (!supportsGraphics && (familyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) {
+            graphicsFamilyIndex = i;
+            supportsGraphics = true;
+        }
+        // A transfer-only family usually maps to the DMA engines, a compute family without graphics is the next best thing
+        if ((familyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0 && (familyProperties.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0) {
+            bool transferOnly = (familyProperties.queueFlags & VK_QUEUE_COMPUTE_BIT) == 0;
+            if (transferFamilyIndex == UINT32_MAX || (transferOnly && (queueFamilyProperties[transferFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0)) {
+                transferFamilyIndex = i;
             }
         }
-
-        if (!supportsGraphics || !supportsPresent) {
-            suitable = false;
+        if (surface == VK_NULL_HANDLE) {
+            continue;
+        }
+        VkBool32 wsiSupported = VK_FALSE;
+        ASSERT_RESULT(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &wsiSupported), VK_SUCCESS, "Failed to query queue family for WSI support");
+        if (!supportsPresent && wsiSupported == VK_TRUE) {
+            presentFamilyIndex = i;
+            supportsPresent = true;
+        }
+    }
+    // Graphics queues can always do transfers, uploads just share the queue with rendering then
+    if (transferFamilyIndex == UINT32_MAX) {
+        transferFamilyIndex = graphicsFamilyIndex;
+    }
+    // Async compute wants a family without graphics, preferably one that doesn't also carry the uploads
+    for (uint32_t i = 0; i < queueFamilyProperties.size(); i++) {
+        VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+        if ((flags & VK_QUEUE_GRAPHICS_BIT) == 0 && (flags & VK_QUEUE_COMPUTE_BIT) != 0 &&
+                (computeFamilyIndex == UINT32_MAX || (computeFamilyIndex == transferFamilyIndex && i != transferFamilyIndex))) {
+            computeFamilyIndex = i;
         }
+    }
+    if (computeFamilyIndex == UINT32_MAX) {
+        computeFamilyIndex = graphicsFamilyIndex;
+    }
 
-        std::vector<VkLayerProperties> deviceLayers;
-        ENUMERATE_OBJECTS(deviceLayers, vkEnumerateDeviceLayerProperties(device, &size, nullptr),
-                vkEnumerateDeviceLayerProperties(device, &size, deviceLayers.data()), "Failed to enumerate device layers");
-        for (const char *layer : requiredLayers) {
-            bool found = false;
-            for (VkLayerProperties layerProps : deviceLayers) {
-                if (strcmp(layer, layerProps.layerName) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                suitable = false;
-            }
+    // Without a surface nothing is ever presented, the graphics family stands in for the present one
+    if (surface == VK_NULL_HANDLE) {
+        presentFamilyIndex = graphicsFamilyIndex;
+        supportsPresent = supportsGraphics;
+    }
+
+    if (!supportsGraphics || !supportsPresent) {
+        suitable = false;
+    }
+
+    std::vector<VkLayerProperties> deviceLayers;
+    ENUMERATE_OBJECTS(deviceLayers, vkEnumerateDeviceLayerProperties(device, &size, nullptr),
+            vkEnumerateDeviceLayerProperties(device, &size, deviceLayers.data()), "Failed to enumerate device layers");
+    std::unordered_set<std::string> layerNames;
+    for (const VkLayerProperties& layerProps : deviceLayers) {
+        layerNames.insert(layerProps.layerName);
+    }
+    for (const char *layer : requiredLayers) {
+        if (layerNames.count(layer) == 0) {
+            suitable = false;
         }
+    }
 
-        std::vector<VkExtensionProperties> deviceExtensions;
-        ENUMERATE_OBJECTS(deviceExtensions, vkEnumerateDeviceExtensionProperties(device, nullptr, &size, nullptr),
-                vkEnumerateDeviceExtensionProperties(device, nullptr, &size, deviceExtensions.data()), "Failed to enumerate device extensions");
-        for (const char* extension : requiredDeviceExtensions) {
-            bool found = false;
-            for (VkExtensionProperties extProps : deviceExtensions) {
-                if (strcmp(extProps.extensionName, extension) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                suitable = false;
-            }
+    std::vector<VkExtensionProperties> deviceExtensions;
+    ENUMERATE_OBJECTS(deviceExtensions, vkEnumerateDeviceExtensionProperties(device, nullptr, &size, nullptr),
+            vkEnumerateDeviceExtensionProperties(device, nullptr, &size, deviceExtensions.data()), "Failed to enumerate device extensions");
+    for (const VkExtensionProperties& extProps : deviceExtensions) {
+        candidate->extensions.insert(extProps.extensionName);
+    }
+    for (const char* extension : requiredDeviceExtensions) {
+        if (candidate->extensions.count(extension) == 0) {
+            suitable = false;
         }
+    }
 
+    if (suitable && surface != VK_NULL_HANDLE) {
         VkSurfaceCapabilitiesKHR capabilities;
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &capabilities);
         if ((capabilities.supportedUsageFlags & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) == 0) {
             suitable = false;
         }
+    }
 
-        if (suitable) {
-            uint32_t score = 1;
-            VkPhysicalDeviceProperties properties;
-            vkGetPhysicalDeviceProperties(device, &properties);
-            if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-                score += 100;
-            }
-            if (score > maxScore) {
-                maxScore = score;
-                graphicsQueueIndex = graphicsFamilyIndex;
-                presentQueueIndex = presentFamilyIndex;
-                (*physicalDevice) = device;
-            }
+    if (suitable) {
+        candidate->score = 1;
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+            candidate->score += 100;
+        }
+    }
+    candidate->graphicsFamily = graphicsFamilyIndex;
+    candidate->presentFamily = presentFamilyIndex;
+    candidate->transferFamily = transferFamilyIndex;
+    candidate->computeFamily = computeFamilyIndex;
+    // A family shared with another role gives compute a queue of its own if it has a second one
+    bool shared = computeFamilyIndex == graphicsFamilyIndex || computeFamilyIndex == transferFamilyIndex;
+    candidate->computeQueueInFamily = shared && queueFamilyProperties[computeFamilyIndex].queueCount > 1 ? 1 : 0;
+}
+
+// Devices are scored in parallel, the query calls of different devices don't depend on each other
+void pickPhysicalDevice (JobSystem *jobs, VkInstance instance, VkSurfaceKHR surface, DeviceCandidate *chosen) {
+    std::vector<VkPhysicalDevice> devices;
+    ENUMERATE_OBJECTS(devices, vkEnumeratePhysicalDevices(instance, &size, NULL), vkEnumeratePhysicalDevices(instance, &size, devices.data()),
+            "Failed to enumerate physical devices");
+
+    std::vector<DeviceCandidate> candidates(devices.size());
+    parallelFor(jobs, static_cast<uint32_t>(devices.size()), 1, [&] (uint32_t begin, uint32_t end, uint32_t thread) {
+        for (uint32_t i = begin; i < end; i++) {
+            scorePhysicalDevice(devices[i], surface, &candidates[i]);
+        }
+    });
+
+    uint32_t maxScore = 0;
+    for (DeviceCandidate& candidate : candidates) {
+        // Ties go to the first device, like the order the loader reports them in
+        if (candidate.score > maxScore) {
+            maxScore = candidate.score;
+            *chosen = std::move(candidate);
         }
     }
     if (maxScore == 0) {
@@ -216,31 +352,50 @@ void pickPhysicalDevice (VkInstance instance, VkSurfaceKHR surface, VkPhysicalDe
     }
 }
 
-VkResult createLogicalDevice (VkPhysicalDevice physicalDevice, VkDevice* device, uint32_t graphicsQueueIndex, uint32_t presentQueueIndex) {
-    float one =  1.0f;
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos {
-        {
-            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-            .pNext = nullptr,
-            .flags = 0,
-            .queueFamilyIndex = graphicsQueueIndex,
-            .queueCount = 1,
-            .pQueuePriorities = &one
+VkResult createLogicalDevice (VkPhysicalDevice physicalDevice, VkDevice* device, uint32_t graphicsQueueIndex, uint32_t presentQueueIndex,
+        uint32_t transferQueueIndex, uint32_t computeQueueIndex, uint32_t computeQueueInFamily, const QueuePriorities& priorities,
+        const VkPhysicalDeviceFeatures& features, const void *featureChain) {
+    struct FamilyQueues {
+        uint32_t family;
+        uint32_t count;
+        float priorities[2];
+    };
+    std::vector<FamilyQueues> families;
+    // Queue 0 of every distinct family is shared by the roles placed in it and gets the highest of their priorities,
+    // only compute may get a second queue
+    auto addQueue = [&families] (uint32_t family, uint32_t queue, float priority) {
+        for (FamilyQueues& entry : families) {
+            if (entry.family == family) {
+                if (queue < entry.count) {
+                    entry.priorities[queue] = std::max(entry.priorities[queue], priority);
+                } else {
+                    entry.priorities[queue] = priority;
+                    entry.count = queue + 1;
+                }
+                return;
+            }
         }
+        families.push_back({ family, 1, { priority, 0.0f } });
     };
-    if (graphicsQueueIndex != presentQueueIndex) {
+    addQueue(graphicsQueueIndex, 0, priorities.graphics);
+    addQueue(presentQueueIndex, 0, priorities.graphics);
+    addQueue(transferQueueIndex, 0, priorities.transfer);
+    addQueue(computeQueueIndex, computeQueueInFamily, priorities.compute);
+
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (const FamilyQueues& entry : families) {
         queueCreateInfos.push_back({
             .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
             .pNext = nullptr,
             .flags = 0,
-            .queueFamilyIndex = presentQueueIndex,
-            .queueCount = 1,
-            .pQueuePriorities = &one
+            .queueFamilyIndex = entry.family,
+            .queueCount = entry.count,
+            .pQueuePriorities = entry.priorities
         });
     }
     VkDeviceCreateInfo deviceCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = nullptr,
+        .pNext = featureChain,
         .flags = 0,
         .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
         .pQueueCreateInfos = queueCreateInfos.data(),
@@ -248,277 +403,1086 @@ VkResult createLogicalDevice (VkPhysicalDevice physicalDevice, VkDevice* device,
         .ppEnabledLayerNames = requiredLayers.data(),
         .enabledExtensionCount = static_cast<uint32_t>(requiredDeviceExtensions.size()),
         .ppEnabledExtensionNames = requiredDeviceExtensions.data(),
-        .pEnabledFeatures = NULL
+        .pEnabledFeatures = &features
     };
 
-    return vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, device);
+    return vkCreateDevice(physicalDevice, &deviceCreateInfo, hostAllocator(), device);
 }
 
-void retrieveQueues (VkDevice device, uint32_t graphicsQueueIndex, uint32_t presentQueueIndex, VkQueue *graphicsQueue, VkQueue *presentQueue) {
+void retrieveQueues (VkDevice device, uint32_t graphicsQueueIndex, uint32_t presentQueueIndex, uint32_t transferQueueIndex, uint32_t computeQueueIndex,
+        uint32_t computeQueueInFamily, VkQueue *graphicsQueue, VkQueue *presentQueue, VkQueue *transferQueue, VkQueue *computeQueue) {
+    // Everything but compute uses queue 0 of its family, so the same family always yields the same queue
     vkGetDeviceQueue(device, graphicsQueueIndex, 0, graphicsQueue);
-    if (graphicsQueueIndex == presentQueueIndex) {
-        (*presentQueue) = (*graphicsQueue);
-    } else {
-        vkGetDeviceQueue(device, presentQueueIndex, 0, presentQueue);
-    }
+    vkGetDeviceQueue(device, presentQueueIndex, 0, presentQueue);
+    vkGetDeviceQueue(device, transferQueueIndex, 0, transferQueue);
+    vkGetDeviceQueue(device, computeQueueIndex, computeQueueInFamily, computeQueue);
 }
 
-VkResult createSwapchain (VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, SDL_Window* window,
-        uint32_t graphicsQueueIndex, uint32_t presentQueueIndex, VkSwapchainKHR *swapchain) {
-    VkSurfaceCapabilitiesKHR surfaceCapabilities;
-    VkExtent2D extent;
-    VkFormat format;
-    VkColorSpaceKHR colorSpace;
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
-
-    if ((surfaceCapabilities.supportedCompositeAlpha & compositeAlpha) == 0) {
-        if ((surfaceCapabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR) != 0)
-            compositeAlpha = VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR;
-        if ((surfaceCapabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR) != 0)
-            compositeAlpha = VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR;
-        if ((surfaceCapabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR) != 0)
-            compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
-    }
-
-    std::vector<VkSurfaceFormatKHR> supportedSurfaceFormats;
-    ENUMERATE_OBJECTS(supportedSurfaceFormats, vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &size, nullptr),
-            vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &size, supportedSurfaceFormats.data()), "Failed to enumerate supported surface formats");
-    bool preferedSurfaceFormatFound = false;
-    for (VkSurfaceFormatKHR surfaceFormat : supportedSurfaceFormats) {
-        if (surfaceFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR && surfaceFormat.format == VK_FORMAT_B8G8R8A8_SRGB) {
-            format = surfaceFormat.format;
-            colorSpace = surfaceFormat.colorSpace;
-            preferedSurfaceFormatFound = true;
-            break;
-        }
-    }
-    if (!preferedSurfaceFormatFound) {
-        log("Prefered surface format could not be found, defaulting to first available surface format (colors might be inaccurate)");
-        format = supportedSurfaceFormats[0].format;
-        colorSpace = supportedSurfaceFormats[0].colorSpace;
+static void recordDraws (VkCommandBuffer cmdBuffer, VkPipeline pipeline, const BindlessTable& table, uint32_t slot, VkExtent2D extent, uint32_t draws) {
+    VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+    VkRect2D scissor = { { 0, 0 }, extent };
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    // Secondaries inherit no bindings, every command buffer binds the table itself
+    bindBindlessTable(cmdBuffer, table, slot, VK_PIPELINE_BIND_POINT_GRAPHICS);
+    vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+    for (uint32_t i = 0; i < draws; i++) {
+        vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
     }
+}
+
+// Small frames are recorded inline, larger ones are split into secondary command buffers recorded on the job system.
+// Without jobs everything is recorded inline, for command buffers that outlive the slot's secondaries. The GPU driven
+// instances, if any, are drawn after the triangles.
+void recordFrame (VkCommandBuffer cmdBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent, VkPipeline pipeline,
+        const BindlessTable& table, double time, uint32_t draws, const GpuSceneFrame *gpuScene, JobSystem *jobs, CommandRecorder *recorder, uint32_t slot,
+        std::vector<VkCommandBuffer>& secondaries) {
+    // Cycles every 256 ticks
+    float t = static_cast<float>(fmod(time * SIMULATION_TICK_RATE, 256.0) / 255.0);
+    VkClearValue clearValue;
+    clearValue.color = { { 0.1f * t, 0.1f, 0.1f * (1.0f - t), 1.0f } };
+    VkRenderPassBeginInfo renderPassBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .pNext = nullptr,
+        .renderPass = renderPass,
+        .framebuffer = framebuffer,
+        .renderArea = { { 0, 0 }, extent },
+        .clearValueCount = 1,
+        .pClearValues = &clearValue
+    };
+    bool parallel = jobs != nullptr && draws > DRAWS_PER_JOB;
 
-    std::vector<VkPresentModeKHR> supportedPresentModes;
-    ENUMERATE_OBJECTS(supportedPresentModes, vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &size, nullptr),
-            vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &size, supportedPresentModes.data()), "Failed to enumerate supported present modes");
-    for (VkPresentModeKHR mode : supportedPresentModes) {
-        if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            presentMode = mode;
-            break;
+    vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    if (!parallel) {
+        recordDraws(cmdBuffer, pipeline, table, slot, extent, draws);
+        if (gpuScene != nullptr) {
+            recordGpuSceneDraws(cmdBuffer, *gpuScene, extent);
         }
+    } else {
+        VkCommandBufferInheritanceInfo inheritance = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .pNext = nullptr,
+            .renderPass = renderPass,
+            .subpass = 0,
+            .framebuffer = framebuffer,
+            .occlusionQueryEnable = VK_FALSE,
+            .queryFlags = 0,
+            .pipelineStatistics = 0
+        };
+        // Every chunk writes its own element, so the execution order matches the draw order no matter which thread recorded it
+        secondaries.resize((draws + DRAWS_PER_JOB - 1) / DRAWS_PER_JOB);
+        parallelFor(jobs, draws, DRAWS_PER_JOB, [&] (uint32_t begin, uint32_t end, uint32_t thread) {
+            VkCommandBuffer secondary = beginSecondary(recorder, slot, thread, inheritance);
+            recordDraws(secondary, pipeline, table, slot, extent, end - begin);
+            ASSERT_RESULT(vkEndCommandBuffer(secondary), VK_SUCCESS, "Failed to end secondary command buffer");
+            secondaries[begin / DRAWS_PER_JOB] = secondary;
+        });
+        if (gpuScene != nullptr) {
+            VkCommandBuffer secondary = beginSecondary(recorder, slot, currentJobThread(), inheritance);
+            recordGpuSceneDraws(secondary, *gpuScene, extent);
+            ASSERT_RESULT(vkEndCommandBuffer(secondary), VK_SUCCESS, "Failed to end secondary command buffer");
+            secondaries.push_back(secondary);
+        }
+        vkCmdExecuteCommands(cmdBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
     }
+    vkCmdEndRenderPass(cmdBuffer);
+}
 
-    int winWidth = 0, winHeight = 0;
-    SDL_Vulkan_GetDrawableSize(window, &winWidth, &winHeight);
-    extent.width = CLAMP(static_cast<uint32_t>(winWidth), surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
-    extent.height = CLAMP(static_cast<uint32_t>(winWidth), surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+// Everything recordFrame needs, handed to the scene pass of the render graph
+struct ScenePassData {
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;
+    VkPipeline pipeline;
+    const BindlessTable *table;
+    double time;
+    uint32_t draws;
+    // Null when there are no GPU driven instances or they are still being uploaded
+    GpuSceneFrame *gpuScene;
+    JobSystem *jobs;
+    CommandRecorder *recorder;
+    uint32_t slot;
+    std::vector<VkCommandBuffer> *secondaries;
+};
 
-    uint32_t queues[] = { graphicsQueueIndex, presentQueueIndex };
+struct ReadbackPassData {
+    const OffscreenTargets *targets;
+    uint32_t index;
+};
 
-    VkSwapchainCreateInfoKHR swapchainCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-        .pNext = nullptr,
-        .flags = 0,
-        .surface = surface,
-        .minImageCount = surfaceCapabilities.minImageCount,
-        .imageFormat = format,
-        .imageColorSpace = colorSpace,
-        .imageExtent = extent,
-        .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-        .imageSharingMode = (graphicsQueueIndex == presentQueueIndex ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT),
-        .queueFamilyIndexCount = 2,
-        .pQueueFamilyIndices = queues,
-        .preTransform = surfaceCapabilities.currentTransform,
-        .compositeAlpha = compositeAlpha,
-        .presentMode = presentMode,
-        .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE
-    };
+// The scene rendered at a lower resolution into a graph owned image, which is then stretched over the target
+struct ScaledPassData {
+    VkFormat format;
+    VkExtent2D extent;
+    VkFilter filter;
+    // Filled in by recordFrameGraph
+    const RenderGraph *graph;
+    uint32_t source;
+    VkImage target;
+    VkExtent2D targetExtent;
+};
 
-    return vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, swapchain);
+void recordUpscale (VkCommandBuffer cmdBuffer, const ScaledPassData& scaled) {
+    VkImageBlit region = {
+        .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .srcOffsets = { { 0, 0, 0 }, { static_cast<int32_t>(scaled.extent.width), static_cast<int32_t>(scaled.extent.height), 1 } },
+        .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .dstOffsets = { { 0, 0, 0 }, { static_cast<int32_t>(scaled.targetExtent.width), static_cast<int32_t>(scaled.targetExtent.height), 1 } }
+    };
+    vkCmdBlitImage(cmdBuffer, graphImage(*scaled.graph, scaled.source), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, scaled.target,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, scaled.filter);
 }
 
-VkResult createSemaphore (VkDevice device, VkSemaphore *semaphore) {
-    VkSemaphoreCreateInfo semaphoreCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0
-    };
-    return vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, semaphore);
+// The scene pass renders into the target, or into a transient that is upscaled into the target when scaled is given. The
+// target is then read back, presented, or left as it is. GPU driven instances are culled by compute passes before the
+// scene pass. Transitions and barriers between them come from the graph.
+void recordFrameGraph (RenderGraph *graph, VkCommandBuffer cmdBuffer, ScenePassData *scene, VkImage image, bool present, ScaledPassData *scaled,
+        ReadbackPassData *readback, uint64_t frameNumber) {
+    beginRenderGraph(graph);
+    uint32_t target = importImage(graph, image, VK_IMAGE_ASPECT_COLOR_BIT, present ? GRAPH_USAGE_ACQUIRED : GRAPH_USAGE_NONE,
+            present ? GRAPH_USAGE_PRESENT : GRAPH_USAGE_NONE, true);
+    uint32_t color = target;
+    if (scaled != nullptr) {
+        VkImageCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = scaled->format,
+            .extent = { scaled->extent.width, scaled->extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+        color = createTransientImage(graph, createInfo, scene->renderPass);
+        scaled->graph = graph;
+        scaled->source = color;
+        scaled->target = image;
+        scaled->targetExtent = scene->extent;
+    }
+    // The frame slot's visible list and commands were last read by the slot's previous frame, which has completed
+    uint32_t instances = GRAPH_NONE, visible = GRAPH_NONE, draws = GRAPH_NONE;
+    if (scene->gpuScene != nullptr) {
+        const GpuScene& gpuScene = *scene->gpuScene->scene;
+        instances = importBuffer(graph, scene->gpuScene->instanceBuffer, GRAPH_USAGE_NONE, false);
+        visible = importBuffer(graph, gpuScene.visibleBuffers[scene->slot], GRAPH_USAGE_NONE, false);
+        draws = importBuffer(graph, gpuScene.drawBuffers[scene->slot], GRAPH_USAGE_NONE, false);
+        uint32_t resetPass = addGraphPass(graph, "cull reset", [] (VkCommandBuffer cmdBuffer, void *data) {
+            recordGpuSceneReset(cmdBuffer, *static_cast<GpuSceneFrame*>(data));
+        }, scene->gpuScene);
+        useGraphResource(graph, resetPass, draws, GRAPH_USAGE_TRANSFER_DST);
+        uint32_t cullPass = addGraphPass(graph, "cull", [] (VkCommandBuffer cmdBuffer, void *data) {
+            recordGpuSceneCull(cmdBuffer, *static_cast<GpuSceneFrame*>(data));
+        }, scene->gpuScene);
+        useGraphResource(graph, cullPass, instances, GRAPH_USAGE_STORAGE_READ);
+        useGraphResource(graph, cullPass, draws, GRAPH_USAGE_STORAGE_WRITE);
+        useGraphResource(graph, cullPass, visible, GRAPH_USAGE_STORAGE_WRITE);
+    }
+    uint32_t scenePass = addGraphPass(graph, "scene", [] (VkCommandBuffer cmdBuffer, void *data) {
+        ScenePassData *scene = static_cast<ScenePassData*>(data);
+        recordFrame(cmdBuffer, scene->renderPass, scene->framebuffer, scene->extent, scene->pipeline, *scene->table, scene->time, scene->draws,
+                scene->gpuScene, scene->jobs, scene->recorder, scene->slot, *scene->secondaries);
+    }, scene);
+    useGraphResource(graph, scenePass, color, GRAPH_USAGE_COLOR_ATTACHMENT);
+    if (scene->gpuScene != nullptr) {
+        useGraphResource(graph, scenePass, instances, GRAPH_USAGE_VERTEX_STORAGE_READ);
+        useGraphResource(graph, scenePass, visible, GRAPH_USAGE_VERTEX_STORAGE_READ);
+        useGraphResource(graph, scenePass, draws, GRAPH_USAGE_INDIRECT_BUFFER);
+    }
+    if (scaled != nullptr) {
+        uint32_t upscalePass = addGraphPass(graph, "upscale", [] (VkCommandBuffer cmdBuffer, void *data) {
+            recordUpscale(cmdBuffer, *static_cast<ScaledPassData*>(data));
+        }, scaled);
+        useGraphResource(graph, upscalePass, color, GRAPH_USAGE_TRANSFER_SRC);
+        useGraphResource(graph, upscalePass, target, GRAPH_USAGE_TRANSFER_DST);
+    }
+    if (readback != nullptr) {
+        uint32_t buffer = importBuffer(graph, readback->targets->targets[readback->index].readbackBuffer, GRAPH_USAGE_HOST_READ, true);
+        uint32_t readbackPass = addGraphPass(graph, "readback", [] (VkCommandBuffer cmdBuffer, void *data) {
+            ReadbackPassData *readback = static_cast<ReadbackPassData*>(data);
+            recordOffscreenReadback(cmdBuffer, *readback->targets, readback->index);
+        }, readback);
+        useGraphResource(graph, readbackPass, target, GRAPH_USAGE_TRANSFER_SRC);
+        useGraphResource(graph, readbackPass, buffer, GRAPH_USAGE_TRANSFER_DST);
+    }
+    ASSERT_RESULT(compileRenderGraph(graph, frameNumber), VK_SUCCESS, "Failed to compile render graph");
+    if (scaled != nullptr) {
+        // The transient and its framebuffer only exist once the graph is compiled
+        scene->framebuffer = graphFramebuffer(*graph, color);
+        scene->extent = scaled->extent;
+    }
+    executeRenderGraph(graph, cmdBuffer);
 }
 
-VkResult createFence (VkDevice device, VkFence *fence) {
-    VkFenceCreateInfo fenceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0
-    };
-    return vkCreateFence(device, &fenceCreateInfo, nullptr, fence);
+void logSwapchain (const Swapchain& swapchain) {
+    log(("Swapchain: " + std::to_string(swapchain.extent.width) + "x" + std::to_string(swapchain.extent.height) + ", " +
+                std::to_string(swapchain.images.size()) + " images, present mode " + presentModeName(swapchain.presentMode)).c_str());
 }
 
-VkResult createCommandPool (VkDevice device, uint32_t queueIndex, VkCommandPool *pool) {
-    VkCommandPoolCreateInfo cmdPoolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = queueIndex
-    };
-    return vkCreateCommandPool(device, &cmdPoolCreateInfo, nullptr, pool);
+// Everything the render thread cares about, timestamped when the event thread receives it
+static bool translateEvent (const SDL_Event& ev, InputEvent *event) {
+    *event = { INPUT_EVENT_QUIT, 0, 0, 0, eventTimestamp() };
+    switch (ev.type) {
+        case SDL_QUIT:
+            return true;
+        case SDL_WINDOWEVENT:
+            event->type = INPUT_EVENT_RESIZED;
+            event->code = ev.window.data1;
+            event->x = ev.window.data2;
+            return ev.window.event == SDL_WINDOWEVENT_SIZE_CHANGED;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            // Auto repeat is not input the simulation reacts to
+            event->type = ev.type == SDL_KEYDOWN ? INPUT_EVENT_KEY_DOWN : INPUT_EVENT_KEY_UP;
+            event->code = ev.key.keysym.sym;
+            return ev.key.repeat == 0;
+        case SDL_MOUSEMOTION:
+            event->type = INPUT_EVENT_MOUSE_MOTION;
+            event->x = ev.motion.x;
+            event->y = ev.motion.y;
+            return true;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            event->type = ev.type == SDL_MOUSEBUTTONDOWN ? INPUT_EVENT_MOUSE_BUTTON_DOWN : INPUT_EVENT_MOUSE_BUTTON_UP;
+            event->code = ev.button.button;
+            event->x = ev.button.x;
+            event->y = ev.button.y;
+            return true;
+        default:
+            return false;
+    }
 }
 
-VkResult allocateCommandBuffer (VkDevice device, VkCommandPool pool, VkCommandBuffer *buffer) {
-    VkCommandBufferAllocateInfo cmdAllocInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .commandPool = pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1
-    };
-    return vkAllocateCommandBuffers(device, &cmdAllocInfo, buffer);
+struct Options {
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    bool headless = false;
+    VkExtent2D extent = { 1366, 768 };
+    uint64_t frameCount = 0;
+    bool readback = false;
+    std::string dumpDir;
+    std::string traceFile;
+    std::string csvFile;
+    std::string benchFile;
+    SwapchainConfig swapchainConfig;
+    std::string pipelineCachePath = DEFAULT_PIPELINE_CACHE_PATH;
+    // Worker threads on top of the main thread
+    uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    uint32_t draws = 1;
+    bool bindless = true;
+    // Serve the driver's host allocations from arenas and pools instead of the default allocator
+    bool hostAllocator = true;
+    // Record the scene once per render target and resubmit it, instead of recording every frame
+    bool staticScene = false;
+    QueuePriorities queuePriorities;
+    bool asyncCompute = true;
+    // Particles simulated by compute work every frame, 0 disables it
+    uint32_t particles = 0;
+    uint32_t particleGroupSize = PARTICLE_GROUP_SIZE;
+    // Fraction of the target size the scene is rendered at before it is upscaled, 1 renders straight into the target
+    float renderScale = 1.0f;
+    // Instances drawn through GPU culling and indirect draws, 0 disables them
+    uint32_t instances = 0;
+    // Move the instances every frame, which uploads all of them again
+    bool moveInstances = false;
+    // Mesh files loaded in the background while rendering
+    std::vector<std::string> meshes;
+    // KTX2 textures streamed in as their on-screen size asks for more detail
+    std::vector<std::string> textures;
+    VkDeviceSize textureBudget = TEXTURE_DEFAULT_BUDGET;
+    bool watchShaders = false;
+#ifdef NDEBUG
+    bool validation = false;
+#else
+    bool validation = true;
+#endif
+    LogSeverity logLevel = LOG_SEVERITY_INFO;
+};
+
+void parseOptions (int argc, char *argv[], Options& options) {
+    bool frameCountGiven = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            options.framesInFlight = CLAMP(static_cast<uint32_t>(atoi(argv[++i])), 1u, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT));
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%ux%u", &options.extent.width, &options.extent.height) != 2 || options.extent.width == 0 || options.extent.height == 0) {
+                panic("Expected --size WIDTHxHEIGHT");
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frameCount = strtoull(argv[++i], nullptr, 10);
+            frameCountGiven = true;
+        } else if (strcmp(argv[i], "--readback") == 0) {
+            options.readback = true;
+        } else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc) {
+            options.dumpDir = argv[++i];
+            options.readback = true;
+        } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            if (!parseLatencyProfile(argv[++i], &options.swapchainConfig.profile)) {
+                panic("Expected --latency vsync|adaptive|low|throughput");
+            }
+        } else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+            if (!parsePresentMode(argv[++i], &options.swapchainConfig.presentMode)) {
+                panic("Expected --present-mode fifo|fifo-relaxed|mailbox|immediate");
+            }
+            options.swapchainConfig.forcePresentMode = true;
+        } else if (strcmp(argv[i], "--swapchain-images") == 0 && i + 1 < argc) {
+            options.swapchainConfig.imageCount = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc) {
+            options.pipelineCachePath = argv[++i];
+        } else if (strcmp(argv[i], "--no-pipeline-cache") == 0) {
+            options.pipelineCachePath.clear();
+        } else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            options.renderScale = CLAMP(static_cast<float>(atof(argv[++i])), MIN_RENDER_SCALE, 1.0f);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            options.draws = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--async-compute") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "on") != 0 && strcmp(argv[i], "off") != 0) {
+                panic("Expected --async-compute on|off");
+            }
+            options.asyncCompute = strcmp(argv[i], "on") == 0;
+        } else if (strcmp(argv[i], "--compute-priority") == 0 && i + 1 < argc) {
+            options.queuePriorities.compute = CLAMP(static_cast<float>(atof(argv[++i])), 0.0f, 1.0f);
+        } else if (strcmp(argv[i], "--transfer-priority") == 0 && i + 1 < argc) {
+            options.queuePriorities.transfer = CLAMP(static_cast<float>(atof(argv[++i])), 0.0f, 1.0f);
+        } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            options.particles = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--particle-group-size") == 0 && i + 1 < argc) {
+            options.particleGroupSize = static_cast<uint32_t>(atoi(argv[++i]));
+            // Every device supports at least 128 invocations per workgroup
+            if (options.particleGroupSize == 0 || options.particleGroupSize > 128 || (options.particleGroupSize & (options.particleGroupSize - 1)) != 0) {
+                panic("Expected --particle-group-size to be a power of two up to 128");
+            }
+        } else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            options.meshes.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            options.textures.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            options.textureBudget = static_cast<VkDeviceSize>(atoll(argv[++i])) << 20;
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            options.instances = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--move-instances") == 0) {
+            options.moveInstances = true;
+        } else if (strcmp(argv[i], "--watch-shaders") == 0) {
+            options.watchShaders = true;
+        } else if (strcmp(argv[i], "--validation") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "on") != 0 && strcmp(argv[i], "off") != 0) {
+                panic("Expected --validation on|off");
+            }
+            options.validation = strcmp(argv[i], "on") == 0;
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            if (!parseLogSeverity(argv[++i], &options.logLevel)) {
+                panic("Expected --log-level debug|info|warning|error");
+            }
+        } else if (strcmp(argv[i], "--static-scene") == 0) {
+            options.staticScene = true;
+        } else if (strcmp(argv[i], "--no-bindless") == 0) {
+            options.bindless = false;
+        } else if (strcmp(argv[i], "--no-host-allocator") == 0) {
+            options.hostAllocator = false;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options.traceFile = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            options.csvFile = argv[++i];
+        } else if (strcmp(argv[i], "--bench-json") == 0 && i + 1 < argc) {
+            options.benchFile = argv[++i];
+        } else {
+            panic(("Unknown or incomplete option \"" + std::string(argv[i]) + "\"").c_str());
+        }
+    }
+    // There is no window to close, so headless runs must end on their own
+    if (options.headless && !frameCountGiven) {
+        options.frameCount = DEFAULT_HEADLESS_FRAMES;
+    }
+    if (options.readback && !options.headless) {
+        panic("--readback and --dump-frames are only supported together with --headless");
+    }
+    // The culling pass allocates its descriptor sets from the frame's pools, which pre-recorded buffers would outlive
+    if (options.instances > 0 && options.staticScene) {
+        panic("--instances is not supported together with --static-scene");
+    }
+    if (options.moveInstances && static_cast<uint64_t>(options.instances) * sizeof(GpuInstance) > GPU_SCENE_UPLOAD_CHUNK) {
+        panic(("--move-instances supports up to " + std::to_string(GPU_SCENE_UPLOAD_CHUNK / sizeof(GpuInstance)) + " instances").c_str());
+    }
+#ifndef ENABLE_VALIDATION
+    if (options.validation) {
+        panic("Validation is compiled out of release builds, use BUILD=debug or BUILD=profile");
+    }
+#endif
 }
 
 int main (int argc, char *argv[]) {
+    Options options;
     SDL_Window *window = nullptr;
     VkInstance vulkanInstance;
-    VkDebugUtilsMessengerEXT debugMessenger;
+#ifdef ENABLE_VALIDATION
+    VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
+#endif
+    bool properties2Enabled;
+    InstanceSupport instanceSupport;
+    DeviceCandidate deviceCandidate;
     VkPhysicalDevice physicalDevice;
-    VkSurfaceKHR vulkanSurface;
-    uint32_t graphicsQueueIndex = 0, presentQueueIndex = 0;
+    VkSurfaceKHR vulkanSurface = VK_NULL_HANDLE;
+    uint32_t graphicsQueueIndex = 0, presentQueueIndex = 0, transferQueueIndex = 0, computeQueueIndex = 0, computeQueueInFamily = 0;
     VkDevice vulkanDevice;
-    VkQueue graphicsQueue, presentQueue;
-    VkSwapchainKHR swapchain;
-    std::vector<VkImage> swapchainImages;
-    VkSemaphore semaphore;
+    VkQueue graphicsQueue, presentQueue, transferQueue, computeQueue;
+    Swapchain swapchain = {};
+    std::vector<RetiredSwapchain> retiredSwapchains;
+    bool swapchainDirty = false;
     uint32_t swapchainImageIndex;
-    VkCommandBuffer presentCmdBuffer, graphicsCmdBuffer;
-    VkCommandPool presentCmdPool, graphicsCmdPool;
-    VkFence fence;
+    MemoryAllocator memoryAllocator;
+    Uploader uploader;
+    MeshLoader meshLoader;
+    std::vector<Mesh> meshes;
+    JobSystem jobSystem;
+    CommandRecorder commandRecorder;
+    AsyncCompute asyncCompute;
+    ParticleSystem particles;
+    GpuScene gpuScene;
+    GpuSceneFrame gpuSceneData;
+    FrameDescriptors frameDescriptors;
+    DescriptorLayoutCache descriptorLayouts;
+    BindlessTable bindlessTable;
+    TextureStreamer textureStreamer;
+    std::vector<uint32_t> textures;
+    DescriptorIndexingSupport descriptorIndexing = {};
+    std::vector<VkCommandBuffer> secondaries;
+    StaticCommands staticCommands;
+    RenderGraph renderGraph;
+    OffscreenTargets offscreenTargets;
+    FrameRing frameRing;
+    Profiler profiler;
+    PipelineLibrary pipelineLibrary;
+    ShaderWatcher shaderWatcher;
+    ComputePipelineDesc particlesDesc;
+    VkRenderPass renderPass;
+    VkPipeline trianglePipeline;
+    StartupTimer startupTimer;
+    EventQueue eventQueue;
+    Simulation simulation;
 
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
-        panic("Failed to initialize SDL2");
+    parseOptions(argc, argv, options);
+    startupBegin(&startupTimer);
+    createEventQueue(&eventQueue);
+    startLogger(options.logLevel);
+    if (options.hostAllocator) {
+        startHostAllocator(options.framesInFlight);
+    }
+    if (options.validation) {
+        requiredLayers.push_back(VALIDATION_LAYER);
+        requiredInstanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
-    window = SDL_CreateWindow("Vulkan", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1366, 768, SDL_WINDOW_VULKAN);
-    if (window == nullptr) {
-        panic("Failed to create SDL2 window");
+
+    // Nothing in the job system depends on Vulkan, so it is up first and startup work can fan out onto it
+    createJobSystem(options.threads, &jobSystem);
+    JobCounter startupJobs;
+    startupJobs.pending.store(0, std::memory_order_relaxed);
+    auto instanceSupportJob = makeFunctionJob([&instanceSupport] (uint32_t thread) {
+        enumerateInstanceSupport(&instanceSupport);
+    }, &startupJobs);
+    submitFunctionJob(&jobSystem, &instanceSupportJob);
+    if (!options.headless) {
+        // Audio, joystick and haptics are never used, initializing them only costs time
+        if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
+            panic("Failed to initialize SDL2");
+        }
+        window = SDL_CreateWindow("Vulkan", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, options.extent.width, options.extent.height,
+                SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+        if (window == nullptr) {
+            panic("Failed to create SDL2 window");
+        }
+    } else {
+        requiredDeviceExtensions.clear();
     }
-    ASSERT_RESULT(createVulkanInstance(window, &vulkanInstance), VK_SUCCESS, "Failed to create vulkan instance");
-    if (SDL_Vulkan_CreateSurface(window, vulkanInstance, &vulkanSurface) != SDL_TRUE) {
+    startupMark(&startupTimer, "window");
+    waitForCounter(&jobSystem, &startupJobs);
+    ASSERT_RESULT(createVulkanInstance(window, instanceSupport, &vulkanInstance, properties2Enabled), VK_SUCCESS, "Failed to create vulkan instance");
+    if (window != nullptr && SDL_Vulkan_CreateSurface(window, vulkanInstance, &vulkanSurface) != SDL_TRUE) {
         panic("Failed to create Vulkan surface");
     }
-    ASSERT_RESULT(createDebugMessenger(vulkanInstance, debugCallback, &debugMessenger), VK_SUCCESS, "Falied to create debug messenger");
-    pickPhysicalDevice(vulkanInstance, vulkanSurface, &physicalDevice, graphicsQueueIndex, presentQueueIndex);
-    ASSERT_RESULT(createLogicalDevice(physicalDevice, &vulkanDevice, graphicsQueueIndex, presentQueueIndex), VK_SUCCESS, "Failed to create Logical device");
-    retrieveQueues(vulkanDevice, graphicsQueueIndex, presentQueueIndex, &graphicsQueue, &presentQueue);
-    ASSERT_RESULT(createSwapchain(physicalDevice, vulkanDevice, vulkanSurface, window, graphicsQueueIndex, presentQueueIndex, &swapchain), VK_SUCCESS,
-            "Failed to create swapchain");
-
-    ENUMERATE_OBJECTS(swapchainImages, vkGetSwapchainImagesKHR(vulkanDevice, swapchain, &size, nullptr), vkGetSwapchainImagesKHR(vulkanDevice,swapchain, &size, swapchainImages.data()), "Failed to get swap chain images");
+#ifdef ENABLE_VALIDATION
+    if (options.validation) {
+        ASSERT_RESULT(createDebugMessenger(vulkanInstance, debugCallback, &debugMessenger), VK_SUCCESS, "Falied to create debug messenger");
+    }
+#endif
+    startupMark(&startupTimer, "instance");
+    pickPhysicalDevice(&jobSystem, vulkanInstance, vulkanSurface, &deviceCandidate);
+    physicalDevice = deviceCandidate.device;
+    graphicsQueueIndex = deviceCandidate.graphicsFamily;
+    presentQueueIndex = deviceCandidate.presentFamily;
+    transferQueueIndex = deviceCandidate.transferFamily;
+    computeQueueIndex = deviceCandidate.computeFamily;
+    computeQueueInFamily = deviceCandidate.computeQueueInFamily;
+    if (options.bindless) {
+        descriptorIndexing = queryDescriptorIndexing(vulkanInstance, physicalDevice, properties2Enabled, deviceCandidate.extensions,
+                requiredDeviceExtensions);
+    }
+    startupMark(&startupTimer, "device selection");
+    // The table is indexed with push constants, which only needs dynamically uniform indexing
+    VkPhysicalDeviceFeatures availableFeatures, enabledFeatures = {};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &availableFeatures);
+    enabledFeatures.shaderSampledImageArrayDynamicIndexing = availableFeatures.shaderSampledImageArrayDynamicIndexing;
+    enabledFeatures.shaderStorageBufferArrayDynamicIndexing = availableFeatures.shaderStorageBufferArrayDynamicIndexing;
+    ASSERT_RESULT(createLogicalDevice(physicalDevice, &vulkanDevice, graphicsQueueIndex, presentQueueIndex, transferQueueIndex, computeQueueIndex,
+                computeQueueInFamily, options.queuePriorities, enabledFeatures, descriptorIndexing.supported ? &descriptorIndexing.features : nullptr),
+            VK_SUCCESS, "Failed to create Logical device");
+    retrieveQueues(vulkanDevice, graphicsQueueIndex, presentQueueIndex, transferQueueIndex, computeQueueIndex, computeQueueInFamily, &graphicsQueue,
+            &presentQueue, &transferQueue, &computeQueue);
+    startupMark(&startupTimer, "device creation");
 
+    // Reading and validating the cache file overlaps with creating everything else
+    VkResult pipelineLibraryResult;
+    auto pipelineLibraryJob = makeFunctionJob([&] (uint32_t thread) {
+        pipelineLibraryResult = createPipelineLibrary(physicalDevice, vulkanDevice, options.pipelineCachePath, &pipelineLibrary);
+    }, &startupJobs);
+    submitFunctionJob(&jobSystem, &pipelineLibraryJob);
 
-    ASSERT_RESULT(createSemaphore(vulkanDevice, &semaphore), VK_SUCCESS, "Failed to create Vulkan semaphore");
-    ASSERT_RESULT(createFence(vulkanDevice, &fence), VK_SUCCESS, "Failed to create Vulkan fence");
+    ASSERT_RESULT(createFrameRing(vulkanDevice, graphicsQueueIndex, options.framesInFlight, &frameRing), VK_SUCCESS, "Failed to create frame ring");
+    ASSERT_RESULT(createAsyncCompute(vulkanDevice, computeQueue, computeQueueIndex, graphicsQueue, graphicsQueueIndex, options.asyncCompute,
+                static_cast<uint32_t>(frameRing.slots.size()), &asyncCompute), VK_SUCCESS, "Failed to create async compute");
+    if (asyncCompute.async) {
+        log(("Async compute uses queue " + std::to_string(computeQueueInFamily) + " of queue family " + std::to_string(computeQueueIndex)).c_str());
+    } else {
+        log(options.asyncCompute ? "No queue besides the graphics queue, compute work is recorded inline" :
+                "Async compute disabled, compute work is recorded inline");
+    }
+    ASSERT_RESULT(createCommandRecorder(vulkanDevice, graphicsQueueIndex, jobThreadCount(jobSystem), static_cast<uint32_t>(frameRing.slots.size()),
+                &commandRecorder), VK_SUCCESS, "Failed to create command recorder");
+    ASSERT_RESULT(createProfiler(physicalDevice, vulkanDevice, graphicsQueueIndex, static_cast<uint32_t>(frameRing.slots.size()), &profiler), VK_SUCCESS,
+            "Failed to create profiler");
+    ASSERT_RESULT(createMemoryAllocator(physicalDevice, vulkanDevice, static_cast<uint32_t>(frameRing.slots.size()), &memoryAllocator), VK_SUCCESS,
+            "Failed to create memory allocator");
+    ASSERT_RESULT(createUploader(&memoryAllocator, physicalDevice, transferQueue, transferQueueIndex, graphicsQueueIndex, DEFAULT_STAGING_SIZE, &uploader),
+            VK_SUCCESS, "Failed to create uploader");
+    if (transferQueueIndex != graphicsQueueIndex) {
+        log(("Uploads use transfer queue family " + std::to_string(transferQueueIndex)).c_str());
+    } else {
+        log("No separate transfer queue family, uploads share the graphics queue");
+    }
+    createMeshLoader(&memoryAllocator, &uploader, &meshLoader);
+    // Sized once, the loader thread writes through pointers into it
+    meshes.resize(options.meshes.size());
+    for (uint32_t i = 0; i < options.meshes.size(); i++) {
+        loadMesh(&meshLoader, options.meshes[i], &meshes[i]);
+    }
+    ASSERT_RESULT(createFrameDescriptors(vulkanDevice, jobThreadCount(jobSystem), static_cast<uint32_t>(frameRing.slots.size()), &frameDescriptors),
+            VK_SUCCESS, "Failed to create descriptor pools");
+    ASSERT_RESULT(createBindlessTable(&memoryAllocator, &uploader, physicalDevice, descriptorIndexing, static_cast<uint32_t>(frameRing.slots.size()),
+                &bindlessTable), VK_SUCCESS, "Failed to create bindless resource table");
+    log(((bindlessTable.bindless ? "Bindless resource table with " : "Descriptor indexing unavailable or disabled, fallback resource table with ") +
+                std::to_string(bindlessTable.textureCapacity) + " textures and " + std::to_string(bindlessTable.bufferCapacity) + " buffers").c_str());
+    createTextureStreamer(&memoryAllocator, &uploader, &bindlessTable, physicalDevice, options.textureBudget, &textureStreamer);
+    for (const std::string& path : options.textures) {
+        uint32_t texture;
+        if (loadTexture(&textureStreamer, path, &texture) == VK_SUCCESS) {
+            textures.push_back(texture);
+        }
+    }
 
-    ASSERT_RESULT(createCommandPool(vulkanDevice, presentQueueIndex, &presentCmdPool), VK_SUCCESS, "Failed to create present command pool");
-    ASSERT_RESULT(createCommandPool(vulkanDevice, graphicsQueueIndex, &graphicsCmdPool), VK_SUCCESS, "Failed to create graphics command pool");
+    if (options.headless) {
+        ASSERT_RESULT(createOffscreenTargets(&memoryAllocator, options.extent, static_cast<uint32_t>(frameRing.slots.size()), options.readback,
+                    &offscreenTargets), VK_SUCCESS, "Failed to create offscreen render targets");
+    } else {
+        ASSERT_RESULT(createSwapchain(physicalDevice, vulkanDevice, vulkanSurface, window, graphicsQueueIndex, presentQueueIndex, options.swapchainConfig,
+                    VK_NULL_HANDLE, &swapchain), VK_SUCCESS, "Failed to create swapchain");
+        logSwapchain(swapchain);
+    }
+    VkFormat targetFormat = options.headless ? offscreenTargets.format : swapchain.format;
+    ASSERT_RESULT(createRenderPass(vulkanDevice, targetFormat, &renderPass), VK_SUCCESS, "Failed to create render pass");
+    // Upscaling blits from and into the target format, linear filtering is only preferred
+    VkFilter upscaleFilter = VK_FILTER_LINEAR;
+    if (options.renderScale < 1.0f) {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, targetFormat, &formatProperties);
+        VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+        if ((formatProperties.optimalTilingFeatures & blit) != blit) {
+            logMessage(LOG_SEVERITY_WARNING, "The target format can not be blitted, rendering at full resolution");
+            options.renderScale = 1.0f;
+        } else if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) == 0) {
+            upscaleFilter = VK_FILTER_NEAREST;
+        }
+    }
+    createRenderGraph(&memoryAllocator, &renderGraph);
+    startupMark(&startupTimer, "frame resources");
+    waitForCounter(&jobSystem, &startupJobs);
+    ASSERT_RESULT(pipelineLibraryResult, VK_SUCCESS, "Failed to create pipeline cache");
+    log(("Pipeline cache is " + std::string(pipelineLibrary.warm ? "warm" : "cold") + " (" + std::to_string(pipelineLibrary.loadedBytes) +
+                " bytes loaded)").c_str());
+    startupMark(&startupTimer, "pipeline cache load");
 
-    ASSERT_RESULT(allocateCommandBuffer(vulkanDevice, graphicsCmdPool, &graphicsCmdBuffer), VK_SUCCESS, "Failed to allocate graphics command buffer");
-    ASSERT_RESULT(allocateCommandBuffer(vulkanDevice, presentCmdPool, &presentCmdBuffer), VK_SUCCESS, "Failed to allocate present command buffer");
+    // Every pipeline compiles on its own worker while this thread creates the framebuffers
+    GraphicsPipelineDesc triangleDesc;
+    triangleDesc.vertexShader = "shaders/triangle.vert.spv";
+    triangleDesc.fragmentShader = "shaders/triangle.frag.spv";
+    triangleDesc.layout = bindlessTable.pipelineLayout;
+    triangleDesc.renderPass = renderPass;
+    VkResult triangleResult, particlesResult = VK_SUCCESS, gpuSceneResult = VK_SUCCESS;
+    auto triangleJob = makeFunctionJob([&] (uint32_t thread) {
+        triangleResult = getGraphicsPipeline(vulkanDevice, &pipelineLibrary, triangleDesc, &trianglePipeline);
+    }, &startupJobs);
+    auto particlesJob = makeFunctionJob([&] (uint32_t thread) {
+        particlesResult = createParticleSystem(&memoryAllocator, &pipelineLibrary, &descriptorLayouts, options.particles, options.particleGroupSize,
+                static_cast<uint32_t>(frameRing.slots.size()), computeSharingFamilies(asyncCompute), &particles, &particlesDesc);
+    }, &startupJobs);
+    auto gpuSceneJob = makeFunctionJob([&] (uint32_t thread) {
+        gpuSceneResult = createGpuScene(&memoryAllocator, &pipelineLibrary, &descriptorLayouts, renderPass, options.instances,
+                options.moveInstances, static_cast<uint32_t>(frameRing.slots.size()), &gpuScene);
+    }, &startupJobs);
+    submitFunctionJob(&jobSystem, &triangleJob);
+    if (options.particles > 0) {
+        submitFunctionJob(&jobSystem, &particlesJob);
+    }
+    if (options.instances > 0) {
+        submitFunctionJob(&jobSystem, &gpuSceneJob);
+    }
+    if (options.headless) {
+        ASSERT_RESULT(createOffscreenFramebuffers(vulkanDevice, renderPass, &offscreenTargets), VK_SUCCESS, "Failed to create offscreen framebuffers");
+    } else {
+        ASSERT_RESULT(createSwapchainFramebuffers(vulkanDevice, renderPass, &swapchain), VK_SUCCESS, "Failed to create swapchain framebuffers");
+    }
+    waitForCounter(&jobSystem, &startupJobs);
+    ASSERT_RESULT(triangleResult, VK_SUCCESS, "Failed to create triangle pipeline");
+    ASSERT_RESULT(particlesResult, VK_SUCCESS, "Failed to create particle system");
+    ASSERT_RESULT(gpuSceneResult, VK_SUCCESS, "Failed to create GPU driven scene");
+    if (options.staticScene) {
+        // The fallback table binds a different set in every slot, so its command buffers differ per slot as well
+        ASSERT_RESULT(createStaticCommands(vulkanDevice, graphicsQueueIndex,
+                    options.headless ? static_cast<uint32_t>(frameRing.slots.size()) : static_cast<uint32_t>(swapchain.images.size()),
+                    bindlessTable.bindless ? 1u : static_cast<uint32_t>(frameRing.slots.size()), &staticCommands), VK_SUCCESS,
+                "Failed to create static command buffers");
+    }
+    createShaderWatcher(vulkanDevice, &pipelineLibrary, &shaderWatcher);
+    if (options.watchShaders) {
+        watchGraphicsPipeline(&shaderWatcher, triangleDesc, &trianglePipeline);
+        if (options.particles > 0) {
+            watchComputePipeline(&shaderWatcher, particlesDesc, &particles.pipeline);
+        }
+        startShaderWatcher(&shaderWatcher);
+    }
+    startupMark(&startupTimer, "pipelines");
 
     VkResult presentResult = VK_SUCCESS;
     VkPresentInfoKHR presentInfo = {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .pNext = nullptr,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = NULL,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = nullptr,
         .swapchainCount = 1,
-        .pSwapchains = &swapchain,
+        .pSwapchains = &swapchain.handle,
         .pImageIndices = &swapchainImageIndex,
         .pResults = &presentResult
     };
 
-    VkCommandBufferBeginInfo presentBeginInfo = {
+    VkCommandBufferBeginInfo frameBeginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext = nullptr,
         .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
         .pInheritanceInfo = nullptr
     };
 
-    VkImageMemoryBarrier imageBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .pNext = nullptr,
-        .srcAccessMask = 0,
-        .dstAccessMask = 0,
-        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .newLayout = (graphicsQueueIndex == presentQueueIndex ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_SHARED_PRESENT_KHR),
-        .srcQueueFamilyIndex = presentQueueIndex,
-        .dstQueueFamilyIndex = presentQueueIndex,
-        .image = swapchainImages[0],
-        .subresourceRange = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        }
-    };
-
-    VkPipelineStageFlags top = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
     VkSubmitInfo submitInfo = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .pNext = nullptr,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &semaphore,
-        .pWaitDstStageMask = &top,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = nullptr,
+        .pWaitDstStageMask = nullptr,
         .commandBufferCount = 1,
-        .pCommandBuffers = &presentCmdBuffer,
-        .signalSemaphoreCount = 0,
+        .pCommandBuffers = nullptr,
+        .signalSemaphoreCount = (options.headless ? 0u : 1u),
         .pSignalSemaphores = nullptr
     };
-    bool running = true;
-    while (running) {
-        SDL_Event ev;
-        while (SDL_PollEvent(&ev) != 0) {
-            switch (ev.type) {
-                case SDL_QUIT:
-                    running = 0;
-                    break;
-                default:
+    auto loopStart = std::chrono::steady_clock::now();
+    createSimulation(&simulation, options.headless ? 0 : eventTimestamp());
+    double particleTime = 0.0;
+    HostAllocatorStats hostWarmedUp = {};
+    uint64_t hostWarmedUpFrame = 0;
+    auto renderLoop = [&] () {
+        bool running = true;
+        while (running) {
+            profilerBeginFrame(&profiler, frameRing.frameNumber);
+            hostAllocatorBeginFrame(frameRing.frameNumber);
+            if (frameRing.frameNumber == HOST_ALLOCATOR_WARMUP_FRAMES) {
+                hostWarmedUp = hostAllocatorStats();
+                hostWarmedUpFrame = frameRing.frameNumber;
+            }
+            profilerBeginScope(&profiler, CPU_SCOPE_EVENTS);
+            InputEvent event;
+            while (popEvent(&eventQueue, &event)) {
+                switch (event.type) {
+                    case INPUT_EVENT_QUIT:
+                        running = false;
+                        break;
+                    case INPUT_EVENT_RESIZED:
+                        swapchainDirty = true;
+                        break;
+                    default:
+                        queueSimulationInput(&simulation, event);
+                        break;
+                }
+            }
+            profilerEndScope(&profiler, CPU_SCOPE_EVENTS);
+            if (options.frameCount != 0 && frameRing.frameNumber >= options.frameCount) {
+                break;
+            }
+
+            if (swapchainDirty) {
+                VkResult res = recreateSwapchain(physicalDevice, vulkanDevice, vulkanSurface, window, graphicsQueueIndex, presentQueueIndex,
+                        options.swapchainConfig, frameRing.frameNumber, &swapchain, retiredSwapchains);
+                if (res == VK_NOT_READY) {
+                    // Minimized, nothing can be presented until the window gets a size again
+                    std::this_thread::sleep_for(std::chrono::milliseconds(MINIMIZED_WAIT_MS));
+                    continue;
+                }
+                ASSERT_RESULT(res, VK_SUCCESS, "Failed to recreate swapchain");
+                ASSERT_RESULT(createSwapchainFramebuffers(vulkanDevice, renderPass, &swapchain), VK_SUCCESS, "Failed to create swapchain framebuffers");
+                logSwapchain(swapchain);
+                if (options.staticScene) {
+                    ASSERT_RESULT(resizeStaticCommands(&staticCommands, frameRing, static_cast<uint32_t>(swapchain.images.size())), VK_SUCCESS,
+                            "Failed to resize static command buffers");
+                }
+                swapchainDirty = false;
+            }
+
+            // Only blocks when we wrap around onto a slot the GPU hasn't finished with yet
+            profilerBeginScope(&profiler, CPU_SCOPE_FENCE_WAIT);
+            FrameSlot& slot = beginFrame(vulkanDevice, &frameRing);
+            profilerEndScope(&profiler, CPU_SCOPE_FENCE_WAIT);
+            if (!options.headless) {
+                profilerBeginScope(&profiler, CPU_SCOPE_ACQUIRE);
+                VkResult res = vkAcquireNextImageKHR(vulkanDevice, swapchain.handle, UINT64_MAX, slot.imageAvailable, VK_NULL_HANDLE, &swapchainImageIndex);
+                profilerEndScope(&profiler, CPU_SCOPE_ACQUIRE);
+                if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+                    // Nothing was acquired and the semaphore stays unsignaled. The swapchain is recreated at the top of the loop
+                    // and the frame retried, none of its bookkeeping has run yet.
+                    swapchainDirty = true;
+                    continue;
+                }
+                // A suboptimal swapchain can still be presented to, it gets replaced after this frame
+                if (res == VK_SUBOPTIMAL_KHR) {
+                    swapchainDirty = true;
+                } else {
+                    ASSERT_RESULT(res, VK_SUCCESS, "Failed to acquire swapchian image");
+                }
+            }
+            profilerCollect(&profiler, vulkanDevice, frameRing.current);
+            destroyRetiredSwapchains(vulkanDevice, retiredSwapchains, framesCompleted(frameRing));
+            releaseRenderGraphTransients(&renderGraph, framesCompleted(frameRing));
+            destroyRetiredPipelines(&shaderWatcher, framesCompleted(frameRing));
+            if (applyShaderReloads(&shaderWatcher, frameRing.frameNumber) && options.staticScene) {
+                invalidateStaticCommands(&staticCommands);
+            }
+            beginTransientFrame(&memoryAllocator, frameRing.current);
+            resetCommandRecorder(&commandRecorder, frameRing.current);
+            retireUploads(&uploader, framesCompleted(frameRing));
+            updateMeshLoads(&meshLoader);
+            resetFrameDescriptors(&frameDescriptors, frameRing.current);
+            // Nothing samples the textures yet, the triangle's height on screen stands in for their usage
+            VkExtent2D targetExtent = options.headless ? offscreenTargets.extent : swapchain.extent;
+            for (uint32_t texture : textures) {
+                useTexture(&textureStreamer, texture, targetExtent.height / 2.0f, frameRing.frameNumber);
+            }
+            updateTextureStreaming(&textureStreamer, frameRing.frameNumber, framesCompleted(frameRing));
+            profilerTextureMemory(&profiler, textureStreamer.residentBytes);
+            if (updateBindlessTable(&bindlessTable, frameRing.current, framesCompleted(frameRing)) && options.staticScene) {
+                invalidateStaticCommandsForSlot(&staticCommands, frameRing.current);
+            }
+
+            if (options.headless) {
+                // The slot's fence just signaled, so whatever it rendered last time is now readable
+                const uint8_t *pixels = mapOffscreenReadback(&memoryAllocator, offscreenTargets, frameRing.current);
+                if (pixels != nullptr && !options.dumpDir.empty()) {
+                    std::string path = options.dumpDir + "/frame" + std::to_string(offscreenTargets.targets[frameRing.current].pendingFrame) + ".ppm";
+                    if (!writeFramePPM(path, pixels, offscreenTargets.extent)) {
+                        panic(("Failed to write \"" + path + "\"").c_str());
+                    }
+                }
+            }
+
+            // Headless runs have no input and step exactly one tick per frame, so their output does not depend on timing
+            advanceSimulation(&simulation, options.headless ? static_cast<int64_t>(frameRing.frameNumber + 1) * simulation.tickLength : eventTimestamp());
+
+            waitSemaphores.clear();
+            waitStages.clear();
+            if (!options.headless) {
+                // The render pass only touches the acquired image at COLOR_ATTACHMENT_OUTPUT, earlier stages can run before it is available
+                waitSemaphores.push_back(slot.imageAvailable);
+                waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+            }
+            GpuSceneFrame *gpuSceneFrame = nullptr;
+            // Right before the flush, moving instances are only uploaded when it is sure to submit them
+            if (options.instances > 0 && streamGpuScene(&memoryAllocator, &uploader, frameRing.current, simulationTime(simulation), &gpuScene)) {
+                prepareGpuSceneFrame(gpuScene, &frameDescriptors, frameRing.current, simulationTime(simulation),
+                        options.headless ? offscreenTargets.extent : swapchain.extent, &gpuSceneData);
+                gpuSceneFrame = &gpuSceneData;
+            }
+            // Still queued uploads stay queued if every batch is in flight
+            VkResult uploadResult = flushUploads(&memoryAllocator, &uploader);
+            if (uploadResult != VK_NOT_READY) {
+                ASSERT_RESULT(uploadResult, VK_SUCCESS, "Failed to submit uploads");
+            }
+
+            profilerBeginScope(&profiler, CPU_SCOPE_RECORD);
+            ASSERT_RESULT(vkBeginCommandBuffer(slot.cmdBuffer, &frameBeginInfo), VK_SUCCESS, "Failed to begin recording command buffer");
+            profilerCmdBegin(&profiler, slot.cmdBuffer, frameRing.current);
+            recordUploadAcquires(&uploader, slot.cmdBuffer, frameRing.frameNumber, waitSemaphores, waitStages);
+            if (options.particles > 0) {
+                // Overlaps with the previous frame's graphics work when async, the compute submit has to precede the graphics one that waits on it
+                uint32_t previousSlot = (frameRing.current + static_cast<uint32_t>(frameRing.slots.size()) - 1) % static_cast<uint32_t>(frameRing.slots.size());
+                VkCommandBuffer computeCmdBuffer = beginComputeWork(&asyncCompute, frameRing.current, slot.cmdBuffer);
+                recordParticleUpdate(particles, &frameDescriptors, computeCmdBuffer, frameRing.current, previousSlot, frameRing.frameNumber,
+                        static_cast<float>(simulation.current.time - particleTime));
+                particleTime = simulation.current.time;
+                ASSERT_RESULT(submitComputeWork(&asyncCompute, frameRing.current, slot.cmdBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, waitSemaphores, waitStages),
+                        VK_SUCCESS, "Failed to submit compute work");
+            }
+            // The static path submits the frame's buffer, the target's pre-recorded one and a buffer that closes the frame
+            VkCommandBuffer frameCmdBuffers[3] = { slot.cmdBuffer, VK_NULL_HANDLE, slot.finishCmdBuffer };
+            uint32_t target = options.headless ? frameRing.current : swapchainImageIndex;
+            // A static scene does not animate the clear color either, and its buffers outlive the slot's secondaries
+            ScenePassData scene = {
+                renderPass,
+                options.headless ? offscreenTargets.targets[target].framebuffer : swapchain.framebuffers[target],
+                targetExtent,
+                trianglePipeline,
+                &bindlessTable,
+                options.staticScene ? 0.0 : simulationTime(simulation),
+                options.draws,
+                gpuSceneFrame,
+                options.staticScene ? nullptr : &jobSystem,
+                &commandRecorder,
+                frameRing.current,
+                &secondaries
+            };
+            ReadbackPassData readback = { &offscreenTargets, target };
+            VkImage targetImage = options.headless ? offscreenTargets.targets[target].image : swapchain.images[target];
+            ReadbackPassData *targetReadback = options.headless && offscreenTargets.readback ? &readback : nullptr;
+            // Surfaces that do not allow transfer writes get the scene at full resolution
+            ScaledPassData scaled = {
+                targetFormat,
+                { std::max(static_cast<uint32_t>(targetExtent.width * options.renderScale), 1u),
+                    std::max(static_cast<uint32_t>(targetExtent.height * options.renderScale), 1u) },
+                upscaleFilter
+            };
+            ScaledPassData *targetScaled = options.renderScale < 1.0f && (options.headless ||
+                    (swapchain.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0) ? &scaled : nullptr;
+            if (options.staticScene) {
+                ASSERT_RESULT(vkEndCommandBuffer(slot.cmdBuffer), VK_SUCCESS, "Failed to end recording command buffer");
+                bool recording;
+                frameCmdBuffers[1] = acquireStaticCommands(&staticCommands, frameRing, target, &recording);
+                if (recording) {
+                    recordFrameGraph(&renderGraph, frameCmdBuffers[1], &scene, targetImage, !options.headless, targetScaled, targetReadback,
+                            frameRing.frameNumber);
+                    ASSERT_RESULT(vkEndCommandBuffer(frameCmdBuffers[1]), VK_SUCCESS, "Failed to end static command buffer");
+                }
+                ASSERT_RESULT(vkBeginCommandBuffer(slot.finishCmdBuffer, &frameBeginInfo), VK_SUCCESS, "Failed to begin recording command buffer");
+                profilerCmdEnd(&profiler, slot.finishCmdBuffer, frameRing.current);
+                ASSERT_RESULT(vkEndCommandBuffer(slot.finishCmdBuffer), VK_SUCCESS, "Failed to end recording command buffer");
+            } else {
+                recordFrameGraph(&renderGraph, slot.cmdBuffer, &scene, targetImage, !options.headless, targetScaled, targetReadback,
+                        frameRing.frameNumber);
+                profilerCmdEnd(&profiler, slot.cmdBuffer, frameRing.current);
+                ASSERT_RESULT(vkEndCommandBuffer(slot.cmdBuffer), VK_SUCCESS, "Failed to end recording command buffer");
+            }
+            if (options.headless) {
+                offscreenTargets.targets[frameRing.current].pendingFrame = static_cast<int64_t>(frameRing.frameNumber);
+            }
+            profilerEndScope(&profiler, CPU_SCOPE_RECORD);
+
+            profilerBeginScope(&profiler, CPU_SCOPE_SUBMIT);
+            submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+            submitInfo.pWaitSemaphores = waitSemaphores.data();
+            submitInfo.pWaitDstStageMask = waitStages.data();
+            submitInfo.commandBufferCount = options.staticScene ? 3 : 1;
+            submitInfo.pCommandBuffers = frameCmdBuffers;
+            submitInfo.pSignalSemaphores = options.headless ? nullptr : &swapchain.renderFinished[swapchainImageIndex];
+            // Reset as late as possible so an early exit above never leaves the slot with an unsignaled fence
+            ASSERT_RESULT(vkResetFences(vulkanDevice, 1, &slot.inFlight), VK_SUCCESS, "Failed to reset frame slot fence");
+            ASSERT_RESULT(vkQueueSubmit(graphicsQueue, 1, &submitInfo, slot.inFlight), VK_SUCCESS, "Failed to submit frame command buffer");
+            if (options.staticScene) {
+                submittedStaticCommands(&staticCommands, frameRing, target);
+            }
+            int64_t submitted = eventTimestamp();
+            for (int64_t timestamp : simulation.applied) {
+                profilerInputLatency(&profiler, submitted - timestamp);
+            }
+            if (frameRing.frameNumber == 0) {
+                startupMark(&startupTimer, "first frame");
+                startupReport(startupTimer);
+            }
+            profilerEndScope(&profiler, CPU_SCOPE_SUBMIT);
+
+            if (!options.headless) {
+                profilerBeginScope(&profiler, CPU_SCOPE_PRESENT);
+                presentInfo.pWaitSemaphores = &swapchain.renderFinished[swapchainImageIndex];
+                VkResult res = vkQueuePresentKHR(presentQueue, &presentInfo);
+                if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR) {
+                    swapchainDirty = true;
+                } else {
+                    ASSERT_RESULT(res, VK_SUCCESS, "Failed to queue image presentation");
+                }
+                profilerEndScope(&profiler, CPU_SCOPE_PRESENT);
+            }
+
+            endFrame(&frameRing);
+            profilerEndFrame(&profiler);
+        }
+    };
+    if (options.headless) {
+        renderLoop();
+    } else {
+        // SDL only delivers events to the thread that created the window. It stays behind to pump them, so the window
+        // keeps responding while the render thread waits on the GPU. The render thread takes over as thread 0 of the
+        // job system, this thread never submits jobs.
+        std::atomic<bool> renderDone(false);
+        std::thread renderThread([&] () {
+            renderLoop();
+            renderDone.store(true, std::memory_order_release);
+        });
+        while (!renderDone.load(std::memory_order_acquire)) {
+            SDL_Event ev;
+            InputEvent event;
+            if (SDL_WaitEventTimeout(&ev, EVENT_WAIT_MS) == 0 || !translateEvent(ev, &event)) {
+                continue;
+            }
+            // Losing a quit or a resize would leave the render thread running or presenting to a stale swapchain
+            while (!pushEvent(&eventQueue, event)) {
+                if ((event.type != INPUT_EVENT_QUIT && event.type != INPUT_EVENT_RESIZED) || renderDone.load(std::memory_order_acquire)) {
+                    eventQueue.dropped++;
                     break;
+                }
+                std::this_thread::yield();
+            }
+        }
+        renderThread.join();
+    }
+
+    if (updateMeshLoads(&meshLoader) > 0) {
+        log((std::to_string(meshLoader.pending) + " meshes were still loading").c_str());
+    }
+    destroyMeshLoader(&meshLoader);
+    vkDeviceWaitIdle(vulkanDevice);
+    if (options.headless && !options.dumpDir.empty()) {
+        // The last frame of every slot was never picked up by the loop
+        for (uint32_t i = 0; i < offscreenTargets.targets.size(); i++) {
+            const uint8_t *pixels = mapOffscreenReadback(&memoryAllocator, offscreenTargets, i);
+            std::string path = options.dumpDir + "/frame" + std::to_string(offscreenTargets.targets[i].pendingFrame) + ".ppm";
+            if (pixels != nullptr && !writeFramePPM(path, pixels, offscreenTargets.extent)) {
+                panic(("Failed to write \"" + path + "\"").c_str());
             }
         }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+    log(("Rendered " + std::to_string(frameRing.frameNumber) + " frames in " + std::to_string(seconds) + " s (" +
+                std::to_string(seconds > 0.0 ? frameRing.frameNumber / seconds : 0.0) + " fps)").c_str());
+    // Pick up the timestamps of the frames that were still in flight when the loop ended
+    for (uint32_t i = 0; i < frameRing.slots.size(); i++) {
+        profilerCollect(&profiler, vulkanDevice, i);
+    }
+    profilerReport(profiler);
+    if (simulation.droppedTicks > 0 || eventQueue.dropped > 0) {
+        log(("Dropped " + std::to_string(simulation.droppedTicks) + " simulation ticks and " + std::to_string(eventQueue.dropped) +
+                    " input events").c_str());
+    }
+    log(("Uploaded " + std::to_string(uploader.bytesUploaded) + " bytes in " + std::to_string(uploader.batchesSubmitted) + " batches").c_str());
+    if (!textures.empty()) {
+        log(("Streamed " + std::to_string(textureStreamer.streamedBytes) + " bytes of texture data, " + std::to_string(textureStreamer.evictions) +
+                    " evictions, peak resident " + std::to_string(textureStreamer.peakBytes) + " of " + std::to_string(textureStreamer.budget) +
+                    " budgeted bytes").c_str());
+    }
+    if (meshLoader.meshesLoaded > 0) {
+        log(("Loaded " + std::to_string(meshLoader.meshesLoaded) + " meshes, " + std::to_string(meshLoader.bytesLoaded) + " bytes").c_str());
+    }
+    if (asyncCompute.submits > 0) {
+        log(("Submitted " + std::to_string(asyncCompute.submits) + " compute batches to the async compute queue").c_str());
+    }
+    if (options.hostAllocator) {
+        logHostAllocatorStats(hostWarmedUp, frameRing.frameNumber - hostWarmedUpFrame);
+    }
+    logAllocatorStats(&memoryAllocator);
+    if (!options.traceFile.empty() && !profilerExportChromeTrace(profiler, options.traceFile)) {
+        log(("Failed to write trace to \"" + options.traceFile + "\"").c_str());
+    }
+    if (!options.csvFile.empty() && !profilerExportCsv(profiler, options.csvFile)) {
+        log(("Failed to write frame timings to \"" + options.csvFile + "\"").c_str());
+    }
+    if (!options.benchFile.empty() && !profilerExportBenchmark(profiler, startupTimer, frameRing.frameNumber, seconds, options.benchFile)) {
+        log(("Failed to write benchmark results to \"" + options.benchFile + "\"").c_str());
+    }
+
+    destroyProfiler(vulkanDevice, &profiler);
+    if (options.watchShaders) {
+        log(("Reloaded " + std::to_string(shaderWatcher.reloads.load()) + " pipelines, " + std::to_string(shaderWatcher.failures.load()) +
+                    " shader reloads failed").c_str());
+    }
+    // Stopped first, the thread may still be compiling into the pipeline cache
+    destroyShaderWatcher(&shaderWatcher);
+    if (savePipelineLibrary(vulkanDevice, pipelineLibrary) != VK_SUCCESS) {
+        log(("Failed to save pipeline cache to \"" + pipelineLibrary.cachePath + "\"").c_str());
+    }
+    destroyPipelineLibrary(vulkanDevice, &pipelineLibrary);
+    vkDestroyRenderPass(vulkanDevice, renderPass, hostAllocator());
 
-        ASSERT_RESULT(vkAcquireNextImageKHR(vulkanDevice, swapchain, UINT64_MAX, semaphore, VK_NULL_HANDLE, &swapchainImageIndex), VK_SUCCESS,
-                "Failed to acquire swapchian image");
-
-        ASSERT_RESULT(vkBeginCommandBuffer(presentCmdBuffer, &presentBeginInfo), VK_SUCCESS, "Failed to begin recording command buffer");
-        imageBarrier.image = swapchainImages[swapchainImageIndex];
-        vkCmdPipelineBarrier(presentCmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
-        ASSERT_RESULT(vkEndCommandBuffer(presentCmdBuffer), VK_SUCCESS, "Failed to begin recording command buffer");
-        ASSERT_RESULT(vkQueueSubmit(presentQueue, 1, &submitInfo, fence), VK_SUCCESS, "Failed to submit presentation command buffer");
-
-        ASSERT_RESULT(vkWaitForFences(vulkanDevice, 1, &fence, VK_TRUE, UINT64_MAX), VK_SUCCESS, "Failed to wait for presentation queue fence");
-        ASSERT_RESULT(vkResetFences(vulkanDevice, 1, &fence), VK_SUCCESS, "Failed to wait for presentation queue fence");
-
-        ASSERT_RESULT(vkQueuePresentKHR(presentQueue, &presentInfo), VK_SUCCESS, "Failed to queue image presentation");
-    }
-
-    vkDestroyFence(vulkanDevice, fence, nullptr);
-    vkFreeCommandBuffers(vulkanDevice, graphicsCmdPool, 1, &graphicsCmdBuffer);
-    vkFreeCommandBuffers(vulkanDevice, presentCmdPool, 1, &presentCmdBuffer);
-    vkDestroyCommandPool(vulkanDevice, graphicsCmdPool, nullptr);
-    vkDestroyCommandPool(vulkanDevice, presentCmdPool, nullptr);
-    vkDestroySemaphore(vulkanDevice, semaphore, nullptr);
-    vkDestroySwapchainKHR(vulkanDevice, swapchain, nullptr);
-    vkDestroyDevice(vulkanDevice, nullptr);
-    destroyDebugMessenger(vulkanInstance, debugMessenger);
-    vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, nullptr);
-    vkDestroyInstance(vulkanInstance, nullptr);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    if (options.particles > 0) {
+        destroyParticleSystem(&memoryAllocator, &particles);
+    }
+    if (options.instances > 0) {
+        destroyGpuScene(&memoryAllocator, &gpuScene);
+    }
+    destroyTextureStreamer(&textureStreamer);
+    for (Mesh& mesh : meshes) {
+        destroyMesh(&memoryAllocator, &mesh);
+    }
+    destroyBindlessTable(&memoryAllocator, &bindlessTable);
+    destroyFrameDescriptors(&frameDescriptors);
+    destroyDescriptorLayoutCache(vulkanDevice, &descriptorLayouts);
+    destroyAsyncCompute(&asyncCompute);
+    destroyUploader(&memoryAllocator, &uploader);
+    log(("Render graph culled " + std::to_string(renderGraph.culledPasses) + " passes and recorded " + std::to_string(renderGraph.barrierBatches) +
+                " barrier batches").c_str());
+    destroyRenderGraph(&renderGraph);
+    if (options.staticScene) {
+        log(("Recorded static command buffers " + std::to_string(staticCommands.recordings) + " times in " + std::to_string(frameRing.frameNumber) +
+                    " frames").c_str());
+        destroyStaticCommands(&staticCommands);
+    }
+    destroyCommandRecorder(&commandRecorder);
+    destroyJobSystem(&jobSystem);
+    destroyFrameRing(vulkanDevice, &frameRing);
+    if (options.headless) {
+        destroyOffscreenTargets(&memoryAllocator, &offscreenTargets);
+    } else {
+        destroyRetiredSwapchains(vulkanDevice, retiredSwapchains, UINT64_MAX);
+        destroySwapchain(vulkanDevice, &swapchain);
+    }
+    destroyMemoryAllocator(&memoryAllocator);
+    vkDestroyDevice(vulkanDevice, hostAllocator());
+#ifdef ENABLE_VALIDATION
+    if (debugMessenger != VK_NULL_HANDLE) {
+        destroyDebugMessenger(vulkanInstance, debugMessenger);
+    }
+#endif
+    // SDL created the surface without allocation callbacks
+    if (vulkanSurface != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, nullptr);
+    }
+    vkDestroyInstance(vulkanInstance, hostAllocator());
+    stopHostAllocator();
+    if (window != nullptr) {
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+    stopLogger();
     return 0;
 }
-
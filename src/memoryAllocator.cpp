@@ -0,0 +1,620 @@
+#include <algorithm>
+#include <sstream>
+
+#include "hostAllocator.h"
+#include "memoryAllocator.h"
+#include "vulkanUtils.h"
+
+static VkDeviceSize alignUp (VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t mostSignificantBit (uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+// Sizes are always multiples of TLSF_MIN_ALIGNMENT, so fl is never below TLSF_SL_LOG2
+static void mappingInsert (VkDeviceSize size, uint32_t *fl, uint32_t *sl) {
+    *fl = mostSignificantBit(size);
+    *sl = static_cast<uint32_t>(size >> (*fl - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+}
+
+// Rounds the size up to the next list boundary, so that any range found in the resulting list is large enough
+static void mappingSearch (VkDeviceSize size, uint32_t *fl, uint32_t *sl) {
+    size += (1ull << (mostSignificantBit(size) - TLSF_SL_LOG2)) - 1;
+    mappingInsert(size, fl, sl);
+}
+
+static uint32_t newNode (TlsfBlock *block) {
+    if (!block->unusedNodes.empty()) {
+        uint32_t node = block->unusedNodes.back();
+        block->unusedNodes.pop_back();
+        return node;
+    }
+    block->nodes.push_back({});
+    return static_cast<uint32_t>(block->nodes.size() - 1);
+}
+
+static void insertFree (TlsfBlock *block, uint32_t node) {
+    uint32_t fl, sl;
+    mappingInsert(block->nodes[node].size, &fl, &sl);
+    uint32_t head = block->freeHeads[fl][sl];
+    block->nodes[node].free = true;
+    block->nodes[node].prevFree = TLSF_NONE;
+    block->nodes[node].nextFree = head;
+    if (head != TLSF_NONE) {
+        block->nodes[head].prevFree = node;
+    }
+    block->freeHeads[fl][sl] = node;
+    block->flBitmap |= 1ull << fl;
+    block->slBitmap[fl] |= 1u << sl;
+}
+
+static void removeFree (TlsfBlock *block, uint32_t node) {
+    uint32_t fl, sl;
+    mappingInsert(block->nodes[node].size, &fl, &sl);
+    uint32_t prev = block->nodes[node].prevFree;
+    uint32_t next = block->nodes[node].nextFree;
+    if (prev != TLSF_NONE) {
+        block->nodes[prev].nextFree = next;
+    } else {
+        block->freeHeads[fl][sl] = next;
+    }
+    if (next != TLSF_NONE) {
+        block->nodes[next].prevFree = prev;
+    }
+    if (block->freeHeads[fl][sl] == TLSF_NONE) {
+        block->slBitmap[fl] &= ~(1u << sl);
+        if (block->slBitmap[fl] == 0) {
+            block->flBitmap &= ~(1ull << fl);
+        }
+    }
+    block->nodes[node].free = false;
+}
+
+static uint32_t findFree (const TlsfBlock& block, uint32_t fl, uint32_t sl) {
+    uint32_t slMap = block.slBitmap[fl] & (~0u << sl);
+    if (slMap == 0) {
+        uint64_t flMap = fl + 1 < TLSF_FL_COUNT ? block.flBitmap & (~0ull << (fl + 1)) : 0;
+        if (flMap == 0) {
+            return TLSF_NONE;
+        }
+        fl = __builtin_ctzll(flMap);
+        slMap = block.slBitmap[fl];
+    }
+    return block.freeHeads[fl][__builtin_ctz(slMap)];
+}
+
+static void initTlsfBlock (TlsfBlock *block) {
+    block->nodes.clear();
+    block->unusedNodes.clear();
+    block->flBitmap = 0;
+    std::fill(std::begin(block->slBitmap), std::end(block->slBitmap), 0u);
+    for (auto& lists : block->freeHeads) {
+        std::fill(std::begin(lists), std::end(lists), TLSF_NONE);
+    }
+    block->usedBytes = 0;
+    block->allocationCount = 0;
+    uint32_t node = newNode(block);
+    block->nodes[node] = {
+        .offset = 0,
+        .size = block->size,
+        .prevPhysical = TLSF_NONE,
+        .nextPhysical = TLSF_NONE,
+        .prevFree = TLSF_NONE,
+        .nextFree = TLSF_NONE,
+        .free = false
+    };
+    insertFree(block, node);
+}
+
+// size and alignment must be multiples of TLSF_MIN_ALIGNMENT
+static bool tlsfAllocate (TlsfBlock *block, VkDeviceSize size, VkDeviceSize alignment, uint32_t *allocatedNode) {
+    // Searching for the worst case padding up front keeps the search O(1) instead of walking a list
+    VkDeviceSize searchSize = size + alignment - TLSF_MIN_ALIGNMENT;
+    if (searchSize > block->size) {
+        return false;
+    }
+    uint32_t fl, sl;
+    mappingSearch(searchSize, &fl, &sl);
+    uint32_t node = findFree(*block, fl, sl);
+    if (node == TLSF_NONE) {
+        return false;
+    }
+    removeFree(block, node);
+
+    VkDeviceSize padding = alignUp(block->nodes[node].offset, alignment) - block->nodes[node].offset;
+    if (padding > 0) {
+        uint32_t front = newNode(block);
+        uint32_t prev = block->nodes[node].prevPhysical;
+        block->nodes[front] = {
+            .offset = block->nodes[node].offset,
+            .size = padding,
+            .prevPhysical = prev,
+            .nextPhysical = node,
+            .prevFree = TLSF_NONE,
+            .nextFree = TLSF_NONE,
+            .free = false
+        };
+        if (prev != TLSF_NONE) {
+            block->nodes[prev].nextPhysical = front;
+        }
+        block->nodes[node].prevPhysical = front;
+        block->nodes[node].offset += padding;
+        block->nodes[node].size -= padding;
+        insertFree(block, front);
+    }
+
+    VkDeviceSize remainder = block->nodes[node].size - size;
+    if (remainder > 0) {
+        uint32_t back = newNode(block);
+        uint32_t next = block->nodes[node].nextPhysical;
+        block->nodes[back] = {
+            .offset = block->nodes[node].offset + size,
+            .size = remainder,
+            .prevPhysical = node,
+            .nextPhysical = next,
+            .prevFree = TLSF_NONE,
+            .nextFree = TLSF_NONE,
+            .free = false
+        };
+        if (next != TLSF_NONE) {
+            block->nodes[next].prevPhysical = back;
+        }
+        block->nodes[node].nextPhysical = back;
+        block->nodes[node].size = size;
+        insertFree(block, back);
+    }
+
+    block->usedBytes += size;
+    block->allocationCount++;
+    *allocatedNode = node;
+    return true;
+}
+
+// Merges next into node, both must already be out of the free lists
+static void mergeNext (TlsfBlock *block, uint32_t node, uint32_t next) {
+    block->nodes[node].size += block->nodes[next].size;
+    uint32_t after = block->nodes[next].nextPhysical;
+    block->nodes[node].nextPhysical = after;
+    if (after != TLSF_NONE) {
+        block->nodes[after].prevPhysical = node;
+    }
+    block->unusedNodes.push_back(next);
+}
+
+static void tlsfFree (TlsfBlock *block, uint32_t node) {
+    block->usedBytes -= block->nodes[node].size;
+    block->allocationCount--;
+    uint32_t next = block->nodes[node].nextPhysical;
+    if (next != TLSF_NONE && block->nodes[next].free) {
+        removeFree(block, next);
+        mergeNext(block, node, next);
+    }
+    uint32_t prev = block->nodes[node].prevPhysical;
+    if (prev != TLSF_NONE && block->nodes[prev].free) {
+        removeFree(block, prev);
+        mergeNext(block, prev, node);
+        node = prev;
+    }
+    insertFree(block, node);
+}
+
+static bool isHostVisible (const MemoryAllocator& allocator, uint32_t memoryType) {
+    return (allocator.memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+static bool isNonCoherent (const MemoryAllocator& allocator, uint32_t memoryType) {
+    VkMemoryPropertyFlags flags = allocator.memoryProperties.memoryTypes[memoryType].propertyFlags;
+    return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0 && (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0;
+}
+
+// Small heaps (integrated GPUs, the 256 MiB BAR window) get proportionally smaller blocks so a single pool can't exhaust them
+static VkDeviceSize preferredBlockSize (const MemoryAllocator& allocator, uint32_t memoryType) {
+    const VkMemoryType& type = allocator.memoryProperties.memoryTypes[memoryType];
+    VkDeviceSize heapSize = allocator.memoryProperties.memoryHeaps[type.heapIndex].size;
+    if (heapSize <= (1ull << 30)) {
+        return alignUp(heapSize / 8, TLSF_MIN_ALIGNMENT);
+    }
+    return (type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0 ? DEFAULT_DEVICE_BLOCK_SIZE : DEFAULT_HOST_BLOCK_SIZE;
+}
+
+// Every VkDeviceMemory the allocator owns goes through here, host visible memory is mapped once for its whole lifetime
+static VkResult allocateDeviceMemory (MemoryAllocator *allocator, uint32_t memoryType, VkDeviceSize size, VkDeviceMemory *memory,
+        void **mapped) {
+    if (allocator->deviceMemoryObjects >= allocator->maxMemoryAllocationCount) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+    VkMemoryAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryType
+    };
+    VkResult result = vkAllocateMemory(allocator->device, &allocateInfo, hostAllocator(), memory);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    *mapped = nullptr;
+    if (isHostVisible(*allocator, memoryType)) {
+        if ((result = vkMapMemory(allocator->device, *memory, 0, VK_WHOLE_SIZE, 0, mapped)) != VK_SUCCESS) {
+            vkFreeMemory(allocator->device, *memory, hostAllocator());
+            return result;
+        }
+    }
+    allocator->deviceMemoryObjects++;
+    return VK_SUCCESS;
+}
+
+static void freeDeviceMemory (MemoryAllocator *allocator, VkDeviceMemory memory) {
+    // Freeing implicitly unmaps
+    vkFreeMemory(allocator->device, memory, hostAllocator());
+    allocator->deviceMemoryObjects--;
+}
+
+static VkResult allocateFromPool (MemoryAllocator *allocator, uint32_t memoryType, ResourceKind kind, VkDeviceSize size,
+        VkDeviceSize alignment, Allocation *allocation) {
+    std::vector<std::unique_ptr<TlsfBlock>>& blocks = allocator->blocks[memoryType][kind];
+    uint32_t node;
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        TlsfBlock *block = blocks[i].get();
+        if (block != nullptr && tlsfAllocate(block, size, alignment, &node)) {
+            allocation->memory = block->memory;
+            allocation->offset = block->nodes[node].offset;
+            allocation->mapped = block->mapped != nullptr ? static_cast<char*>(block->mapped) + allocation->offset : nullptr;
+            allocation->block = i;
+            allocation->node = node;
+            return VK_SUCCESS;
+        }
+    }
+
+    std::unique_ptr<TlsfBlock> block(new TlsfBlock());
+    block->size = preferredBlockSize(*allocator, memoryType);
+    VkResult result = allocateDeviceMemory(allocator, memoryType, block->size, &block->memory, &block->mapped);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    initTlsfBlock(block.get());
+    if (!tlsfAllocate(block.get(), size, alignment, &node)) {
+        freeDeviceMemory(allocator, block->memory);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    // Reuse the slot of a block released earlier so existing allocations keep their indices
+    auto slot = std::find(blocks.begin(), blocks.end(), nullptr);
+    if (slot == blocks.end()) {
+        slot = blocks.insert(blocks.end(), nullptr);
+    }
+    allocation->memory = block->memory;
+    allocation->offset = block->nodes[node].offset;
+    allocation->mapped = block->mapped != nullptr ? static_cast<char*>(block->mapped) + allocation->offset : nullptr;
+    allocation->block = static_cast<uint32_t>(slot - blocks.begin());
+    allocation->node = node;
+    *slot = std::move(block);
+    return VK_SUCCESS;
+}
+
+static VkResult allocateTransient (MemoryAllocator *allocator, uint32_t memoryType, ResourceKind kind, VkDeviceSize size,
+        VkDeviceSize alignment, Allocation *allocation) {
+    std::vector<LinearBlock>& blocks = allocator->transient[allocator->currentSlot].blocks[memoryType][kind];
+    LinearBlock *target = nullptr;
+    for (LinearBlock& block : blocks) {
+        if (alignUp(block.head, alignment) + size <= block.size) {
+            target = &block;
+            break;
+        }
+    }
+    if (target == nullptr) {
+        // Grows until it covers the slot's peak usage, after that the arena never allocates again
+        LinearBlock block = {};
+        block.size = std::max<VkDeviceSize>(DEFAULT_TRANSIENT_BLOCK_SIZE, alignUp(size, TLSF_MIN_ALIGNMENT));
+        VkResult result = allocateDeviceMemory(allocator, memoryType, block.size, &block.memory, &block.mapped);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+        blocks.push_back(block);
+        target = &blocks.back();
+    }
+    allocation->memory = target->memory;
+    allocation->offset = alignUp(target->head, alignment);
+    allocation->mapped = target->mapped != nullptr ? static_cast<char*>(target->mapped) + allocation->offset : nullptr;
+    allocation->block = TLSF_NONE;
+    allocation->node = TLSF_NONE;
+    target->head = allocation->offset + size;
+    return VK_SUCCESS;
+}
+
+VkResult createMemoryAllocator (VkPhysicalDevice physicalDevice, VkDevice device, uint32_t frameSlots, MemoryAllocator *allocator) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    allocator->physicalDevice = physicalDevice;
+    allocator->device = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &allocator->memoryProperties);
+    allocator->bufferImageGranularity = properties.limits.bufferImageGranularity;
+    allocator->nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+    allocator->maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+    allocator->deviceMemoryObjects = 0;
+    allocator->transient.clear();
+    allocator->transient.resize(frameSlots);
+    allocator->currentSlot = 0;
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++) {
+        allocator->dedicatedCount[i] = 0;
+        allocator->dedicatedBytes[i] = 0;
+    }
+    return VK_SUCCESS;
+}
+
+void destroyMemoryAllocator (MemoryAllocator *allocator) {
+    for (auto& kinds : allocator->blocks) {
+        for (auto& blocks : kinds) {
+            for (std::unique_ptr<TlsfBlock>& block : blocks) {
+                if (block != nullptr) {
+                    if (block->allocationCount > 0) {
+                        log(("Memory block destroyed with " + std::to_string(block->allocationCount) + " live allocations").c_str());
+                    }
+                    freeDeviceMemory(allocator, block->memory);
+                }
+            }
+            blocks.clear();
+        }
+    }
+    for (TransientArena& arena : allocator->transient) {
+        for (auto& kinds : arena.blocks) {
+            for (auto& blocks : kinds) {
+                for (LinearBlock& block : blocks) {
+                    freeDeviceMemory(allocator, block.memory);
+                }
+                blocks.clear();
+            }
+        }
+    }
+    allocator->transient.clear();
+    if (allocator->deviceMemoryObjects > 0) {
+        log(("Leaked " + std::to_string(allocator->deviceMemoryObjects) + " dedicated allocations").c_str());
+    }
+}
+
+VkResult allocateMemory (MemoryAllocator *allocator, const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred, AllocationUsage usage, ResourceKind kind, Allocation *allocation) {
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+
+    // Candidates with more of the preferred flags first, the rest are fallbacks for when a heap runs out
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < allocator->memoryProperties.memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = allocator->memoryProperties.memoryTypes[i].propertyFlags;
+        if ((requirements.memoryTypeBits & (1u << i)) != 0 && (flags & required) == required) {
+            candidates.push_back(i);
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [allocator, preferred] (uint32_t a, uint32_t b) {
+        return __builtin_popcount(allocator->memoryProperties.memoryTypes[a].propertyFlags & preferred) >
+            __builtin_popcount(allocator->memoryProperties.memoryTypes[b].propertyFlags & preferred);
+    });
+    if (candidates.empty()) {
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    // Without a granularity restriction linear and optimal resources can share blocks
+    if (allocator->bufferImageGranularity <= 1) {
+        kind = RESOURCE_LINEAR;
+    }
+
+    VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    for (uint32_t memoryType : candidates) {
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, TLSF_MIN_ALIGNMENT);
+        VkDeviceSize size = alignUp(requirements.size, TLSF_MIN_ALIGNMENT);
+        // Keeps flush and invalidate ranges legal without clamping them against neighbouring allocations
+        if (isNonCoherent(*allocator, memoryType)) {
+            alignment = std::max(alignment, allocator->nonCoherentAtomSize);
+            size = alignUp(size, allocator->nonCoherentAtomSize);
+        }
+
+        allocation->size = size;
+        allocation->memoryType = memoryType;
+        allocation->usage = usage;
+        allocation->kind = kind;
+
+        if (usage == ALLOCATION_TRANSIENT) {
+            result = allocateTransient(allocator, memoryType, kind, size, alignment, allocation);
+        } else if (size > preferredBlockSize(*allocator, memoryType) / 2) {
+            // Big resources would waste most of a block, give them their own memory object
+            result = allocateDeviceMemory(allocator, memoryType, size, &allocation->memory, &allocation->mapped);
+            if (result == VK_SUCCESS) {
+                allocation->offset = 0;
+                allocation->block = TLSF_NONE;
+                allocation->node = TLSF_NONE;
+                allocator->dedicatedCount[memoryType]++;
+                allocator->dedicatedBytes[memoryType] += size;
+            }
+        } else {
+            result = allocateFromPool(allocator, memoryType, kind, size, alignment, allocation);
+        }
+        if (result == VK_SUCCESS || result == VK_ERROR_TOO_MANY_OBJECTS) {
+            break;
+        }
+    }
+    return result;
+}
+
+void freeMemory (MemoryAllocator *allocator, Allocation *allocation) {
+    if (allocation->memory == VK_NULL_HANDLE || allocation->usage == ALLOCATION_TRANSIENT) {
+        *allocation = {};
+        return;
+    }
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    if (allocation->block == TLSF_NONE) {
+        freeDeviceMemory(allocator, allocation->memory);
+        allocator->dedicatedCount[allocation->memoryType]--;
+        allocator->dedicatedBytes[allocation->memoryType] -= allocation->size;
+    } else {
+        std::vector<std::unique_ptr<TlsfBlock>>& blocks = allocator->blocks[allocation->memoryType][allocation->kind];
+        TlsfBlock *block = blocks[allocation->block].get();
+        tlsfFree(block, allocation->node);
+        if (block->allocationCount == 0) {
+            // Keep a single empty block around so a resource that is recreated over and over doesn't churn vkAllocateMemory
+            bool otherEmpty = false;
+            for (const std::unique_ptr<TlsfBlock>& other : blocks) {
+                otherEmpty = otherEmpty || (other != nullptr && other.get() != block && other->allocationCount == 0);
+            }
+            if (otherEmpty) {
+                freeDeviceMemory(allocator, block->memory);
+                blocks[allocation->block].reset();
+            }
+        }
+    }
+    *allocation = {};
+}
+
+void beginTransientFrame (MemoryAllocator *allocator, uint32_t slot) {
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    allocator->currentSlot = slot;
+    for (auto& kinds : allocator->transient[slot].blocks) {
+        for (auto& blocks : kinds) {
+            for (LinearBlock& block : blocks) {
+                block.head = 0;
+            }
+        }
+    }
+}
+
+static VkResult mappedRangeOp (MemoryAllocator *allocator, const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size,
+        PFN_vkFlushMappedMemoryRanges op) {
+    if (!isNonCoherent(*allocator, allocation.memoryType)) {
+        return VK_SUCCESS;
+    }
+    // Allocations in non-coherent memory start and end on atom boundaries, so the widened range never leaves them
+    VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.size : std::min(allocation.size, alignUp(offset + size, allocator->nonCoherentAtomSize));
+    offset = offset / allocator->nonCoherentAtomSize * allocator->nonCoherentAtomSize;
+    VkMappedMemoryRange range = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .pNext = nullptr,
+        .memory = allocation.memory,
+        .offset = allocation.offset + offset,
+        .size = end - offset
+    };
+    return op(allocator->device, 1, &range);
+}
+
+VkResult flushAllocation (MemoryAllocator *allocator, const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+    return mappedRangeOp(allocator, allocation, offset, size, vkFlushMappedMemoryRanges);
+}
+
+VkResult invalidateAllocation (MemoryAllocator *allocator, const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+    return mappedRangeOp(allocator, allocation, offset, size, vkInvalidateMappedMemoryRanges);
+}
+
+VkResult createAllocatedBuffer (MemoryAllocator *allocator, VkDeviceSize size, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred, AllocationUsage usage, VkBuffer *buffer, Allocation *allocation, const std::vector<uint32_t>& sharingFamilies) {
+    bool concurrent = sharingFamilies.size() > 1;
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .size = size,
+        .usage = bufferUsage,
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? static_cast<uint32_t>(sharingFamilies.size()) : 0u,
+        .pQueueFamilyIndices = concurrent ? sharingFamilies.data() : nullptr
+    };
+    VkResult result = vkCreateBuffer(allocator->device, &bufferCreateInfo, hostAllocator(), buffer);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(allocator->device, *buffer, &requirements);
+    if ((result = allocateMemory(allocator, requirements, required, preferred, usage, RESOURCE_LINEAR, allocation)) != VK_SUCCESS) {
+        vkDestroyBuffer(allocator->device, *buffer, hostAllocator());
+        *buffer = VK_NULL_HANDLE;
+        return result;
+    }
+    return vkBindBufferMemory(allocator->device, *buffer, allocation->memory, allocation->offset);
+}
+
+void destroyAllocatedBuffer (MemoryAllocator *allocator, VkBuffer buffer, Allocation *allocation) {
+    vkDestroyBuffer(allocator->device, buffer, hostAllocator());
+    freeMemory(allocator, allocation);
+}
+
+VkResult createAllocatedImage (MemoryAllocator *allocator, const VkImageCreateInfo& imageCreateInfo, VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred, VkImage *image, Allocation *allocation) {
+    VkResult result = vkCreateImage(allocator->device, &imageCreateInfo, hostAllocator(), image);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(allocator->device, *image, &requirements);
+    ResourceKind kind = imageCreateInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? RESOURCE_OPTIMAL : RESOURCE_LINEAR;
+    if ((result = allocateMemory(allocator, requirements, required, preferred, ALLOCATION_PERSISTENT, kind, allocation)) != VK_SUCCESS) {
+        vkDestroyImage(allocator->device, *image, hostAllocator());
+        *image = VK_NULL_HANDLE;
+        return result;
+    }
+    return vkBindImageMemory(allocator->device, *image, allocation->memory, allocation->offset);
+}
+
+void destroyAllocatedImage (MemoryAllocator *allocator, VkImage image, Allocation *allocation) {
+    vkDestroyImage(allocator->device, image, hostAllocator());
+    freeMemory(allocator, allocation);
+}
+
+AllocatorStats getAllocatorStats (MemoryAllocator *allocator) {
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    AllocatorStats stats = {};
+    stats.memoryTypeCount = allocator->memoryProperties.memoryTypeCount;
+    stats.deviceMemoryObjects = allocator->deviceMemoryObjects;
+    stats.maxMemoryAllocationCount = allocator->maxMemoryAllocationCount;
+    for (uint32_t type = 0; type < stats.memoryTypeCount; type++) {
+        MemoryTypeStats& typeStats = stats.types[type];
+        VkDeviceSize freeBytes = 0;
+        for (const auto& blocks : allocator->blocks[type]) {
+            for (const std::unique_ptr<TlsfBlock>& block : blocks) {
+                if (block == nullptr) {
+                    continue;
+                }
+                typeStats.blockCount++;
+                typeStats.blockBytes += block->size;
+                typeStats.usedBytes += block->usedBytes;
+                typeStats.allocationCount += block->allocationCount;
+                for (uint32_t node = 0; node != TLSF_NONE; node = block->nodes[node].nextPhysical) {
+                    if (block->nodes[node].free) {
+                        typeStats.freeRangeCount++;
+                        typeStats.largestFreeRange = std::max(typeStats.largestFreeRange, block->nodes[node].size);
+                        freeBytes += block->nodes[node].size;
+                    }
+                }
+            }
+        }
+        typeStats.fragmentation = freeBytes > 0 ? 1.0f - static_cast<float>(typeStats.largestFreeRange) / freeBytes : 0.0f;
+        typeStats.dedicatedCount = allocator->dedicatedCount[type];
+        typeStats.dedicatedBytes = allocator->dedicatedBytes[type];
+        for (const TransientArena& arena : allocator->transient) {
+            for (const auto& blocks : arena.blocks[type]) {
+                for (const LinearBlock& block : blocks) {
+                    typeStats.transientBytes += block.size;
+                    typeStats.transientUsedBytes += block.head;
+                }
+            }
+        }
+    }
+    return stats;
+}
+
+void logAllocatorStats (MemoryAllocator *allocator) {
+    AllocatorStats stats = getAllocatorStats(allocator);
+    std::ostringstream report;
+    report.precision(2);
+    report << std::fixed << "Device memory: " << stats.deviceMemoryObjects << " of " << stats.maxMemoryAllocationCount << " memory objects";
+    log(report.str().c_str());
+    for (uint32_t type = 0; type < stats.memoryTypeCount; type++) {
+        const MemoryTypeStats& typeStats = stats.types[type];
+        if (typeStats.blockCount == 0 && typeStats.dedicatedCount == 0 && typeStats.transientBytes == 0) {
+            continue;
+        }
+        report.str("");
+        report << "  type " << type << ": " << typeStats.allocationCount << " allocations, " << typeStats.usedBytes / 1024.0 / 1024.0 << " of "
+            << typeStats.blockBytes / 1024.0 / 1024.0 << " MiB used in " << typeStats.blockCount << " blocks, " << typeStats.freeRangeCount
+            << " free ranges, fragmentation " << typeStats.fragmentation << ", " << typeStats.dedicatedCount << " dedicated ("
+            << typeStats.dedicatedBytes / 1024.0 / 1024.0 << " MiB), transient " << typeStats.transientUsedBytes / 1024.0 / 1024.0 << " of "
+            << typeStats.transientBytes / 1024.0 / 1024.0 << " MiB";
+        log(report.str().c_str());
+    }
+}
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <chrono>
+
+#include <unistd.h>
+
+#include "logger.h"
+#include "meshLoader.h"
+#include "vulkanUtils.h"
+
+static int64_t steadyTime () {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool validSection (const MeshFileSection& section, uint64_t size, size_t fileSize) {
+    return section.offset % MESH_FILE_ALIGNMENT == 0 && section.size == size && section.offset <= fileSize && section.size <= fileSize - section.offset;
+}
+
+VkResult mapMeshFile (const std::string& path, MappedMesh *mesh) {
+    // Sections are read front to back exactly once, the mapping starts reading ahead right away
+    mesh->data = mapFile(path, &mesh->size);
+    if (mesh->data == nullptr) {
+        logMessage(LOG_SEVERITY_WARNING, ("Failed to map mesh \"" + path + "\"").c_str());
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    mesh->header = reinterpret_cast<const MeshFileHeader*>(mesh->data);
+    const MeshFileHeader& header = *mesh->header;
+    if (mesh->size < sizeof(MeshFileHeader) || header.magic != MESH_FILE_MAGIC || header.version != MESH_FILE_VERSION ||
+            header.vertexStride != sizeof(MeshVertex) || header.vertexCount == 0 || header.indexCount == 0 || header.indexCount % 3 != 0 ||
+            header.meshletCount == 0 ||
+            !validSection(header.vertices, static_cast<uint64_t>(header.vertexCount) * sizeof(MeshVertex), mesh->size) ||
+            !validSection(header.indices, static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t), mesh->size) ||
+            !validSection(header.meshlets, static_cast<uint64_t>(header.meshletCount) * sizeof(Meshlet), mesh->size)) {
+        logMessage(LOG_SEVERITY_WARNING, ("\"" + path + "\" is not a valid version " + std::to_string(MESH_FILE_VERSION) + " mesh file").c_str());
+        unmapMeshFile(mesh);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    return VK_SUCCESS;
+}
+
+void unmapMeshFile (MappedMesh *mesh) {
+    unmapFile(mesh->data, mesh->size);
+    mesh->data = nullptr;
+    mesh->header = nullptr;
+}
+
+// Touches one byte per page, so the copy under the uploader's lock never takes a major fault
+static void faultIn (const uint8_t *data, VkDeviceSize size) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    volatile uint8_t sink = 0;
+    for (VkDeviceSize offset = 0; offset < size; offset += pageSize) {
+        sink += data[offset];
+    }
+    (void)sink;
+}
+
+// Returns false if the loader was stopped before everything was queued
+static bool uploadSection (MeshLoader *loader, const MappedMesh& mapped, const MeshFileSection& section, VkBuffer buffer, MeshLoad *load) {
+    for (VkDeviceSize offset = 0; offset < section.size; offset += MESH_UPLOAD_CHUNK) {
+        VkDeviceSize size = std::min<VkDeviceSize>(MESH_UPLOAD_CHUNK, section.size - offset);
+        const uint8_t *data = mapped.data + section.offset + offset;
+        faultIn(data, size);
+        VkResult res;
+        while ((res = uploadBuffer(loader->allocator, loader->uploader, buffer, offset, data, size, &load->lastUpload)) == VK_NOT_READY) {
+            // The render loop frees staging space as frames complete
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            loader->wake.wait_for(lock, std::chrono::milliseconds(MESH_LOADER_RETRY_MS));
+            if (!loader->running) {
+                return false;
+            }
+        }
+        if (res != VK_SUCCESS) {
+            load->result = res;
+            return true;
+        }
+    }
+    return true;
+}
+
+static bool loadRequest (MeshLoader *loader, MeshLoad *load) {
+    MappedMesh mapped;
+    if ((load->result = mapMeshFile(load->path, &mapped)) != VK_SUCCESS) {
+        return true;
+    }
+    load->mapped = steadyTime();
+    Mesh *mesh = load->mesh;
+    mesh->header = *mapped.header;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if ((load->result = createAllocatedBuffer(loader->allocator, mesh->header.vertices.size, usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, &mesh->vertexBuffer,
+                    &mesh->vertexMemory)) != VK_SUCCESS ||
+            (load->result = createAllocatedBuffer(loader->allocator, mesh->header.indices.size, usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, &mesh->indexBuffer,
+                    &mesh->indexMemory)) != VK_SUCCESS ||
+            (load->result = createAllocatedBuffer(loader->allocator, mesh->header.meshlets.size, usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, &mesh->meshletBuffer, &mesh->meshletMemory)) != VK_SUCCESS) {
+        // The buffers created so far are released with the failed load
+        unmapMeshFile(&mapped);
+        return true;
+    }
+    const MeshFileSection *sections[] = { &mesh->header.vertices, &mesh->header.indices, &mesh->header.meshlets };
+    VkBuffer buffers[] = { mesh->vertexBuffer, mesh->indexBuffer, mesh->meshletBuffer };
+    // The first failing section ends the load, nothing after it is staged
+    bool finished = true;
+    for (uint32_t i = 0; i < 3 && finished && load->result == VK_SUCCESS; i++) {
+        finished = uploadSection(loader, mapped, *sections[i], buffers[i], load);
+    }
+    // Everything queued has been copied into the staging ring already
+    unmapMeshFile(&mapped);
+    load->queued = steadyTime();
+    return finished;
+}
+
+static void loadMeshes (MeshLoader *loader) {
+    std::unique_lock<std::mutex> lock(loader->mutex);
+    while (true) {
+        loader->wake.wait(lock, [loader] () { return !loader->running || !loader->requests.empty(); });
+        if (!loader->running) {
+            break;
+        }
+        MeshLoad load = loader->requests.front();
+        loader->requests.pop_front();
+        lock.unlock();
+        bool finished = loadRequest(loader, &load);
+        lock.lock();
+        if (finished) {
+            loader->queued.push_back(load);
+        }
+    }
+}
+
+void createMeshLoader (MemoryAllocator *allocator, Uploader *uploader, MeshLoader *loader) {
+    loader->allocator = allocator;
+    loader->uploader = uploader;
+    loader->running = true;
+    loader->bytesLoaded = 0;
+    loader->meshesLoaded = 0;
+    loader->pending = 0;
+    loader->thread = std::thread(loadMeshes, loader);
+}
+
+void destroyMeshLoader (MeshLoader *loader) {
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->running = false;
+    }
+    loader->wake.notify_all();
+    loader->thread.join();
+    loader->requests.clear();
+    loader->queued.clear();
+    loader->uploading.clear();
+}
+
+void loadMesh (MeshLoader *loader, const std::string& path, Mesh *mesh) {
+    *mesh = {};
+    mesh->result = VK_NOT_READY;
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->requests.push_back({ path, mesh, steadyTime(), 0, 0, 0, VK_SUCCESS });
+    }
+    loader->pending++;
+    loader->wake.notify_all();
+}
+
+uint32_t updateMeshLoads (MeshLoader *loader) {
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->uploading.insert(loader->uploading.end(), loader->queued.begin(), loader->queued.end());
+        loader->queued.clear();
+    }
+    for (uint32_t i = 0; i < loader->uploading.size();) {
+        MeshLoad& load = loader->uploading[i];
+        // Failed loads wait as well, copies already queued into their buffers must finish before the buffers go away
+        if (!uploadComplete(*loader->uploader, load.lastUpload)) {
+            i++;
+            continue;
+        }
+        Mesh *mesh = load.mesh;
+        mesh->result = load.result;
+        if (load.result == VK_SUCCESS) {
+            mesh->resident = true;
+            uint64_t bytes = mesh->header.vertices.size + mesh->header.indices.size + mesh->header.meshlets.size;
+            double seconds = (steadyTime() - load.requested) / 1e9;
+            loader->bytesLoaded += bytes;
+            loader->meshesLoaded++;
+            log(("Mesh \"" + load.path + "\" resident after " + std::to_string(seconds * 1e3) + " ms: " + std::to_string(bytes / 1e6) + " MB at " +
+                        std::to_string(bytes / 1e6 / seconds) + " MB/s, mapped after " + std::to_string((load.mapped - load.requested) / 1e6) +
+                        " ms, queued after " + std::to_string((load.queued - load.requested) / 1e6) + " ms").c_str());
+        } else {
+            logMessage(LOG_SEVERITY_WARNING, ("Failed to load mesh \"" + load.path + "\" (" + std::to_string(load.result) + ")").c_str());
+            destroyMesh(loader->allocator, mesh);
+        }
+        load = loader->uploading.back();
+        loader->uploading.pop_back();
+        loader->pending--;
+    }
+    return loader->pending;
+}
+
+void destroyMesh (MemoryAllocator *allocator, Mesh *mesh) {
+    if (mesh->vertexBuffer != VK_NULL_HANDLE) {
+        destroyAllocatedBuffer(allocator, mesh->vertexBuffer, &mesh->vertexMemory);
+        mesh->vertexBuffer = VK_NULL_HANDLE;
+    }
+    if (mesh->indexBuffer != VK_NULL_HANDLE) {
+        destroyAllocatedBuffer(allocator, mesh->indexBuffer, &mesh->indexMemory);
+        mesh->indexBuffer = VK_NULL_HANDLE;
+    }
+    if (mesh->meshletBuffer != VK_NULL_HANDLE) {
+        destroyAllocatedBuffer(allocator, mesh->meshletBuffer, &mesh->meshletMemory);
+        mesh->meshletBuffer = VK_NULL_HANDLE;
+    }
+    mesh->resident = false;
+}
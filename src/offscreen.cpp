@@ -0,0 +1,124 @@
+#include <fstream>
+
+#include "hostAllocator.h"
+#include "offscreen.h"
+#include "vulkanUtils.h"
+
+VkResult createOffscreenTargets (MemoryAllocator *allocator, VkExtent2D extent, uint32_t count, bool readback, OffscreenTargets *res) {
+    VkResult result = VK_SUCCESS;
+    res->format = VK_FORMAT_R8G8B8A8_UNORM;
+    res->extent = extent;
+    res->readback = readback;
+    res->targets.resize(count);
+
+    for (OffscreenTarget& target : res->targets) {
+        target = {};
+        target.pendingFrame = -1;
+        VkImageCreateInfo imageCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = res->format,
+            .extent = { extent.width, extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+        // Software implementations might not advertise device local memory at all, so it is only preferred
+        if ((result = createAllocatedImage(allocator, imageCreateInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &target.image,
+                        &target.memory)) != VK_SUCCESS) {
+            return result;
+        }
+        if (readback) {
+            VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+            // Cached memory makes the CPU reads fast, fall back to whatever is host visible
+            if ((result = createAllocatedBuffer(allocator, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                            VK_MEMORY_PROPERTY_HOST_CACHED_BIT, ALLOCATION_PERSISTENT, &target.readbackBuffer, &target.readbackMemory)) != VK_SUCCESS) {
+                return result;
+            }
+        }
+    }
+    return result;
+}
+
+VkResult createOffscreenFramebuffers (VkDevice device, VkRenderPass renderPass, OffscreenTargets *targets) {
+    VkResult res = VK_SUCCESS;
+    for (OffscreenTarget& target : targets->targets) {
+        if ((res = createImageView(device, target.image, targets->format, &target.view)) != VK_SUCCESS) {
+            return res;
+        }
+        if ((res = createFramebuffer(device, renderPass, target.view, targets->extent, &target.framebuffer)) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    return res;
+}
+
+void destroyOffscreenTargets (MemoryAllocator *allocator, OffscreenTargets *targets) {
+    for (OffscreenTarget& target : targets->targets) {
+        vkDestroyFramebuffer(allocator->device, target.framebuffer, hostAllocator());
+        vkDestroyImageView(allocator->device, target.view, hostAllocator());
+        if (target.readbackBuffer != VK_NULL_HANDLE) {
+            destroyAllocatedBuffer(allocator, target.readbackBuffer, &target.readbackMemory);
+        }
+        destroyAllocatedImage(allocator, target.image, &target.memory);
+    }
+    targets->targets.clear();
+}
+
+void recordOffscreenReadback (VkCommandBuffer cmdBuffer, const OffscreenTargets& targets, uint32_t index) {
+    const OffscreenTarget& target = targets.targets[index];
+    if (!targets.readback) {
+        return;
+    }
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { targets.extent.width, targets.extent.height, 1 }
+    };
+    vkCmdCopyImageToBuffer(cmdBuffer, target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.readbackBuffer, 1, &region);
+}
+
+const uint8_t* mapOffscreenReadback (MemoryAllocator *allocator, const OffscreenTargets& targets, uint32_t index) {
+    const OffscreenTarget& target = targets.targets[index];
+    if (!targets.readback || target.pendingFrame < 0) {
+        return nullptr;
+    }
+    ASSERT_RESULT(invalidateAllocation(allocator, target.readbackMemory), VK_SUCCESS, "Failed to invalidate readback memory");
+    return static_cast<const uint8_t*>(target.readbackMemory.mapped);
+}
+
+bool writeFramePPM (const std::string& path, const uint8_t *rgba, VkExtent2D extent) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    out << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+    std::vector<uint8_t> row(extent.width * 3);
+    for (uint32_t y = 0; y < extent.height; y++) {
+        const uint8_t *src = rgba + static_cast<size_t>(y) * extent.width * 4;
+        for (uint32_t x = 0; x < extent.width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,102 @@
+#include <fstream>
+
+#include "hostAllocator.h"
+#include "jobSystem.h"
+#include "particles.h"
+#include "vulkanUtils.h"
+
+struct ParticlePushConstants {
+    uint32_t count;
+    float dt;
+    uint32_t reset;
+};
+
+VkResult createParticleSystem (MemoryAllocator *allocator, PipelineLibrary *library, DescriptorLayoutCache *layouts, uint32_t count, uint32_t groupSize,
+        uint32_t slotCount, const std::vector<uint32_t>& sharingFamilies, ParticleSystem *particles, ComputePipelineDesc *desc) {
+    VkResult res = VK_SUCCESS;
+    VkDevice device = allocator->device;
+    particles->count = count;
+    particles->groupSize = groupSize;
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+        { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+    };
+    if ((res = getDescriptorSetLayout(device, layouts, bindings, &particles->setLayout)) != VK_SUCCESS) {
+        return res;
+    }
+    VkPushConstantRange pushConstants = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticlePushConstants) };
+    VkPipelineLayoutCreateInfo layoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &particles->setLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstants
+    };
+    if ((res = vkCreatePipelineLayout(device, &layoutCreateInfo, hostAllocator(), &particles->pipelineLayout)) != VK_SUCCESS) {
+        return res;
+    }
+    std::string variant = "shaders/particles.comp.group" + std::to_string(groupSize) + ".spv";
+    std::ifstream variantFile(variant);
+    // A frozen variant has no specialization constants left, the constant is simply ignored there
+    desc->computeShader = variantFile.good() ? variant : "shaders/particles.comp.spv";
+    desc->layout = particles->pipelineLayout;
+    desc->specialization = { { PARTICLE_GROUP_SIZE_ID, groupSize } };
+    if ((res = getComputePipeline(device, library, *desc, &particles->pipeline)) != VK_SUCCESS) {
+        return res;
+    }
+
+    // position and velocity, two vec4 per particle
+    VkDeviceSize size = static_cast<VkDeviceSize>(count) * 8 * sizeof(float);
+    particles->buffers.resize(slotCount);
+    particles->memory.resize(slotCount);
+    for (uint32_t i = 0; i < slotCount; i++) {
+        if ((res = createAllocatedBuffer(allocator, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 0,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, &particles->buffers[i], &particles->memory[i], sharingFamilies)) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    return res;
+}
+
+void destroyParticleSystem (MemoryAllocator *allocator, ParticleSystem *particles) {
+    for (uint32_t i = 0; i < particles->buffers.size(); i++) {
+        destroyAllocatedBuffer(allocator, particles->buffers[i], &particles->memory[i]);
+    }
+    particles->buffers.clear();
+    particles->memory.clear();
+    // The pipeline belongs to the library and the set layout to the layout cache
+    vkDestroyPipelineLayout(allocator->device, particles->pipelineLayout, hostAllocator());
+}
+
+void recordParticleUpdate (const ParticleSystem& particles, FrameDescriptors *descriptors, VkCommandBuffer cmdBuffer, uint32_t slot, uint32_t previousSlot,
+        uint64_t frameNumber, float dt) {
+    VkDescriptorSet set;
+    ASSERT_RESULT(allocateFrameDescriptorSet(descriptors, slot, currentJobThread(), particles.setLayout, &set), VK_SUCCESS,
+            "Failed to allocate particle descriptor set");
+    VkDescriptorBufferInfo bufferInfos[] = {
+        { particles.buffers[previousSlot], 0, VK_WHOLE_SIZE },
+        { particles.buffers[slot], 0, VK_WHOLE_SIZE }
+    };
+    // Both bindings in one write, it rolls over from binding 0 into binding 1
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = set,
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 2,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = bufferInfos,
+        .pTexelBufferView = nullptr
+    };
+    vkUpdateDescriptorSets(descriptors->device, 1, &write, 0, nullptr);
+
+    ParticlePushConstants pushConstants = { particles.count, dt, frameNumber == 0 ? 1u : 0u };
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particles.pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particles.pipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, particles.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(cmdBuffer, (particles.count + particles.groupSize - 1) / particles.groupSize, 1, 1);
+}
@@ -0,0 +1,500 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "hostAllocator.h"
+#include "pipelines.h"
+#include "vulkanUtils.h"
+
+#define PIPELINE_CACHE_MAGIC    0x43505056u    // "VPPC"
+#define PIPELINE_CACHE_VERSION  1u
+
+// Prepended to the driver's cache blob on disk. The driver validates its own header as well, but some drivers
+// crash or silently misbehave on foreign data, so nothing reaches vkCreatePipelineCache unless this matches.
+struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint32_t reserved;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+// Layout of the header every VkPipelineCache blob starts with (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+struct DriverCacheHeader {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+static bool validateCacheFile (const PipelineLibrary& library, const std::vector<char>& contents) {
+    if (contents.size() < sizeof(PipelineCacheFileHeader)) {
+        return false;
+    }
+    PipelineCacheFileHeader header;
+    memcpy(&header, contents.data(), sizeof(header));
+    const char *data = contents.data() + sizeof(header);
+    if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION ||
+            header.vendorID != library.vendorID || header.deviceID != library.deviceID || header.driverVersion != library.driverVersion ||
+            memcmp(header.pipelineCacheUUID, library.pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+            header.dataSize != contents.size() - sizeof(header) || header.dataHash != hashBytes(data, header.dataSize)) {
+        return false;
+    }
+
+    if (header.dataSize < sizeof(DriverCacheHeader)) {
+        return false;
+    }
+    DriverCacheHeader driverHeader;
+    memcpy(&driverHeader, data, sizeof(driverHeader));
+    return driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && driverHeader.vendorID == library.vendorID &&
+        driverHeader.deviceID == library.deviceID && memcmp(driverHeader.pipelineCacheUUID, library.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkResult createPipelineLibrary (VkPhysicalDevice physicalDevice, VkDevice device, const std::string& cachePath, PipelineLibrary *library) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    library->cachePath = cachePath;
+    library->warm = false;
+    library->loadedBytes = 0;
+    library->vendorID = properties.vendorID;
+    library->deviceID = properties.deviceID;
+    library->driverVersion = properties.driverVersion;
+    memcpy(library->pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    std::vector<char> contents;
+    const void *initialData = nullptr;
+    size_t initialDataSize = 0;
+    if (!cachePath.empty() && readFile(cachePath, contents)) {
+        if (validateCacheFile(*library, contents)) {
+            initialData = contents.data() + sizeof(PipelineCacheFileHeader);
+            initialDataSize = contents.size() - sizeof(PipelineCacheFileHeader);
+        } else {
+            log(("Ignoring pipeline cache \"" + cachePath + "\", it was written by a different device or driver or is corrupt").c_str());
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .initialDataSize = initialDataSize,
+        .pInitialData = initialData
+    };
+    VkResult res = vkCreatePipelineCache(device, &cacheCreateInfo, hostAllocator(), &library->cache);
+    if (res != VK_SUCCESS && initialData != nullptr) {
+        // Still rejected by the driver, fall back to an empty cache
+        cacheCreateInfo.initialDataSize = 0;
+        cacheCreateInfo.pInitialData = nullptr;
+        initialDataSize = 0;
+        res = vkCreatePipelineCache(device, &cacheCreateInfo, hostAllocator(), &library->cache);
+    }
+    library->warm = (res == VK_SUCCESS && initialDataSize > 0);
+    library->loadedBytes = initialDataSize;
+    return res;
+}
+
+VkResult savePipelineLibrary (VkDevice device, const PipelineLibrary& library) {
+    if (library.cachePath.empty()) {
+        return VK_SUCCESS;
+    }
+    size_t size = 0;
+    VkResult res = vkGetPipelineCacheData(device, library.cache, &size, nullptr);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    std::vector<char> data(size);
+    if ((res = vkGetPipelineCacheData(device, library.cache, &size, data.data())) != VK_SUCCESS) {
+        return res;
+    }
+    data.resize(size);
+
+    PipelineCacheFileHeader header = {
+        .magic = PIPELINE_CACHE_MAGIC,
+        .version = PIPELINE_CACHE_VERSION,
+        .vendorID = library.vendorID,
+        .deviceID = library.deviceID,
+        .driverVersion = library.driverVersion,
+        .reserved = 0,
+        .pipelineCacheUUID = {},
+        .dataSize = size,
+        .dataHash = hashBytes(data.data(), size)
+    };
+    memcpy(header.pipelineCacheUUID, library.pipelineCacheUUID, VK_UUID_SIZE);
+
+    std::string tmpPath = library.cachePath + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(data.data(), data.size());
+        if (!out) {
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+    }
+    return rename(tmpPath.c_str(), library.cachePath.c_str()) == 0 ? VK_SUCCESS : VK_ERROR_INITIALIZATION_FAILED;
+}
+
+void destroyPipelineLibrary (VkDevice device, PipelineLibrary *library) {
+    for (auto& entry : library->pipelines) {
+        vkDestroyPipeline(device, entry.second, hostAllocator());
+    }
+    for (auto& entry : library->shaders) {
+        vkDestroyShaderModule(device, entry.second.module, hostAllocator());
+    }
+    library->pipelines.clear();
+    library->shaders.clear();
+    vkDestroyPipelineCache(device, library->cache, hostAllocator());
+    library->cache = VK_NULL_HANDLE;
+}
+
+static VkResult createShaderModule (VkDevice device, const std::string& path, ShaderModule *shader) {
+    std::vector<char> code;
+    if (!readFile(path, code) || code.empty() || code.size() % 4 != 0) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    shader->codeHash = hashBytes(code.data(), code.size());
+    VkShaderModuleCreateInfo moduleCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .codeSize = code.size(),
+        .pCode = reinterpret_cast<const uint32_t*>(code.data())
+    };
+    return vkCreateShaderModule(device, &moduleCreateInfo, hostAllocator(), &shader->module);
+}
+
+// Returned by value, a reload may replace the map entry while the caller still uses it
+static ShaderModule getShaderModule (VkDevice device, PipelineLibrary *library, const std::string& path) {
+    std::lock_guard<std::mutex> lock(library->mutex);
+    auto it = library->shaders.find(path);
+    if (it != library->shaders.end()) {
+        return it->second;
+    }
+
+    ShaderModule shader;
+    ASSERT_RESULT(createShaderModule(device, path, &shader), VK_SUCCESS, ("Failed to create shader module for \"" + path + "\"").c_str());
+    return library->shaders.emplace(path, shader).first->second;
+}
+
+VkResult reloadShaderModule (VkDevice device, PipelineLibrary *library, const std::string& path) {
+    ShaderModule shader;
+    VkResult res = createShaderModule(device, path, &shader);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    std::lock_guard<std::mutex> lock(library->mutex);
+    auto inserted = library->shaders.emplace(path, shader);
+    if (!inserted.second) {
+        // Pipelines do not reference their modules once created
+        vkDestroyShaderModule(device, inserted.first->second.module, hostAllocator());
+        inserted.first->second = shader;
+    }
+    return VK_SUCCESS;
+}
+
+VkPipeline takePipeline (PipelineLibrary *library, uint64_t key) {
+    std::lock_guard<std::mutex> lock(library->mutex);
+    auto it = library->pipelines.find(key);
+    if (it == library->pipelines.end()) {
+        return VK_NULL_HANDLE;
+    }
+    VkPipeline pipeline = it->second;
+    library->pipelines.erase(it);
+    return pipeline;
+}
+
+// Every constant is a 32 bit value, packed in the order they are listed
+static const VkSpecializationInfo *specializationInfo (const std::vector<SpecializationConstant>& constants, std::vector<VkSpecializationMapEntry>& entries,
+        VkSpecializationInfo *info) {
+    if (constants.empty()) {
+        return nullptr;
+    }
+    entries.clear();
+    for (uint32_t i = 0; i < constants.size(); i++) {
+        uint32_t offset = static_cast<uint32_t>(i * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value));
+        entries.push_back({ constants[i].id, offset, sizeof(uint32_t) });
+    }
+    info->mapEntryCount = static_cast<uint32_t>(entries.size());
+    info->pMapEntries = entries.data();
+    info->dataSize = constants.size() * sizeof(SpecializationConstant);
+    info->pData = constants.data();
+    return info;
+}
+
+template<typename T>
+static uint64_t hashValue (const T& value, uint64_t seed) {
+    return hashBytes(&value, sizeof(value), seed);
+}
+
+static uint64_t hashSpecialization (const std::vector<SpecializationConstant>& constants, uint64_t seed) {
+    for (const SpecializationConstant& constant : constants) {
+        seed = hashValue(constant.id, seed);
+        seed = hashValue(constant.value, seed);
+    }
+    return seed;
+}
+
+static bool findPipeline (PipelineLibrary *library, uint64_t key, VkPipeline *pipeline) {
+    std::lock_guard<std::mutex> lock(library->mutex);
+    auto it = library->pipelines.find(key);
+    if (it == library->pipelines.end()) {
+        return false;
+    }
+    *pipeline = it->second;
+    return true;
+}
+
+// Another thread may have compiled the same pipeline in the meantime, the first one to finish wins
+static void insertPipeline (VkDevice device, PipelineLibrary *library, uint64_t key, VkPipeline *pipeline) {
+    std::lock_guard<std::mutex> lock(library->mutex);
+    auto inserted = library->pipelines.emplace(key, *pipeline);
+    if (!inserted.second) {
+        vkDestroyPipeline(device, *pipeline, hostAllocator());
+        *pipeline = inserted.first->second;
+    }
+}
+
+uint64_t hashPipelineDesc (VkDevice device, PipelineLibrary *library, const GraphicsPipelineDesc& desc) {
+    // Hash field by field so struct padding never leaks into the key
+    uint64_t hash = HASH_SEED;
+    hash = hashValue(getShaderModule(device, library, desc.vertexShader).codeHash, hash);
+    hash = hashValue(getShaderModule(device, library, desc.fragmentShader).codeHash, hash);
+    hash = hashValue(desc.topology, hash);
+    hash = hashValue(desc.polygonMode, hash);
+    hash = hashValue(desc.cullMode, hash);
+    hash = hashValue(desc.frontFace, hash);
+    hash = hashValue(desc.blendEnable, hash);
+    hash = hashValue(desc.layout, hash);
+    hash = hashValue(desc.renderPass, hash);
+    hash = hashValue(desc.subpass, hash);
+    hash = hashSpecialization(desc.specialization, hash);
+    return hash;
+}
+
+VkResult getGraphicsPipeline (VkDevice device, PipelineLibrary *library, const GraphicsPipelineDesc& desc, VkPipeline *pipeline) {
+    uint64_t key = hashPipelineDesc(device, library, desc);
+    if (findPipeline(library, key, pipeline)) {
+        return VK_SUCCESS;
+    }
+
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    VkSpecializationInfo specialization;
+    const VkSpecializationInfo *stageSpecialization = specializationInfo(desc.specialization, specializationEntries, &specialization);
+    VkPipelineShaderStageCreateInfo stages[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = getShaderModule(device, library, desc.vertexShader).module,
+            .pName = "main",
+            .pSpecializationInfo = stageSpecialization
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = getShaderModule(device, library, desc.fragmentShader).module,
+            .pName = "main",
+            .pSpecializationInfo = stageSpecialization
+        }
+    };
+    VkPipelineVertexInputStateCreateInfo vertexInputState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .vertexBindingDescriptionCount = 0,
+        .pVertexBindingDescriptions = nullptr,
+        .vertexAttributeDescriptionCount = 0,
+        .pVertexAttributeDescriptions = nullptr
+    };
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .topology = desc.topology,
+        .primitiveRestartEnable = VK_FALSE
+    };
+    // Viewport and scissor are dynamic so pipelines survive swapchain resizes
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .viewportCount = 1,
+        .pViewports = nullptr,
+        .scissorCount = 1,
+        .pScissors = nullptr
+    };
+    VkPipelineRasterizationStateCreateInfo rasterizationState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = desc.polygonMode,
+        .cullMode = desc.cullMode,
+        .frontFace = desc.frontFace,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0.0f,
+        .depthBiasClamp = 0.0f,
+        .depthBiasSlopeFactor = 0.0f,
+        .lineWidth = 1.0f
+    };
+    VkPipelineMultisampleStateCreateInfo multisampleState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE,
+        .minSampleShading = 0.0f,
+        .pSampleMask = nullptr,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE
+    };
+    VkPipelineColorBlendAttachmentState blendAttachment = {
+        .blendEnable = desc.blendEnable,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+    };
+    VkPipelineColorBlendStateCreateInfo colorBlendState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_COPY,
+        .attachmentCount = 1,
+        .pAttachments = &blendAttachment,
+        .blendConstants = { 0.0f, 0.0f, 0.0f, 0.0f }
+    };
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamicStates
+    };
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .stageCount = 2,
+        .pStages = stages,
+        .pVertexInputState = &vertexInputState,
+        .pInputAssemblyState = &inputAssemblyState,
+        .pTessellationState = nullptr,
+        .pViewportState = &viewportState,
+        .pRasterizationState = &rasterizationState,
+        .pMultisampleState = &multisampleState,
+        .pDepthStencilState = nullptr,
+        .pColorBlendState = &colorBlendState,
+        .pDynamicState = &dynamicState,
+        .layout = desc.layout,
+        .renderPass = desc.renderPass,
+        .subpass = desc.subpass,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1
+    };
+    VkResult res = vkCreateGraphicsPipelines(device, library->cache, 1, &pipelineCreateInfo, hostAllocator(), pipeline);
+    if (res == VK_SUCCESS) {
+        insertPipeline(device, library, key, pipeline);
+    }
+    return res;
+}
+
+uint64_t hashPipelineDesc (VkDevice device, PipelineLibrary *library, const ComputePipelineDesc& desc) {
+    // Graphics and compute pipelines share one map, the stage keeps their keys apart
+    uint64_t hash = hashValue(VK_SHADER_STAGE_COMPUTE_BIT, HASH_SEED);
+    hash = hashValue(getShaderModule(device, library, desc.computeShader).codeHash, hash);
+    hash = hashValue(desc.layout, hash);
+    hash = hashSpecialization(desc.specialization, hash);
+    return hash;
+}
+
+VkResult getComputePipeline (VkDevice device, PipelineLibrary *library, const ComputePipelineDesc& desc, VkPipeline *pipeline) {
+    uint64_t key = hashPipelineDesc(device, library, desc);
+    if (findPipeline(library, key, pipeline)) {
+        return VK_SUCCESS;
+    }
+
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    VkSpecializationInfo specialization;
+    VkComputePipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = getShaderModule(device, library, desc.computeShader).module,
+            .pName = "main",
+            .pSpecializationInfo = specializationInfo(desc.specialization, specializationEntries, &specialization)
+        },
+        .layout = desc.layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1
+    };
+    VkResult res = vkCreateComputePipelines(device, library->cache, 1, &pipelineCreateInfo, hostAllocator(), pipeline);
+    if (res == VK_SUCCESS) {
+        insertPipeline(device, library, key, pipeline);
+    }
+    return res;
+}
+
+VkResult createRenderPass (VkDevice device, VkFormat format, VkRenderPass *renderPass) {
+    // Starts and ends in the subpass layout, the render graph transitions the image around the pass and synchronizes it
+    // with the passes before and after, so there are no external dependencies either
+    VkAttachmentDescription colorAttachment = {
+        .flags = 0,
+        .format = format,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    };
+    VkAttachmentReference colorReference = {
+        .attachment = 0,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    };
+    VkSubpassDescription subpass = {
+        .flags = 0,
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .inputAttachmentCount = 0,
+        .pInputAttachments = nullptr,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorReference,
+        .pResolveAttachments = nullptr,
+        .pDepthStencilAttachment = nullptr,
+        .preserveAttachmentCount = 0,
+        .pPreserveAttachments = nullptr
+    };
+    VkRenderPassCreateInfo renderPassCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .attachmentCount = 1,
+        .pAttachments = &colorAttachment,
+        .subpassCount = 1,
+        .pSubpasses = &subpass,
+        .dependencyCount = 0,
+        .pDependencies = nullptr
+    };
+    return vkCreateRenderPass(device, &renderPassCreateInfo, hostAllocator(), renderPass);
+}
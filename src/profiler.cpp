@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <sys/resource.h>
+
+#include "hostAllocator.h"
+#include "profiler.h"
+#include "vulkanUtils.h"
+
+static const char *scopeNames[CPU_SCOPE_COUNT] = { "events", "acquire", "record", "submit", "fence wait", "present" };
+
+static int64_t now (const Profiler *profiler) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler->origin).count();
+}
+
+static FrameSample& currentSample (Profiler *profiler) {
+    return profiler->samples[profiler->frameCount % PROFILER_HISTORY];
+}
+
+VkResult createProfiler (VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t slotCount, Profiler *profiler) {
+    profiler->samples.assign(PROFILER_HISTORY, FrameSample());
+    profiler->slotFrame.assign(slotCount, -1);
+    profiler->frameCount = 0;
+    profiler->inputLatency.assign(PROFILER_HISTORY, 0);
+    profiler->inputCount = 0;
+    profiler->origin = std::chrono::steady_clock::now();
+    profiler->queryPool = VK_NULL_HANDLE;
+    profiler->gpuTimestamps = false;
+    profiler->gpuOffsetKnown = false;
+    profiler->gpuOffset = 0;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties;
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    queueFamilyProperties.resize(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties.data());
+
+    uint32_t validBits = queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+    if (validBits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+        log("Queue family does not support timestamps, GPU timings will not be available");
+        return VK_SUCCESS;
+    }
+    profiler->timestampPeriod = properties.limits.timestampPeriod;
+    profiler->timestampMask = (validBits >= 64 ? UINT64_MAX : ((1ull << validBits) - 1));
+
+    // Two queries per frame slot: top and bottom of the slot's command buffer
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = slotCount * 2,
+        .pipelineStatistics = 0
+    };
+    VkResult res = vkCreateQueryPool(device, &queryPoolCreateInfo, hostAllocator(), &profiler->queryPool);
+    profiler->gpuTimestamps = (res == VK_SUCCESS);
+    return res;
+}
+
+void destroyProfiler (VkDevice device, Profiler *profiler) {
+    if (profiler->queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, profiler->queryPool, hostAllocator());
+        profiler->queryPool = VK_NULL_HANDLE;
+    }
+}
+
+void profilerBeginFrame (Profiler *profiler, uint64_t frameNumber) {
+    FrameSample& sample = currentSample(profiler);
+    sample.frameNumber = frameNumber;
+    sample.frameStart = now(profiler);
+    sample.frameEnd = -1;
+    for (uint32_t i = 0; i < CPU_SCOPE_COUNT; i++) {
+        sample.scopeStart[i] = -1;
+        sample.scopeEnd[i] = -1;
+    }
+    sample.gpuStart = -1;
+    sample.gpuEnd = -1;
+    sample.textureBytes = 0;
+}
+
+void profilerEndFrame (Profiler *profiler) {
+    currentSample(profiler).frameEnd = now(profiler);
+    profiler->frameCount++;
+}
+
+void profilerBeginScope (Profiler *profiler, CpuScope scope) {
+    currentSample(profiler).scopeStart[scope] = now(profiler);
+}
+
+void profilerEndScope (Profiler *profiler, CpuScope scope) {
+    currentSample(profiler).scopeEnd[scope] = now(profiler);
+}
+
+void profilerInputLatency (Profiler *profiler, int64_t latency) {
+    profiler->inputLatency[profiler->inputCount % PROFILER_HISTORY] = latency;
+    profiler->inputCount++;
+}
+
+void profilerTextureMemory (Profiler *profiler, uint64_t bytes) {
+    currentSample(profiler).textureBytes = bytes;
+}
+
+void profilerCmdBegin (Profiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot) {
+    if (!profiler->gpuTimestamps) {
+        return;
+    }
+    vkCmdResetQueryPool(cmdBuffer, profiler->queryPool, slot * 2, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->queryPool, slot * 2);
+    profiler->slotFrame[slot] = static_cast<int64_t>(profiler->frameCount);
+}
+
+void profilerCmdEnd (Profiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot) {
+    if (!profiler->gpuTimestamps) {
+        return;
+    }
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->queryPool, slot * 2 + 1);
+}
+
+void profilerCollect (Profiler *profiler, VkDevice device, uint32_t slot) {
+    int64_t frame = profiler->slotFrame[slot];
+    if (!profiler->gpuTimestamps || frame < 0) {
+        return;
+    }
+    profiler->slotFrame[slot] = -1;
+    // The frame may have been pushed out of the ring by now if the history is shorter than the ring depth
+    if (profiler->frameCount - static_cast<uint64_t>(frame) >= PROFILER_HISTORY) {
+        return;
+    }
+
+    uint64_t timestamps[2];
+    VkResult res = vkGetQueryPoolResults(device, profiler->queryPool, slot * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+    if (res != VK_SUCCESS) {
+        return;
+    }
+    FrameSample& sample = profiler->samples[frame % PROFILER_HISTORY];
+    int64_t start = static_cast<int64_t>((timestamps[0] & profiler->timestampMask) * profiler->timestampPeriod);
+    int64_t duration = static_cast<int64_t>(((timestamps[1] - timestamps[0]) & profiler->timestampMask) * profiler->timestampPeriod);
+    if (!profiler->gpuOffsetKnown) {
+        // Work can't start before it was submitted, so the end of the first submit is a decent anchor
+        int64_t submitted = sample.scopeEnd[CPU_SCOPE_SUBMIT] >= 0 ? sample.scopeEnd[CPU_SCOPE_SUBMIT] : sample.frameStart;
+        profiler->gpuOffset = submitted - start;
+        profiler->gpuOffsetKnown = true;
+    }
+    sample.gpuStart = start + profiler->gpuOffset;
+    sample.gpuEnd = sample.gpuStart + duration;
+}
+
+static uint64_t retainedFrames (const Profiler& profiler) {
+    return std::min<uint64_t>(profiler.frameCount, PROFILER_HISTORY);
+}
+
+static double percentile (std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * (values.size() - 1) + 0.5));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// CPU frame times and GPU times in milliseconds over the retained history, returns the peak of resident texture memory
+static uint64_t collectFrameTimes (const Profiler& profiler, std::vector<double> *frameTimes, std::vector<double> *gpuTimes) {
+    uint64_t count = retainedFrames(profiler);
+    uint64_t first = profiler.frameCount - count;
+    // Frame time is measured start to start so that it includes everything the loop does
+    for (uint64_t i = first + 1; i < profiler.frameCount; i++) {
+        const FrameSample& previous = profiler.samples[(i - 1) % PROFILER_HISTORY];
+        const FrameSample& sample = profiler.samples[i % PROFILER_HISTORY];
+        frameTimes->push_back((sample.frameStart - previous.frameStart) / 1e6);
+    }
+    uint64_t peakTextureBytes = 0;
+    for (uint64_t i = first; i < profiler.frameCount; i++) {
+        const FrameSample& sample = profiler.samples[i % PROFILER_HISTORY];
+        if (sample.gpuStart >= 0) {
+            gpuTimes->push_back((sample.gpuEnd - sample.gpuStart) / 1e6);
+        }
+        peakTextureBytes = std::max(peakTextureBytes, sample.textureBytes);
+    }
+    return peakTextureBytes;
+}
+
+void profilerReport (const Profiler& profiler) {
+    std::vector<double> frameTimes, gpuTimes;
+    uint64_t count = retainedFrames(profiler);
+    uint64_t peakTextureBytes = collectFrameTimes(profiler, &frameTimes, &gpuTimes);
+
+    std::ostringstream report;
+    report.precision(3);
+    report << std::fixed << "Frame times over the last " << frameTimes.size() << " frames: p50 " << percentile(frameTimes, 0.50) << " ms, p95 "
+        << percentile(frameTimes, 0.95) << " ms, p99 " << percentile(frameTimes, 0.99) << " ms";
+    log(report.str().c_str());
+    if (!gpuTimes.empty()) {
+        report.str("");
+        report << "GPU times over the last " << gpuTimes.size() << " frames: p50 " << percentile(gpuTimes, 0.50) << " ms, p95 "
+            << percentile(gpuTimes, 0.95) << " ms, p99 " << percentile(gpuTimes, 0.99) << " ms";
+        log(report.str().c_str());
+    }
+    if (profiler.inputCount > 0) {
+        std::vector<double> latencies;
+        for (uint64_t i = 0; i < std::min<uint64_t>(profiler.inputCount, PROFILER_HISTORY); i++) {
+            latencies.push_back(profiler.inputLatency[i] / 1e6);
+        }
+        report.str("");
+        report << "Input to submit latency over the last " << latencies.size() << " inputs: p50 " << percentile(latencies, 0.50) << " ms, p95 "
+            << percentile(latencies, 0.95) << " ms, p99 " << percentile(latencies, 0.99) << " ms";
+        log(report.str().c_str());
+    }
+    if (peakTextureBytes > 0) {
+        report.str("");
+        report << "Resident texture memory over the last " << count << " frames: peak " << peakTextureBytes / 1048576.0 << " MiB, last "
+            << profiler.samples[(profiler.frameCount - 1) % PROFILER_HISTORY].textureBytes / 1048576.0 << " MiB";
+        log(report.str().c_str());
+    }
+}
+
+bool profilerExportChromeTrace (const Profiler& profiler, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    uint64_t count = retainedFrames(profiler);
+    bool firstEvent = true;
+    auto writeEvent = [&out, &firstEvent] (const char *name, int tid, int64_t start, int64_t end, uint64_t frame) {
+        out << (firstEvent ? "\n" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << start / 1000.0
+            << ",\"dur\":" << (end - start) / 1000.0 << ",\"args\":{\"frame\":" << frame << "}}";
+        firstEvent = false;
+    };
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    out << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},";
+    out << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    firstEvent = false;
+    for (uint64_t i = profiler.frameCount - count; i < profiler.frameCount; i++) {
+        const FrameSample& sample = profiler.samples[i % PROFILER_HISTORY];
+        if (sample.frameEnd >= 0) {
+            writeEvent("frame", 1, sample.frameStart, sample.frameEnd, sample.frameNumber);
+        }
+        for (uint32_t scope = 0; scope < CPU_SCOPE_COUNT; scope++) {
+            if (sample.scopeStart[scope] >= 0 && sample.scopeEnd[scope] >= 0) {
+                writeEvent(scopeNames[scope], 1, sample.scopeStart[scope], sample.scopeEnd[scope], sample.frameNumber);
+            }
+        }
+        if (sample.gpuStart >= 0) {
+            writeEvent("gpu frame", 2, sample.gpuStart, sample.gpuEnd, sample.frameNumber);
+        }
+        if (sample.textureBytes > 0) {
+            out << ",\n{\"name\":\"texture memory\",\"ph\":\"C\",\"pid\":1,\"ts\":" << sample.frameStart / 1000.0 << ",\"args\":{\"MiB\":"
+                << sample.textureBytes / 1048576.0 << "}}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+bool profilerExportCsv (const Profiler& profiler, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "frame,cpu_ms";
+    for (uint32_t scope = 0; scope < CPU_SCOPE_COUNT; scope++) {
+        std::string name = scopeNames[scope];
+        std::replace(name.begin(), name.end(), ' ', '_');
+        out << "," << name << "_ms";
+    }
+    out << ",gpu_ms,texture_mib\n";
+
+    uint64_t count = retainedFrames(profiler);
+    for (uint64_t i = profiler.frameCount - count; i < profiler.frameCount; i++) {
+        const FrameSample& sample = profiler.samples[i % PROFILER_HISTORY];
+        out << sample.frameNumber << "," << (sample.frameEnd - sample.frameStart) / 1e6;
+        for (uint32_t scope = 0; scope < CPU_SCOPE_COUNT; scope++) {
+            out << ",";
+            if (sample.scopeStart[scope] >= 0 && sample.scopeEnd[scope] >= 0) {
+                out << (sample.scopeEnd[scope] - sample.scopeStart[scope]) / 1e6;
+            }
+        }
+        out << ",";
+        if (sample.gpuStart >= 0) {
+            out << (sample.gpuEnd - sample.gpuStart) / 1e6;
+        }
+        out << "," << sample.textureBytes / 1048576.0 << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+bool profilerExportBenchmark (const Profiler& profiler, const StartupTimer& startup, uint64_t frames, double seconds, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    std::vector<double> frameTimes, gpuTimes;
+    collectFrameTimes(profiler, &frameTimes, &gpuTimes);
+    // ru_maxrss is in kilobytes on Linux
+    struct rusage usage;
+    double peakMemory = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss / 1024.0 : 0.0;
+
+    out.precision(3);
+    out << std::fixed << "{\n";
+    out << "  \"frames\": " << frames << ",\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+    out << "  \"fps\": " << (seconds > 0.0 ? frames / seconds : 0.0) << ",\n";
+    out << "  \"frame_ms_p50\": " << percentile(frameTimes, 0.50) << ",\n";
+    out << "  \"frame_ms_p95\": " << percentile(frameTimes, 0.95) << ",\n";
+    out << "  \"frame_ms_p99\": " << percentile(frameTimes, 0.99) << ",\n";
+    if (!gpuTimes.empty()) {
+        out << "  \"gpu_ms_p50\": " << percentile(gpuTimes, 0.50) << ",\n";
+        out << "  \"gpu_ms_p95\": " << percentile(gpuTimes, 0.95) << ",\n";
+        out << "  \"gpu_ms_p99\": " << percentile(gpuTimes, 0.99) << ",\n";
+    }
+    out << "  \"startup_ms\": " << std::chrono::duration<double, std::milli>(startup.last - startup.start).count() << ",\n";
+    out << "  \"peak_memory_mib\": " << peakMemory << "\n";
+    out << "}\n";
+    return static_cast<bool>(out);
+}
+
+void startupBegin (StartupTimer *timer) {
+    timer->start = std::chrono::steady_clock::now();
+    timer->last = timer->start;
+    timer->phases.clear();
+}
+
+void startupMark (StartupTimer *timer, const char *phase) {
+    std::chrono::steady_clock::time_point mark = std::chrono::steady_clock::now();
+    timer->phases.push_back({ phase, std::chrono::duration<double, std::milli>(mark - timer->last).count() });
+    timer->last = mark;
+}
+
+void startupReport (const StartupTimer& timer) {
+    std::ostringstream report;
+    report.precision(2);
+    report << std::fixed << "Time to first frame " << std::chrono::duration<double, std::milli>(timer.last - timer.start).count() << " ms:";
+    for (const std::pair<const char*, double>& phase : timer.phases) {
+        report << "\n  " << phase.first << " " << phase.second << " ms";
+    }
+    log(report.str().c_str());
+}
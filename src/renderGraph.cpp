@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <numeric>
+#include <string>
+
+#include "hostAllocator.h"
+#include "renderGraph.h"
+#include "vulkanUtils.h"
+
+struct UsageInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    bool write;
+    // Also reads the previous contents, so earlier writers stay needed
+    bool read;
+    // Overwrites every texel, the previous contents can be discarded in a layout transition
+    bool discard;
+};
+
+static const UsageInfo usageInfos[GRAPH_USAGE_COUNT] = {
+    { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, false, false, false },
+    { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, false, false, false },
+    { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, false, true },
+    { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, true, false },
+    { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false, true, false },
+    { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true, true, false },
+    { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, true, false },
+    { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, true, false },
+    { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, true, false },
+    { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, true, false },
+    { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, false, false },
+    { VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false, true, false },
+    { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false, true, false }
+};
+
+// Everything the write accesses can be, transients inherit these from whatever used their memory before
+static const VkAccessFlags writeAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+static uint32_t addResource (RenderGraph *graph, VkImage image, VkBuffer buffer, VkImageAspectFlags aspect, GraphUsage initialUsage,
+        GraphUsage finalUsage, bool output, uint32_t transient) {
+    GraphResource resource = {};
+    resource.image = image;
+    resource.buffer = buffer;
+    resource.aspect = aspect;
+    resource.initialUsage = initialUsage;
+    resource.finalUsage = finalUsage;
+    resource.output = output;
+    resource.transient = transient;
+    graph->resources.push_back(resource);
+    return static_cast<uint32_t>(graph->resources.size() - 1);
+}
+
+void createRenderGraph (MemoryAllocator *allocator, RenderGraph *graph) {
+    graph->allocator = allocator;
+    graph->passCount = 0;
+    graph->transientMemory = {};
+    graph->unaliasedBytes = 0;
+    graph->culledPasses = 0;
+    graph->barrierBatches = 0;
+}
+
+static void retireTransients (RenderGraph *graph, uint64_t frameNumber) {
+    if (graph->transients.empty()) {
+        return;
+    }
+    RetiredTransients retired;
+    for (const TransientImage& transient : graph->transients) {
+        retired.images.push_back(transient.image);
+        retired.views.push_back(transient.view);
+        retired.framebuffers.push_back(transient.framebuffer);
+    }
+    retired.memory = graph->transientMemory;
+    retired.retiredAtFrame = frameNumber;
+    graph->retired.push_back(retired);
+    graph->transients.clear();
+    graph->transientMemory = {};
+}
+
+void releaseRenderGraphTransients (RenderGraph *graph, uint64_t framesCompleted) {
+    VkDevice device = graph->allocator->device;
+    for (uint32_t i = 0; i < graph->retired.size();) {
+        RetiredTransients& retired = graph->retired[i];
+        if (retired.retiredAtFrame >= framesCompleted) {
+            i++;
+            continue;
+        }
+        for (VkFramebuffer framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, hostAllocator());
+        }
+        for (VkImageView view : retired.views) {
+            vkDestroyImageView(device, view, hostAllocator());
+        }
+        for (VkImage image : retired.images) {
+            vkDestroyImage(device, image, hostAllocator());
+        }
+        freeMemory(graph->allocator, &retired.memory);
+        graph->retired[i] = graph->retired.back();
+        graph->retired.pop_back();
+    }
+}
+
+void destroyRenderGraph (RenderGraph *graph) {
+    retireTransients(graph, 0);
+    releaseRenderGraphTransients(graph, UINT64_MAX);
+}
+
+void beginRenderGraph (RenderGraph *graph) {
+    graph->resources.clear();
+    graph->declaredTransients.clear();
+    // Passes keep their use lists so steady state frames do not allocate
+    graph->passCount = 0;
+}
+
+uint32_t importImage (RenderGraph *graph, VkImage image, VkImageAspectFlags aspect, GraphUsage initialUsage, GraphUsage finalUsage, bool output) {
+    return addResource(graph, image, VK_NULL_HANDLE, aspect, initialUsage, finalUsage, output, GRAPH_NONE);
+}
+
+uint32_t importBuffer (RenderGraph *graph, VkBuffer buffer, GraphUsage finalUsage, bool output) {
+    return addResource(graph, VK_NULL_HANDLE, buffer, 0, GRAPH_USAGE_NONE, finalUsage, output, GRAPH_NONE);
+}
+
+uint32_t createTransientImage (RenderGraph *graph, const VkImageCreateInfo& createInfo, VkRenderPass renderPass) {
+    graph->declaredTransients.push_back({ createInfo, renderPass });
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    if (createInfo.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+        aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    }
+    return addResource(graph, VK_NULL_HANDLE, VK_NULL_HANDLE, aspect, GRAPH_USAGE_NONE, GRAPH_USAGE_NONE, false,
+            static_cast<uint32_t>(graph->declaredTransients.size() - 1));
+}
+
+uint32_t addGraphPass (RenderGraph *graph, const char *name, GraphPassFunction function, void *data) {
+    if (graph->passCount == graph->passes.size()) {
+        graph->passes.emplace_back();
+    }
+    GraphPass& pass = graph->passes[graph->passCount];
+    pass.name = name;
+    pass.function = function;
+    pass.data = data;
+    pass.uses.clear();
+    pass.culled = false;
+    return graph->passCount++;
+}
+
+void useGraphResource (RenderGraph *graph, uint32_t pass, uint32_t resource, GraphUsage usage) {
+    graph->passes[pass].uses.push_back({ resource, usage });
+}
+
+// Walks the passes backwards: a pass survives if it writes something a later survivor or the outside world reads
+static void cullPasses (RenderGraph *graph) {
+    for (GraphResource& resource : graph->resources) {
+        resource.needed = resource.output;
+        resource.firstPass = GRAPH_NONE;
+        resource.lastPass = GRAPH_NONE;
+    }
+    for (uint32_t i = graph->passCount; i-- > 0;) {
+        GraphPass& pass = graph->passes[i];
+        pass.culled = true;
+        for (const GraphResourceUse& use : pass.uses) {
+            if (usageInfos[use.usage].write && graph->resources[use.resource].needed) {
+                pass.culled = false;
+            }
+        }
+        if (pass.culled) {
+            graph->culledPasses++;
+            continue;
+        }
+        // Overwritten contents are no longer needed from earlier passes, read contents are
+        for (const GraphResourceUse& use : pass.uses) {
+            if (usageInfos[use.usage].write && !usageInfos[use.usage].read) {
+                graph->resources[use.resource].needed = false;
+            }
+        }
+        for (const GraphResourceUse& use : pass.uses) {
+            GraphResource& resource = graph->resources[use.resource];
+            if (usageInfos[use.usage].read) {
+                resource.needed = true;
+            }
+            resource.firstPass = i;
+            if (resource.lastPass == GRAPH_NONE) {
+                resource.lastPass = i;
+            }
+        }
+    }
+}
+
+static bool sameImage (const TransientImage& transient, const TransientDesc& desc) {
+    const VkImageCreateInfo& a = transient.createInfo;
+    const VkImageCreateInfo& b = desc.createInfo;
+    return transient.renderPass == desc.renderPass && a.flags == b.flags && a.imageType == b.imageType && a.format == b.format && a.extent.width == b.extent.width &&
+        a.extent.height == b.extent.height && a.extent.depth == b.extent.depth && a.mipLevels == b.mipLevels && a.arrayLayers == b.arrayLayers &&
+        a.samples == b.samples && a.tiling == b.tiling && a.usage == b.usage;
+}
+
+static bool lifetimesOverlap (const TransientImage& a, const TransientImage& b) {
+    // Transients no pass uses any more overlap with nothing
+    if (a.firstPass == GRAPH_NONE || b.firstPass == GRAPH_NONE) {
+        return false;
+    }
+    return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+static bool memoryOverlaps (const TransientImage& a, const TransientImage& b) {
+    return a.offset < b.offset + b.requirements.size && b.offset < a.offset + a.requirements.size;
+}
+
+// Largest first, each image goes to the lowest offset that does not collide with an already placed image whose
+// lifetime overlaps with its own
+static VkResult placeTransients (RenderGraph *graph, uint64_t frameNumber) {
+    VkDevice device = graph->allocator->device;
+    retireTransients(graph, frameNumber);
+    graph->transients.resize(graph->declaredTransients.size());
+    VkMemoryRequirements combined = { 0, 1, ~0u };
+    graph->unaliasedBytes = 0;
+    for (uint32_t i = 0; i < graph->transients.size(); i++) {
+        TransientImage& transient = graph->transients[i];
+        transient.createInfo = graph->declaredTransients[i].createInfo;
+        transient.renderPass = graph->declaredTransients[i].renderPass;
+        transient.view = VK_NULL_HANDLE;
+        transient.framebuffer = VK_NULL_HANDLE;
+        transient.createInfo.pNext = nullptr;
+        transient.createInfo.queueFamilyIndexCount = 0;
+        transient.createInfo.pQueueFamilyIndices = nullptr;
+        transient.createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkResult res = vkCreateImage(device, &transient.createInfo, hostAllocator(), &transient.image);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+        vkGetImageMemoryRequirements(device, transient.image, &transient.requirements);
+        combined.alignment = std::max(combined.alignment, transient.requirements.alignment);
+        combined.memoryTypeBits &= transient.requirements.memoryTypeBits;
+        graph->unaliasedBytes += transient.requirements.size;
+    }
+    for (const GraphResource& resource : graph->resources) {
+        if (resource.transient != GRAPH_NONE) {
+            graph->transients[resource.transient].firstPass = resource.firstPass;
+            graph->transients[resource.transient].lastPass = resource.lastPass;
+        }
+    }
+    if (combined.memoryTypeBits == 0) {
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    std::vector<uint32_t> order(graph->transients.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [graph] (uint32_t a, uint32_t b) {
+        return graph->transients[a].requirements.size > graph->transients[b].requirements.size;
+    });
+    for (uint32_t i = 0; i < order.size(); i++) {
+        TransientImage& transient = graph->transients[order[i]];
+        transient.offset = 0;
+        for (bool moved = true; moved;) {
+            moved = false;
+            for (uint32_t j = 0; j < i; j++) {
+                const TransientImage& placed = graph->transients[order[j]];
+                if (lifetimesOverlap(transient, placed) && memoryOverlaps(transient, placed)) {
+                    VkDeviceSize end = placed.offset + placed.requirements.size;
+                    VkDeviceSize alignment = transient.requirements.alignment;
+                    transient.offset = (end + alignment - 1) / alignment * alignment;
+                    moved = true;
+                }
+            }
+        }
+        combined.size = std::max(combined.size, transient.offset + transient.requirements.size);
+    }
+    if (graph->transients.empty()) {
+        return VK_SUCCESS;
+    }
+
+    // Software implementations might not advertise device local memory at all, so it is only preferred
+    VkResult res = allocateMemory(graph->allocator, combined, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_PERSISTENT, RESOURCE_OPTIMAL,
+            &graph->transientMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    for (TransientImage& transient : graph->transients) {
+        if ((res = vkBindImageMemory(device, transient.image, graph->transientMemory.memory, graph->transientMemory.offset + transient.offset)) != VK_SUCCESS) {
+            return res;
+        }
+        // Views need the memory bound
+        if (transient.renderPass == VK_NULL_HANDLE) {
+            continue;
+        }
+        VkExtent2D extent = { transient.createInfo.extent.width, transient.createInfo.extent.height };
+        if ((res = createImageView(device, transient.image, transient.createInfo.format, &transient.view)) != VK_SUCCESS ||
+                (res = createFramebuffer(device, transient.renderPass, transient.view, extent, &transient.framebuffer)) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    log(("Render graph placed " + std::to_string(graph->transients.size()) + " transient images in " + std::to_string(combined.size) +
+                " bytes (" + std::to_string(graph->unaliasedBytes) + " bytes without aliasing)").c_str());
+    return VK_SUCCESS;
+}
+
+VkResult compileRenderGraph (RenderGraph *graph, uint64_t frameNumber) {
+    cullPasses(graph);
+
+    bool changed = graph->transients.size() != graph->declaredTransients.size();
+    for (uint32_t i = 0; !changed && i < graph->transients.size(); i++) {
+        changed = !sameImage(graph->transients[i], graph->declaredTransients[i]);
+    }
+    for (const GraphResource& resource : graph->resources) {
+        if (!changed && resource.transient != GRAPH_NONE) {
+            const TransientImage& transient = graph->transients[resource.transient];
+            changed = transient.firstPass != resource.firstPass || transient.lastPass != resource.lastPass;
+        }
+    }
+    if (changed) {
+        VkResult res = placeTransients(graph, frameNumber);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+        for (TransientImage& transient : graph->transients) {
+            transient.aliasStages = 0;
+            transient.aliasAccess = 0;
+        }
+        // Every use of memory an image shares has to be finished before its first use, this frame's and the last one's
+        for (uint32_t i = 0; i < graph->passCount; i++) {
+            const GraphPass& pass = graph->passes[i];
+            for (uint32_t j = 0; !pass.culled && j < pass.uses.size(); j++) {
+                uint32_t used = graph->resources[pass.uses[j].resource].transient;
+                if (used == GRAPH_NONE) {
+                    continue;
+                }
+                for (TransientImage& transient : graph->transients) {
+                    if (memoryOverlaps(transient, graph->transients[used])) {
+                        transient.aliasStages |= usageInfos[pass.uses[j].usage].stages;
+                        transient.aliasAccess |= usageInfos[pass.uses[j].usage].access & writeAccessMask;
+                    }
+                }
+            }
+        }
+    }
+
+    for (GraphResource& resource : graph->resources) {
+        const UsageInfo& initial = usageInfos[resource.initialUsage];
+        resource.state = { initial.layout, 0, 0, initial.stages, 0, 0 };
+        if (resource.transient != GRAPH_NONE) {
+            const TransientImage& transient = graph->transients[resource.transient];
+            resource.image = transient.image;
+            resource.state = { VK_IMAGE_LAYOUT_UNDEFINED, transient.aliasStages, transient.aliasAccess, 0, 0, 0 };
+        }
+    }
+    return VK_SUCCESS;
+}
+
+VkImage graphImage (const RenderGraph& graph, uint32_t resource) {
+    return graph.resources[resource].image;
+}
+
+VkFramebuffer graphFramebuffer (const RenderGraph& graph, uint32_t resource) {
+    uint32_t transient = graph.resources[resource].transient;
+    return transient != GRAPH_NONE ? graph.transients[transient].framebuffer : VK_NULL_HANDLE;
+}
+
+struct BarrierBatch {
+    VkPipelineStageFlags srcStages;
+    VkPipelineStageFlags dstStages;
+    VkMemoryBarrier memory;
+};
+
+// Adds whatever the use needs to the batch: a layout transition, or waiting for earlier writes (read after write) or
+// earlier reads and writes (write after read, write after write). Reads after reads need nothing.
+static void addBarrier (RenderGraph *graph, GraphResource& resource, GraphUsage usage, BarrierBatch *batch) {
+    const UsageInfo& info = usageInfos[usage];
+    GraphResourceState& state = resource.state;
+    bool layoutChange = resource.image != VK_NULL_HANDLE && state.layout != info.layout;
+    VkPipelineStageFlags srcStages = 0;
+    VkAccessFlags srcAccess = 0;
+    bool barrier = false;
+    if (layoutChange || info.write) {
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+        barrier = layoutChange || srcStages != 0;
+    } else if (state.writeAccess != 0 && ((info.stages & ~state.visibleStages) != 0 || (info.access & ~state.visibleAccess) != 0)) {
+        srcStages = state.writeStages;
+        srcAccess = state.writeAccess;
+        barrier = true;
+    }
+
+    if (barrier) {
+        batch->srcStages |= srcStages;
+        batch->dstStages |= info.stages;
+        if (resource.image != VK_NULL_HANDLE) {
+            graph->imageBarriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = srcAccess,
+                .dstAccessMask = info.access,
+                .oldLayout = info.discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout,
+                .newLayout = info.layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = resource.image,
+                .subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS }
+            });
+        } else {
+            // Buffers all share one global memory barrier, it costs the same as a buffer barrier on current drivers
+            batch->memory.srcAccessMask |= srcAccess;
+            batch->memory.dstAccessMask |= info.access;
+        }
+    }
+
+    if (resource.image != VK_NULL_HANDLE) {
+        state.layout = info.layout;
+    }
+    if (info.write) {
+        state.writeStages = info.stages;
+        state.writeAccess = info.access & writeAccessMask;
+        state.readStages = 0;
+        state.visibleStages = 0;
+        state.visibleAccess = 0;
+    } else {
+        state.readStages |= info.stages;
+        if (barrier) {
+            state.visibleStages |= info.stages;
+            state.visibleAccess |= info.access;
+        }
+    }
+}
+
+static void flushBarriers (RenderGraph *graph, VkCommandBuffer cmdBuffer, BarrierBatch *batch) {
+    bool memory = batch->memory.srcAccessMask != 0 || batch->memory.dstAccessMask != 0;
+    if (batch->srcStages == 0 && batch->dstStages == 0 && graph->imageBarriers.empty()) {
+        return;
+    }
+    VkPipelineStageFlags srcStages = batch->srcStages != 0 ? batch->srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    VkPipelineStageFlags dstStages = batch->dstStages != 0 ? batch->dstStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    vkCmdPipelineBarrier(cmdBuffer, srcStages, dstStages, 0, memory ? 1 : 0, &batch->memory, 0, nullptr,
+            static_cast<uint32_t>(graph->imageBarriers.size()), graph->imageBarriers.data());
+    graph->barrierBatches++;
+    graph->imageBarriers.clear();
+    *batch = { 0, 0, { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, 0, 0 } };
+}
+
+void executeRenderGraph (RenderGraph *graph, VkCommandBuffer cmdBuffer) {
+    BarrierBatch batch = { 0, 0, { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, 0, 0 } };
+    for (uint32_t i = 0; i < graph->passCount; i++) {
+        const GraphPass& pass = graph->passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        for (const GraphResourceUse& use : pass.uses) {
+            addBarrier(graph, graph->resources[use.resource], use.usage, &batch);
+        }
+        flushBarriers(graph, cmdBuffer, &batch);
+        pass.function(cmdBuffer, pass.data);
+    }
+    // Hand the outputs over to whoever consumes them after the graph, all in one batch
+    for (GraphResource& resource : graph->resources) {
+        if (resource.finalUsage != GRAPH_USAGE_NONE) {
+            addBarrier(graph, resource, resource.finalUsage, &batch);
+        }
+    }
+    flushBarriers(graph, cmdBuffer, &batch);
+}
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+#include "hostAllocator.h"
+#include "logger.h"
+#include "shaderWatcher.h"
+#include "vulkanUtils.h"
+
+static int64_t modifiedTime (const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+static void watchShader (ShaderWatcher *watcher, const std::string& spirv) {
+    for (const WatchedShader& shader : watcher->shaders) {
+        if (shader.spirv == spirv) {
+            return;
+        }
+    }
+    WatchedShader shader;
+    shader.spirv = spirv;
+    shader.source = spirv.substr(0, spirv.size() - (spirv.size() > 4 && spirv.compare(spirv.size() - 4, 4, ".spv") == 0 ? 4 : 0));
+    shader.modified = modifiedTime(shader.source);
+    if (shader.modified < 0) {
+        // Prebuilt variants have no source of their own
+        logMessage(LOG_SEVERITY_DEBUG, ("Not watching \"" + spirv + "\", there is no source at \"" + shader.source + "\"").c_str());
+    }
+    watcher->shaders.push_back(shader);
+}
+
+// Compiled next to the old SPIR-V and renamed over it, so nothing ever reads a half written file
+static bool compileShader (const ShaderWatcher& watcher, const WatchedShader& shader) {
+    std::string output = shader.spirv + ".tmp";
+    std::string command = watcher.compiler + " -o \"" + output + "\" \"" + shader.source + "\" 2>&1";
+    FILE *pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+        logMessage(LOG_SEVERITY_WARNING, ("Failed to run \"" + command + "\"").c_str());
+        return false;
+    }
+    std::string messages;
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+        messages += buffer;
+    }
+    if (pclose(pipe) != 0) {
+        logMessage(LOG_SEVERITY_WARNING, ("Failed to compile \"" + shader.source + "\", keeping the old pipelines:\n" + messages).c_str());
+        remove(output.c_str());
+        return false;
+    }
+    return rename(output.c_str(), shader.spirv.c_str()) == 0;
+}
+
+static bool usesShader (const WatchedPipeline& watched, const std::vector<std::string>& changed) {
+    auto found = [&changed] (const std::string& path) {
+        return std::find(changed.begin(), changed.end(), path) != changed.end();
+    };
+    if (watched.compute) {
+        return found(watched.computeDesc.computeShader);
+    }
+    return found(watched.graphicsDesc.vertexShader) || found(watched.graphicsDesc.fragmentShader);
+}
+
+static void reloadChangedShaders (ShaderWatcher *watcher) {
+    std::vector<std::string> changed;
+    for (WatchedShader& shader : watcher->shaders) {
+        int64_t modified = modifiedTime(shader.source);
+        if (modified < 0 || modified == shader.modified) {
+            continue;
+        }
+        shader.modified = modified;
+        if (!compileShader(*watcher, shader)) {
+            watcher->failures.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (reloadShaderModule(watcher->device, watcher->library, shader.spirv) != VK_SUCCESS) {
+            logMessage(LOG_SEVERITY_WARNING, ("Failed to load the recompiled \"" + shader.spirv + "\"").c_str());
+            watcher->failures.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        changed.push_back(shader.spirv);
+    }
+    if (changed.empty()) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < watcher->pipelines.size(); i++) {
+        WatchedPipeline& watched = watcher->pipelines[i];
+        if (!usesShader(watched, changed)) {
+            continue;
+        }
+        // The library compiles against the persistent cache, so this is the only place that waits for the driver
+        uint64_t key;
+        VkPipeline pipeline;
+        VkResult res;
+        if (watched.compute) {
+            key = hashPipelineDesc(watcher->device, watcher->library, watched.computeDesc);
+            res = getComputePipeline(watcher->device, watcher->library, watched.computeDesc, &pipeline);
+        } else {
+            key = hashPipelineDesc(watcher->device, watcher->library, watched.graphicsDesc);
+            res = getGraphicsPipeline(watcher->device, watcher->library, watched.graphicsDesc, &pipeline);
+        }
+        if (res != VK_SUCCESS) {
+            logMessage(LOG_SEVERITY_WARNING, ("Failed to rebuild a pipeline after a shader change (" + std::to_string(res) + ")").c_str());
+            watcher->failures.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        // Saved without changing the code, the pipeline in use already is this one
+        if (key == watched.key) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(watcher->mutex);
+        watcher->ready.push_back({ i, pipeline, watched.key });
+        watcher->pending.store(true, std::memory_order_release);
+        watched.key = key;
+    }
+}
+
+static void watchShaders (ShaderWatcher *watcher) {
+    std::unique_lock<std::mutex> lock(watcher->mutex);
+    while (watcher->running) {
+        watcher->wake.wait_for(lock, std::chrono::milliseconds(SHADER_WATCH_INTERVAL_MS));
+        if (!watcher->running) {
+            break;
+        }
+        lock.unlock();
+        reloadChangedShaders(watcher);
+        lock.lock();
+    }
+}
+
+void createShaderWatcher (VkDevice device, PipelineLibrary *library, ShaderWatcher *watcher) {
+    const char *compiler = getenv("GLSLC");
+    watcher->device = device;
+    watcher->library = library;
+    watcher->compiler = std::string(compiler != nullptr ? compiler : DEFAULT_SHADER_COMPILER) + " " + SHADER_COMPILE_FLAGS;
+    watcher->running = false;
+    watcher->pending.store(false, std::memory_order_relaxed);
+    watcher->reloads.store(0, std::memory_order_relaxed);
+    watcher->failures.store(0, std::memory_order_relaxed);
+}
+
+void destroyShaderWatcher (ShaderWatcher *watcher) {
+    if (watcher->thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(watcher->mutex);
+            watcher->running = false;
+        }
+        watcher->wake.notify_one();
+        watcher->thread.join();
+    }
+    destroyRetiredPipelines(watcher, UINT64_MAX);
+    watcher->pipelines.clear();
+    watcher->shaders.clear();
+    watcher->ready.clear();
+}
+
+void watchGraphicsPipeline (ShaderWatcher *watcher, const GraphicsPipelineDesc& desc, VkPipeline *pipeline) {
+    WatchedPipeline watched;
+    watched.compute = false;
+    watched.graphicsDesc = desc;
+    watched.key = hashPipelineDesc(watcher->device, watcher->library, desc);
+    watched.pipeline = pipeline;
+    watcher->pipelines.push_back(watched);
+    watchShader(watcher, desc.vertexShader);
+    watchShader(watcher, desc.fragmentShader);
+}
+
+void watchComputePipeline (ShaderWatcher *watcher, const ComputePipelineDesc& desc, VkPipeline *pipeline) {
+    WatchedPipeline watched;
+    watched.compute = true;
+    watched.computeDesc = desc;
+    watched.key = hashPipelineDesc(watcher->device, watcher->library, desc);
+    watched.pipeline = pipeline;
+    watcher->pipelines.push_back(watched);
+    watchShader(watcher, desc.computeShader);
+}
+
+void startShaderWatcher (ShaderWatcher *watcher) {
+    watcher->running = true;
+    watcher->thread = std::thread(watchShaders, watcher);
+    log(("Watching " + std::to_string(watcher->shaders.size()) + " shaders of " + std::to_string(watcher->pipelines.size()) + " pipelines").c_str());
+}
+
+bool applyShaderReloads (ShaderWatcher *watcher, uint64_t frameNumber) {
+    if (LIKELY(!watcher->pending.load(std::memory_order_acquire))) {
+        return false;
+    }
+    std::vector<ReloadedPipeline> ready;
+    {
+        std::lock_guard<std::mutex> lock(watcher->mutex);
+        ready.swap(watcher->ready);
+        watcher->pending.store(false, std::memory_order_relaxed);
+    }
+    // Every frame before this one may still use the replaced pipelines, this one and later ones never do. Pipelines
+    // sharing one library entry are swapped together and retired once.
+    for (const ReloadedPipeline& reloaded : ready) {
+        VkPipeline previous = takePipeline(watcher->library, reloaded.previousKey);
+        if (previous != VK_NULL_HANDLE) {
+            watcher->retired.push_back({ previous, frameNumber });
+        }
+        *watcher->pipelines[reloaded.watched].pipeline = reloaded.pipeline;
+    }
+    watcher->reloads.fetch_add(ready.size(), std::memory_order_relaxed);
+    log(("Swapped in " + std::to_string(ready.size()) + " rebuilt pipelines at frame " + std::to_string(frameNumber)).c_str());
+    return !ready.empty();
+}
+
+void destroyRetiredPipelines (ShaderWatcher *watcher, uint64_t framesCompleted) {
+    for (uint32_t i = 0; i < watcher->retired.size();) {
+        RetiredPipeline& retired = watcher->retired[i];
+        if (retired.retiredAtFrame > framesCompleted) {
+            i++;
+            continue;
+        }
+        vkDestroyPipeline(watcher->device, retired.pipeline, hostAllocator());
+        watcher->retired[i] = watcher->retired.back();
+        watcher->retired.pop_back();
+    }
+}
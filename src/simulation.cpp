@@ -0,0 +1,61 @@
+#include <SDL2/SDL_keycode.h>
+
+#include "simulation.h"
+
+static void applyInput (SimulationState *state, const InputEvent& event) {
+    if (event.type == INPUT_EVENT_KEY_DOWN && event.code == SDLK_SPACE) {
+        state->paused = !state->paused;
+    }
+}
+
+static void tick (Simulation *simulation) {
+    simulation->previous = simulation->current;
+    SimulationState& state = simulation->current;
+    for (const InputEvent& event : simulation->pending) {
+        applyInput(&state, event);
+        simulation->applied.push_back(event.timestamp);
+    }
+    simulation->pending.clear();
+    state.tick++;
+    if (!state.paused) {
+        state.time += SIMULATION_TICK_SECONDS;
+    }
+}
+
+void createSimulation (Simulation *simulation, int64_t now) {
+    simulation->tickLength = 1000000000 / SIMULATION_TICK_RATE;
+    simulation->accumulator = 0;
+    simulation->lastTime = now;
+    simulation->current = { 0, 0.0, false };
+    simulation->previous = simulation->current;
+    simulation->pending.reserve(EVENT_QUEUE_SIZE);
+    simulation->applied.reserve(EVENT_QUEUE_SIZE);
+    simulation->droppedTicks = 0;
+}
+
+void queueSimulationInput (Simulation *simulation, const InputEvent& event) {
+    simulation->pending.push_back(event);
+}
+
+uint32_t advanceSimulation (Simulation *simulation, int64_t now) {
+    simulation->applied.clear();
+    simulation->accumulator += now - simulation->lastTime;
+    simulation->lastTime = now;
+    uint32_t ticks = 0;
+    while (simulation->accumulator >= simulation->tickLength) {
+        if (ticks == SIMULATION_MAX_TICKS) {
+            simulation->droppedTicks += simulation->accumulator / simulation->tickLength;
+            simulation->accumulator %= simulation->tickLength;
+            break;
+        }
+        tick(simulation);
+        simulation->accumulator -= simulation->tickLength;
+        ticks++;
+    }
+    return ticks;
+}
+
+double simulationTime (const Simulation& simulation) {
+    double alpha = static_cast<double>(simulation.accumulator) / simulation.tickLength;
+    return simulation.previous.time + (simulation.current.time - simulation.previous.time) * alpha;
+}
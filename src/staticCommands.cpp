@@ -0,0 +1,106 @@
+#include "hostAllocator.h"
+#include "staticCommands.h"
+#include "vulkanUtils.h"
+
+static uint32_t bufferIndex (const StaticCommands& commands, const FrameRing& ring, uint32_t target) {
+    return target * commands.slotCount + (commands.slotCount == 1 ? 0 : ring.current);
+}
+
+// The frame's slot fence is only reused by later frames, so once it has signaled the frame has completed either way
+static void waitUntilIdle (VkDevice device, const FrameRing& ring, const StaticCommandBuffer& buffer) {
+    if (buffer.submitted && buffer.lastFrame >= framesCompleted(ring)) {
+        const FrameSlot& slot = ring.slots[buffer.lastFrame % ring.slots.size()];
+        ASSERT_RESULT(vkWaitForFences(device, 1, &slot.inFlight, VK_TRUE, UINT64_MAX), VK_SUCCESS, "Failed to wait for static command buffer");
+    }
+}
+
+static VkResult allocateBuffers (StaticCommands *commands, uint32_t count) {
+    VkResult res = VK_SUCCESS;
+    for (uint32_t i = 0; i < count; i++) {
+        StaticCommandBuffer buffer = { VK_NULL_HANDLE, true, false, 0 };
+        if ((res = allocateCommandBuffer(commands->device, commands->pool, &buffer.cmdBuffer)) != VK_SUCCESS) {
+            return res;
+        }
+        commands->buffers.push_back(buffer);
+    }
+    return res;
+}
+
+VkResult createStaticCommands (VkDevice device, uint32_t queueIndex, uint32_t targetCount, uint32_t slotCount, StaticCommands *commands) {
+    VkResult res = VK_SUCCESS;
+    commands->device = device;
+    commands->slotCount = slotCount;
+    commands->recordings = 0;
+    // Not transient, the buffers live as long as the scene does and are reset one at a time
+    VkCommandPoolCreateInfo poolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queueIndex
+    };
+    if ((res = vkCreateCommandPool(device, &poolCreateInfo, hostAllocator(), &commands->pool)) != VK_SUCCESS) {
+        return res;
+    }
+    return allocateBuffers(commands, targetCount * slotCount);
+}
+
+void destroyStaticCommands (StaticCommands *commands) {
+    // Freed together with the pool
+    vkDestroyCommandPool(commands->device, commands->pool, hostAllocator());
+    commands->buffers.clear();
+}
+
+void invalidateStaticCommands (StaticCommands *commands) {
+    for (StaticCommandBuffer& buffer : commands->buffers) {
+        buffer.dirty = true;
+    }
+}
+
+void invalidateStaticCommandsForSlot (StaticCommands *commands, uint32_t slot) {
+    if (commands->slotCount == 1) {
+        invalidateStaticCommands(commands);
+        return;
+    }
+    for (uint32_t i = slot; i < commands->buffers.size(); i += commands->slotCount) {
+        commands->buffers[i].dirty = true;
+    }
+}
+
+VkResult resizeStaticCommands (StaticCommands *commands, const FrameRing& ring, uint32_t targetCount) {
+    uint32_t count = targetCount * commands->slotCount;
+    invalidateStaticCommands(commands);
+    if (count > commands->buffers.size()) {
+        return allocateBuffers(commands, count - static_cast<uint32_t>(commands->buffers.size()));
+    }
+    for (uint32_t i = count; i < commands->buffers.size(); i++) {
+        waitUntilIdle(commands->device, ring, commands->buffers[i]);
+        vkFreeCommandBuffers(commands->device, commands->pool, 1, &commands->buffers[i].cmdBuffer);
+    }
+    commands->buffers.resize(count);
+    return VK_SUCCESS;
+}
+
+VkCommandBuffer acquireStaticCommands (StaticCommands *commands, const FrameRing& ring, uint32_t target, bool *recording) {
+    StaticCommandBuffer& buffer = commands->buffers[bufferIndex(*commands, ring, target)];
+    // Acquiring a swapchain image again normally means the frame that rendered to it is long done, so this rarely blocks
+    waitUntilIdle(commands->device, ring, buffer);
+    *recording = buffer.dirty;
+    if (buffer.dirty) {
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .pInheritanceInfo = nullptr
+        };
+        ASSERT_RESULT(vkBeginCommandBuffer(buffer.cmdBuffer, &beginInfo), VK_SUCCESS, "Failed to begin static command buffer");
+        buffer.dirty = false;
+        commands->recordings++;
+    }
+    return buffer.cmdBuffer;
+}
+
+void submittedStaticCommands (StaticCommands *commands, const FrameRing& ring, uint32_t target) {
+    StaticCommandBuffer& buffer = commands->buffers[bufferIndex(*commands, ring, target)];
+    buffer.submitted = true;
+    buffer.lastFrame = ring.frameNumber;
+}
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include <SDL2/SDL_vulkan.h>
+
+#include "hostAllocator.h"
+#include "swapchain.h"
+#include "vulkanUtils.h"
+
+struct PresentModeName {
+    VkPresentModeKHR mode;
+    const char *name;
+};
+
+static const PresentModeName presentModeNames[] = {
+    { VK_PRESENT_MODE_FIFO_KHR, "fifo" },
+    { VK_PRESENT_MODE_FIFO_RELAXED_KHR, "fifo-relaxed" },
+    { VK_PRESENT_MODE_MAILBOX_KHR, "mailbox" },
+    { VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate" }
+};
+
+bool parseLatencyProfile (const char *name, LatencyProfile *profile) {
+    if (strcmp(name, "vsync") == 0) {
+        *profile = LATENCY_VSYNC;
+    } else if (strcmp(name, "adaptive") == 0) {
+        *profile = LATENCY_ADAPTIVE;
+    } else if (strcmp(name, "low") == 0) {
+        *profile = LATENCY_LOW;
+    } else if (strcmp(name, "throughput") == 0) {
+        *profile = LATENCY_THROUGHPUT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parsePresentMode (const char *name, VkPresentModeKHR *mode) {
+    for (const PresentModeName& entry : presentModeNames) {
+        if (strcmp(name, entry.name) == 0) {
+            *mode = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* presentModeName (VkPresentModeKHR mode) {
+    for (const PresentModeName& entry : presentModeNames) {
+        if (entry.mode == mode) {
+            return entry.name;
+        }
+    }
+    return "unknown";
+}
+
+static VkPresentModeKHR pickPresentMode (const std::vector<VkPresentModeKHR>& supported, const SwapchainConfig& config) {
+    std::vector<VkPresentModeKHR> preferred;
+    if (config.forcePresentMode) {
+        preferred.push_back(config.presentMode);
+    }
+    switch (config.profile) {
+        case LATENCY_ADAPTIVE:
+            preferred.push_back(VK_PRESENT_MODE_FIFO_RELAXED_KHR);
+            break;
+        case LATENCY_LOW:
+            preferred.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+            preferred.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+            break;
+        case LATENCY_THROUGHPUT:
+            preferred.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+            preferred.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+            break;
+        case LATENCY_VSYNC:
+            break;
+    }
+    for (VkPresentModeKHR mode : preferred) {
+        for (VkPresentModeKHR supportedMode : supported) {
+            if (mode == supportedMode) {
+                return mode;
+            }
+        }
+    }
+    if (config.forcePresentMode) {
+        log(("Present mode \"" + std::string(presentModeName(config.presentMode)) + "\" not supported by the surface").c_str());
+    }
+    // Support for FIFO is required by the spec
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+static uint32_t pickImageCount (const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR presentMode, const SwapchainConfig& config) {
+    uint32_t count = config.imageCount;
+    if (count == 0) {
+        // Mailbox needs a third image to always have one to render into while another one waits for vblank
+        count = (presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : capabilities.minImageCount + 1);
+    }
+    count = std::max(count, capabilities.minImageCount);
+    // A maxImageCount of 0 means there is no upper limit
+    if (capabilities.maxImageCount != 0) {
+        count = std::min(count, capabilities.maxImageCount);
+    }
+    return count;
+}
+
+VkResult createSwapchain (VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, SDL_Window* window,
+        uint32_t graphicsQueueIndex, uint32_t presentQueueIndex, const SwapchainConfig& config, VkSwapchainKHR oldSwapchain, Swapchain *swapchain) {
+    VkSurfaceCapabilitiesKHR surfaceCapabilities;
+    VkExtent2D extent;
+    VkFormat format;
+    VkColorSpaceKHR colorSpace;
+    VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+
+    ASSERT_RESULT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities), VK_SUCCESS,
+            "Failed to query surface capabilities");
+
+    if ((surfaceCapabilities.supportedCompositeAlpha & compositeAlpha) == 0) {
+        if ((surfaceCapabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR) != 0)
+            compositeAlpha = VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR;
+        if ((surfaceCapabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR) != 0)
+            compositeAlpha = VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR;
+        if ((surfaceCapabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR) != 0)
+            compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+    }
+
+    std::vector<VkSurfaceFormatKHR> supportedSurfaceFormats;
+    ENUMERATE_OBJECTS(supportedSurfaceFormats, vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &size, nullptr),
+            vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &size, supportedSurfaceFormats.data()), "Failed to enumerate supported surface formats");
+    bool preferedSurfaceFormatFound = false;
+    for (VkSurfaceFormatKHR surfaceFormat : supportedSurfaceFormats) {
+        if (surfaceFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR && surfaceFormat.format == VK_FORMAT_B8G8R8A8_SRGB) {
+            format = surfaceFormat.format;
+            colorSpace = surfaceFormat.colorSpace;
+            preferedSurfaceFormatFound = true;
+            break;
+        }
+    }
+    if (!preferedSurfaceFormatFound) {
+        // Only worth mentioning once, recreations would repeat it on every resize
+        if (oldSwapchain == VK_NULL_HANDLE) {
+            log("Prefered surface format could not be found, defaulting to first available surface format (colors might be inaccurate)");
+        }
+        format = supportedSurfaceFormats[0].format;
+        colorSpace = supportedSurfaceFormats[0].colorSpace;
+    }
+
+    std::vector<VkPresentModeKHR> supportedPresentModes;
+    ENUMERATE_OBJECTS(supportedPresentModes, vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &size, nullptr),
+            vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &size, supportedPresentModes.data()), "Failed to enumerate supported present modes");
+    VkPresentModeKHR presentMode = pickPresentMode(supportedPresentModes, config);
+
+    // A current extent of 0xFFFFFFFF means the surface size is determined by the swapchain
+    if (surfaceCapabilities.currentExtent.width != UINT32_MAX) {
+        extent = surfaceCapabilities.currentExtent;
+    } else {
+        // Called from the render thread, SDL only returns the size it cached from the last window event here
+        int winWidth = 0, winHeight = 0;
+        SDL_Vulkan_GetDrawableSize(window, &winWidth, &winHeight);
+        extent.width = CLAMP(static_cast<uint32_t>(winWidth), surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
+        extent.height = CLAMP(static_cast<uint32_t>(winHeight), surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+    }
+    if (extent.width == 0 || extent.height == 0) {
+        return VK_NOT_READY;
+    }
+
+    uint32_t queues[] = { graphicsQueueIndex, presentQueueIndex };
+    // Scaled rendering blits into the image
+    VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+    VkSwapchainCreateInfoKHR swapchainCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+        .pNext = nullptr,
+        .flags = 0,
+        .surface = surface,
+        .minImageCount = pickImageCount(surfaceCapabilities, presentMode, config),
+        .imageFormat = format,
+        .imageColorSpace = colorSpace,
+        .imageExtent = extent,
+        .imageArrayLayers = 1,
+        .imageUsage = imageUsage,
+        .imageSharingMode = (graphicsQueueIndex == presentQueueIndex ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT),
+        .queueFamilyIndexCount = 2,
+        .pQueueFamilyIndices = queues,
+        .preTransform = surfaceCapabilities.currentTransform,
+        .compositeAlpha = compositeAlpha,
+        .presentMode = presentMode,
+        .clipped = VK_TRUE,
+        .oldSwapchain = oldSwapchain
+    };
+
+    VkResult result = vkCreateSwapchainKHR(device, &swapchainCreateInfo, hostAllocator(), &swapchain->handle);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    swapchain->format = format;
+    swapchain->colorSpace = colorSpace;
+    swapchain->extent = extent;
+    swapchain->presentMode = presentMode;
+    swapchain->imageUsage = imageUsage;
+    ENUMERATE_OBJECTS(swapchain->images, vkGetSwapchainImagesKHR(device, swapchain->handle, &size, nullptr),
+            vkGetSwapchainImagesKHR(device, swapchain->handle, &size, swapchain->images.data()), "Failed to get swap chain images");
+    return result;
+}
+
+VkResult createSwapchainFramebuffers (VkDevice device, VkRenderPass renderPass, Swapchain *swapchain) {
+    VkResult res = VK_SUCCESS;
+    swapchain->imageViews.resize(swapchain->images.size(), VK_NULL_HANDLE);
+    swapchain->framebuffers.resize(swapchain->images.size(), VK_NULL_HANDLE);
+    swapchain->renderFinished.resize(swapchain->images.size(), VK_NULL_HANDLE);
+    for (size_t i = 0; i < swapchain->images.size(); i++) {
+        if ((res = createImageView(device, swapchain->images[i], swapchain->format, &swapchain->imageViews[i])) != VK_SUCCESS) {
+            return res;
+        }
+        if ((res = createFramebuffer(device, renderPass, swapchain->imageViews[i], swapchain->extent, &swapchain->framebuffers[i])) != VK_SUCCESS) {
+            return res;
+        }
+        if ((res = createSemaphore(device, &swapchain->renderFinished[i])) != VK_SUCCESS) {
+            return res;
+        }
+    }
+    return res;
+}
+
+void destroySwapchain (VkDevice device, Swapchain *swapchain) {
+    for (VkFramebuffer framebuffer : swapchain->framebuffers) {
+        vkDestroyFramebuffer(device, framebuffer, hostAllocator());
+    }
+    for (VkImageView view : swapchain->imageViews) {
+        vkDestroyImageView(device, view, hostAllocator());
+    }
+    for (VkSemaphore semaphore : swapchain->renderFinished) {
+        vkDestroySemaphore(device, semaphore, hostAllocator());
+    }
+    swapchain->framebuffers.clear();
+    swapchain->imageViews.clear();
+    swapchain->renderFinished.clear();
+    vkDestroySwapchainKHR(device, swapchain->handle, hostAllocator());
+    swapchain->handle = VK_NULL_HANDLE;
+    swapchain->images.clear();
+}
+
+VkResult recreateSwapchain (VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, SDL_Window* window,
+        uint32_t graphicsQueueIndex, uint32_t presentQueueIndex, const SwapchainConfig& config, uint64_t frameNumber,
+        Swapchain *swapchain, std::vector<RetiredSwapchain>& retired) {
+    Swapchain replacement;
+    VkResult res = createSwapchain(physicalDevice, device, surface, window, graphicsQueueIndex, presentQueueIndex, config, swapchain->handle,
+            &replacement);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    // Frames up to (but not including) frameNumber may still reference the old images
+    retired.push_back({ *swapchain, frameNumber });
+    *swapchain = replacement;
+    return res;
+}
+
+void destroyRetiredSwapchains (VkDevice device, std::vector<RetiredSwapchain>& retired, uint64_t completedFrames) {
+    for (size_t i = 0; i < retired.size();) {
+        if (retired[i].retiredAtFrame <= completedFrames) {
+            destroySwapchain(device, &retired[i].swapchain);
+            retired[i] = retired.back();
+            retired.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cmath>
+
+#include "hostAllocator.h"
+#include "logger.h"
+#include "textureStreamer.h"
+#include "vulkanUtils.h"
+
+// Bytes of levels [topLevel, levelCount) in the file, the image holding them may need a little more
+static VkDeviceSize levelBytes (const StreamedTexture& texture, uint32_t topLevel) {
+    VkDeviceSize bytes = 0;
+    for (uint32_t i = topLevel; i < texture.file.levels.size(); i++) {
+        bytes += texture.file.levels[i].size;
+    }
+    return bytes;
+}
+
+// What the texture will occupy once its pending image, if any, has replaced the resident one
+static VkDeviceSize committedBytes (const StreamedTexture& texture) {
+    return texture.pending.image != VK_NULL_HANDLE ? texture.pending.memory.size :
+        texture.resident.image != VK_NULL_HANDLE ? texture.resident.memory.size : 0;
+}
+
+static VkResult createTextureImage (TextureStreamer *streamer, const StreamedTexture& texture, uint32_t topLevel, TextureImage *image) {
+    VkImageCreateInfo imageCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = texture.file.format,
+        .extent = levelExtent(texture.file, topLevel),
+        .mipLevels = static_cast<uint32_t>(texture.file.levels.size()) - topLevel,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices = nullptr,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VkResult res = createAllocatedImage(streamer->allocator, imageCreateInfo, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &image->image, &image->memory);
+    if (res != VK_SUCCESS) {
+        image->image = VK_NULL_HANDLE;
+        return res;
+    }
+    if ((res = createImageView(streamer->allocator->device, image->image, texture.file.format, &image->view, imageCreateInfo.mipLevels)) != VK_SUCCESS) {
+        destroyAllocatedImage(streamer->allocator, image->image, &image->memory);
+        image->image = VK_NULL_HANDLE;
+        return res;
+    }
+    image->topLevel = topLevel;
+    streamer->residentBytes += image->memory.size;
+    streamer->peakBytes = std::max(streamer->peakBytes, streamer->residentBytes);
+    return VK_SUCCESS;
+}
+
+static void destroyTextureImage (TextureStreamer *streamer, TextureImage *image) {
+    if (image->image == VK_NULL_HANDLE) {
+        return;
+    }
+    streamer->residentBytes -= image->memory.size;
+    vkDestroyImageView(streamer->allocator->device, image->view, hostAllocator());
+    destroyAllocatedImage(streamer->allocator, image->image, &image->memory);
+    image->image = VK_NULL_HANDLE;
+}
+
+// Queues the remaining levels of the pending image, smallest first, until the frame's share of the staging ring is used
+// up. The first upload of a frame always goes, so levels larger than the share still make progress.
+static void queuePendingLevels (TextureStreamer *streamer, StreamedTexture *texture, VkDeviceSize *streamLeft) {
+    while (texture->pendingLevels > 0) {
+        uint32_t level = texture->pending.topLevel + texture->pendingLevels - 1;
+        const Ktx2Level& data = texture->file.levels[level];
+        if (data.size > *streamLeft && *streamLeft != TEXTURE_STREAM_BYTES_PER_FRAME) {
+            return;
+        }
+        VkResult res = uploadImage(streamer->allocator, streamer->uploader, texture->pending.image, VK_IMAGE_ASPECT_COLOR_BIT,
+                level - texture->pending.topLevel, 0, levelExtent(texture->file, level), texture->file.data + data.offset, data.size,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &texture->pendingUpload);
+        if (res == VK_NOT_READY) {
+            *streamLeft = 0;
+            return;
+        }
+        ASSERT_RESULT(res, VK_SUCCESS, "Failed to queue texture upload");
+        streamer->streamedBytes += data.size;
+        *streamLeft -= std::min(*streamLeft, data.size);
+        texture->pendingLevels--;
+    }
+}
+
+static bool startPending (TextureStreamer *streamer, StreamedTexture *texture, uint32_t topLevel) {
+    if (createTextureImage(streamer, *texture, topLevel, &texture->pending) != VK_SUCCESS) {
+        logMessage(LOG_SEVERITY_WARNING, ("Failed to allocate mips " + std::to_string(topLevel) + " and up of \"" + texture->path + "\"").c_str());
+        return false;
+    }
+    texture->pendingLevels = static_cast<uint32_t>(texture->file.levels.size()) - topLevel;
+    return true;
+}
+
+static void swapInPending (TextureStreamer *streamer, StreamedTexture *texture, uint64_t frameNumber) {
+    // Frames before this one may still sample the old image, this one and later ones only see the new one
+    if (texture->resident.image != VK_NULL_HANDLE) {
+        if (texture->bindlessIndex != BINDLESS_INVALID) {
+            releaseTexture(streamer->table, texture->bindlessIndex, frameNumber);
+        }
+        streamer->retired.push_back({ texture->resident, frameNumber });
+    }
+    texture->resident = texture->pending;
+    texture->pending.image = VK_NULL_HANDLE;
+    texture->bindlessIndex = registerTexture(streamer->table, texture->resident.view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    if (texture->bindlessIndex == BINDLESS_INVALID) {
+        logMessage(LOG_SEVERITY_WARNING, ("The bindless table is full, \"" + texture->path + "\" can't be sampled").c_str());
+    }
+}
+
+// Drops the least recently used textures that were last used before usedBefore to their tail until bytes are freed.
+// The memory only returns once the replaced images are retired, committed bytes account for it right away.
+static VkDeviceSize evictTextures (TextureStreamer *streamer, VkDeviceSize bytes, uint64_t usedBefore) {
+    std::vector<uint32_t> victims;
+    for (uint32_t i = 0; i < streamer->textures.size(); i++) {
+        const StreamedTexture& texture = streamer->textures[i];
+        if (texture.pending.image == VK_NULL_HANDLE && texture.resident.image != VK_NULL_HANDLE && texture.resident.topLevel < texture.tailLevel &&
+                texture.lastUsed < usedBefore) {
+            victims.push_back(i);
+        }
+    }
+    std::sort(victims.begin(), victims.end(), [streamer] (uint32_t a, uint32_t b) {
+        return streamer->textures[a].lastUsed < streamer->textures[b].lastUsed;
+    });
+    VkDeviceSize freed = 0;
+    for (uint32_t i = 0; i < victims.size() && freed < bytes; i++) {
+        StreamedTexture& texture = streamer->textures[victims[i]];
+        VkDeviceSize before = texture.resident.memory.size;
+        if (!startPending(streamer, &texture, texture.tailLevel)) {
+            continue;
+        }
+        freed += before - std::min(before, texture.pending.memory.size);
+        streamer->evictions++;
+    }
+    return freed;
+}
+
+void createTextureStreamer (MemoryAllocator *allocator, Uploader *uploader, BindlessTable *table, VkPhysicalDevice physicalDevice, VkDeviceSize budget,
+        TextureStreamer *streamer) {
+    streamer->allocator = allocator;
+    streamer->uploader = uploader;
+    streamer->table = table;
+    streamer->physicalDevice = physicalDevice;
+    streamer->budget = budget;
+    streamer->residentBytes = 0;
+    streamer->peakBytes = 0;
+    streamer->streamedBytes = 0;
+    streamer->evictions = 0;
+}
+
+void destroyTextureStreamer (TextureStreamer *streamer) {
+    for (StreamedTexture& texture : streamer->textures) {
+        destroyTextureImage(streamer, &texture.resident);
+        destroyTextureImage(streamer, &texture.pending);
+        closeKtx2File(&texture.file);
+    }
+    for (RetiredTextureImage& retired : streamer->retired) {
+        destroyTextureImage(streamer, &retired.image);
+    }
+    streamer->textures.clear();
+    streamer->retired.clear();
+}
+
+VkResult loadTexture (TextureStreamer *streamer, const std::string& path, uint32_t *texture) {
+    StreamedTexture loaded = {};
+    loaded.path = path;
+    VkResult res = openKtx2File(path, &loaded.file);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(streamer->physicalDevice, loaded.file.format, &properties);
+    if ((properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0) {
+        logMessage(LOG_SEVERITY_WARNING, ("Not loading \"" + path + "\": the device can't sample format " + std::to_string(loaded.file.format)).c_str());
+        closeKtx2File(&loaded.file);
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+
+    uint32_t levelCount = static_cast<uint32_t>(loaded.file.levels.size());
+    loaded.firstLevel = 0;
+    while (loaded.firstLevel + 1 < levelCount && loaded.file.levels[loaded.firstLevel].size > streamer->uploader->stagingSize) {
+        loaded.firstLevel++;
+    }
+    loaded.tailLevel = loaded.firstLevel;
+    while (loaded.tailLevel + 1 < levelCount && std::max(loaded.file.width, loaded.file.height) >> loaded.tailLevel > TEXTURE_MIN_RESIDENT_SIZE) {
+        loaded.tailLevel++;
+    }
+    loaded.bindlessIndex = BINDLESS_INVALID;
+    loaded.wantedLevel = loaded.tailLevel;
+    loaded.lastUsed = 0;
+    loaded.resident.image = VK_NULL_HANDLE;
+    loaded.pending.image = VK_NULL_HANDLE;
+    if (!startPending(streamer, &loaded, loaded.tailLevel)) {
+        closeKtx2File(&loaded.file);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    if (loaded.firstLevel > 0) {
+        logMessage(LOG_SEVERITY_WARNING, ("Mips finer than " + std::to_string(loaded.firstLevel) + " of \"" + path +
+                    "\" don't fit into the staging ring and are never loaded").c_str());
+    }
+    *texture = static_cast<uint32_t>(streamer->textures.size());
+    streamer->textures.push_back(std::move(loaded));
+    return VK_SUCCESS;
+}
+
+void useTexture (TextureStreamer *streamer, uint32_t texture, float screenSize, uint64_t frameNumber) {
+    StreamedTexture& used = streamer->textures[texture];
+    // One texel per pixel at the wanted level
+    float texels = static_cast<float>(std::max(used.file.width, used.file.height));
+    uint32_t wanted = screenSize > 0.0f ? static_cast<uint32_t>(std::max(std::floor(std::log2(texels / screenSize)), 0.0f)) : used.tailLevel;
+    wanted = CLAMP(wanted, used.firstLevel, used.tailLevel);
+    used.wantedLevel = used.lastUsed == frameNumber ? std::min(used.wantedLevel, wanted) : wanted;
+    used.lastUsed = frameNumber;
+}
+
+uint32_t textureIndex (const TextureStreamer& streamer, uint32_t texture) {
+    return streamer.textures[texture].bindlessIndex;
+}
+
+void updateTextureStreaming (TextureStreamer *streamer, uint64_t frameNumber, uint64_t framesCompleted) {
+    for (uint32_t i = 0; i < streamer->retired.size();) {
+        RetiredTextureImage& retired = streamer->retired[i];
+        if (retired.retiredAtFrame > framesCompleted) {
+            i++;
+            continue;
+        }
+        destroyTextureImage(streamer, &retired.image);
+        streamer->retired[i] = streamer->retired.back();
+        streamer->retired.pop_back();
+    }
+
+    // Images already under way go first, the smallest mips of new textures before anything else
+    VkDeviceSize streamLeft = TEXTURE_STREAM_BYTES_PER_FRAME;
+    VkDeviceSize committed = 0;
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < streamer->textures.size(); i++) {
+        StreamedTexture& texture = streamer->textures[i];
+        if (texture.pending.image != VK_NULL_HANDLE) {
+            if (texture.pendingLevels > 0) {
+                queuePendingLevels(streamer, &texture, &streamLeft);
+            } else if (uploadComplete(*streamer->uploader, texture.pendingUpload)) {
+                swapInPending(streamer, &texture, frameNumber);
+            }
+        } else if (texture.resident.image != VK_NULL_HANDLE && texture.lastUsed + 1 >= frameNumber && texture.wantedLevel < texture.resident.topLevel) {
+            candidates.push_back(i);
+        }
+        committed += committedBytes(texture);
+    }
+    if (committed > streamer->budget) {
+        committed -= std::min(committed, evictTextures(streamer, committed - streamer->budget, frameNumber > 0 ? frameNumber - 1 : 0));
+    }
+
+    // The textures missing the most detail first
+    std::sort(candidates.begin(), candidates.end(), [streamer] (uint32_t a, uint32_t b) {
+        const StreamedTexture& textureA = streamer->textures[a];
+        const StreamedTexture& textureB = streamer->textures[b];
+        return textureA.resident.topLevel - textureA.wantedLevel > textureB.resident.topLevel - textureB.wantedLevel;
+    });
+    for (uint32_t i = 0; i < candidates.size() && streamLeft > 0; i++) {
+        StreamedTexture& texture = streamer->textures[candidates[i]];
+        // Evicted to make room for an earlier candidate
+        if (texture.pending.image != VK_NULL_HANDLE) {
+            continue;
+        }
+        uint32_t topLevel = texture.wantedLevel;
+        VkDeviceSize current = texture.resident.memory.size;
+        if (committed - current + levelBytes(texture, topLevel) > streamer->budget) {
+            committed -= std::min(committed, evictTextures(streamer, committed - current + levelBytes(texture, topLevel) - streamer->budget,
+                        texture.lastUsed));
+        }
+        // Whatever fits, if not everything does
+        while (topLevel < texture.resident.topLevel && committed - current + levelBytes(texture, topLevel) > streamer->budget) {
+            topLevel++;
+        }
+        if (topLevel == texture.resident.topLevel || !startPending(streamer, &texture, topLevel)) {
+            continue;
+        }
+        committed += texture.pending.memory.size - current;
+        queuePendingLevels(streamer, &texture, &streamLeft);
+    }
+}
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <cstring>
+
+#include "hostAllocator.h"
+#include "uploader.h"
+#include "vulkanUtils.h"
+
+// Stages that may read uploaded data on the graphics queue. Waiting on these rather than ALL_COMMANDS lets the
+// clear and anything else that doesn't touch uploads start before the transfer queue is done.
+#define UPLOAD_CONSUMER_STAGES  (VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | \
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+
+static uint64_t alignUp (uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+VkResult createUploader (MemoryAllocator *allocator, VkPhysicalDevice physicalDevice, VkQueue transferQueue, uint32_t transferFamily,
+        uint32_t graphicsFamily, VkDeviceSize stagingSize, Uploader *uploader) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    // 16 covers every texel and compressed block size, so image copies never need a stricter offset
+    uploader->copyAlignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+    uploader->device = allocator->device;
+    uploader->transferQueue = transferQueue;
+    uploader->transferFamily = transferFamily;
+    uploader->graphicsFamily = graphicsFamily;
+    uploader->stagingSize = alignUp(stagingSize, uploader->copyAlignment);
+    uploader->stagingHead = 0;
+    uploader->stagingTail = 0;
+    uploader->stagingFlushed = 0;
+    uploader->nextBatch = 0;
+    uploader->openTicket = 1;
+    uploader->completedTicket = 0;
+    uploader->framesCompleted = 0;
+    uploader->bytesUploaded = 0;
+    uploader->batchesSubmitted = 0;
+
+    VkResult res = createAllocatedBuffer(allocator, uploader->stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, ALLOCATION_PERSISTENT, &uploader->stagingBuffer, &uploader->stagingMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    for (UploadBatch& batch : uploader->batches) {
+        batch = {};
+        if ((res = createCommandPool(uploader->device, transferFamily, &batch.cmdPool)) != VK_SUCCESS) return res;
+        if ((res = allocateCommandBuffer(uploader->device, batch.cmdPool, &batch.cmdBuffer)) != VK_SUCCESS) return res;
+        if ((res = createFence(uploader->device, VK_FENCE_CREATE_SIGNALED_BIT, &batch.fence)) != VK_SUCCESS) return res;
+        if ((res = createSemaphore(uploader->device, &batch.released)) != VK_SUCCESS) return res;
+    }
+    return res;
+}
+
+void destroyUploader (MemoryAllocator *allocator, Uploader *uploader) {
+    for (UploadBatch& batch : uploader->batches) {
+        vkWaitForFences(uploader->device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    }
+    for (UploadBatch& batch : uploader->batches) {
+        vkDestroySemaphore(uploader->device, batch.released, hostAllocator());
+        vkDestroyFence(uploader->device, batch.fence, hostAllocator());
+        vkFreeCommandBuffers(uploader->device, batch.cmdPool, 1, &batch.cmdBuffer);
+        vkDestroyCommandPool(uploader->device, batch.cmdPool, hostAllocator());
+    }
+    destroyAllocatedBuffer(allocator, uploader->stagingBuffer, &uploader->stagingMemory);
+    uploader->bufferUploads.clear();
+    uploader->imageUploads.clear();
+}
+
+// Polls batch fences and recycles their staging space, the caller holds the mutex
+static void retireBatches (Uploader *uploader, uint64_t framesCompleted) {
+    uploader->framesCompleted = framesCompleted;
+    // nextBatch is the oldest batch whenever it is pending, batches complete in submission order
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+        UploadBatch& batch = uploader->batches[(uploader->nextBatch + i) % UPLOAD_BATCH_COUNT];
+        if (!batch.pending) {
+            continue;
+        }
+        if (vkGetFenceStatus(uploader->device, batch.fence) != VK_SUCCESS) {
+            break;
+        }
+        batch.pending = false;
+        uploader->completedTicket = batch.ticket;
+        uploader->stagingTail = batch.stagingEnd;
+    }
+}
+
+static VkResult reserveRange (Uploader *uploader, VkDeviceSize size, VkDeviceSize *offset, void **mapped) {
+    if (size > uploader->stagingSize) {
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    uint64_t head = alignUp(uploader->stagingHead, uploader->copyAlignment);
+    VkDeviceSize ringOffset = head % uploader->stagingSize;
+    // Allocations never straddle the end of the ring, skip to its start instead
+    if (ringOffset + size > uploader->stagingSize) {
+        head += uploader->stagingSize - ringOffset;
+        ringOffset = 0;
+    }
+    if (head + size - uploader->stagingTail > uploader->stagingSize) {
+        retireBatches(uploader, uploader->framesCompleted);
+        if (head + size - uploader->stagingTail > uploader->stagingSize) {
+            return VK_NOT_READY;
+        }
+    }
+    uploader->stagingHead = head + size;
+    uploader->bytesUploaded += size;
+    *offset = ringOffset;
+    *mapped = static_cast<char*>(uploader->stagingMemory.mapped) + ringOffset;
+    return VK_SUCCESS;
+}
+
+VkResult reserveStaging (Uploader *uploader, VkDeviceSize size, VkDeviceSize *offset, void **mapped) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    return reserveRange(uploader, size, offset, mapped);
+}
+
+void queueBufferCopy (Uploader *uploader, VkBuffer buffer, VkDeviceSize dstOffset, VkDeviceSize stagingOffset, VkDeviceSize size) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    uploader->bufferUploads.push_back({ buffer, { stagingOffset, dstOffset, size } });
+}
+
+static void pushImageCopy (Uploader *uploader, VkImage image, VkImageAspectFlags aspect, uint32_t mipLevel, uint32_t arrayLayer, VkExtent3D extent,
+        VkDeviceSize stagingOffset, VkImageLayout finalLayout) {
+    VkBufferImageCopy region = {
+        .bufferOffset = stagingOffset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = aspect,
+            .mipLevel = mipLevel,
+            .baseArrayLayer = arrayLayer,
+            .layerCount = 1
+        },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = extent
+    };
+    uploader->imageUploads.push_back({ image, region, finalLayout });
+}
+
+void queueImageCopy (Uploader *uploader, VkImage image, VkImageAspectFlags aspect, uint32_t mipLevel, uint32_t arrayLayer, VkExtent3D extent,
+        VkDeviceSize stagingOffset, VkImageLayout finalLayout) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    pushImageCopy(uploader, image, aspect, mipLevel, arrayLayer, extent, stagingOffset, finalLayout);
+}
+
+VkResult uploadBuffer (MemoryAllocator *allocator, Uploader *uploader, VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+        UploadTicket *ticket) {
+    // Held across the copy, a flush in between would submit the copy before its data is in the ring
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    VkDeviceSize stagingOffset;
+    void *mapped;
+    VkResult res = reserveRange(uploader, size, &stagingOffset, &mapped);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    memcpy(mapped, data, size);
+    uploader->bufferUploads.push_back({ buffer, { stagingOffset, offset, size } });
+    *ticket = uploader->openTicket;
+    return VK_SUCCESS;
+}
+
+VkResult uploadImage (MemoryAllocator *allocator, Uploader *uploader, VkImage image, VkImageAspectFlags aspect, uint32_t mipLevel,
+        uint32_t arrayLayer, VkExtent3D extent, const void *data, VkDeviceSize size, VkImageLayout finalLayout, UploadTicket *ticket) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    VkDeviceSize stagingOffset;
+    void *mapped;
+    VkResult res = reserveRange(uploader, size, &stagingOffset, &mapped);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    memcpy(mapped, data, size);
+    pushImageCopy(uploader, image, aspect, mipLevel, arrayLayer, extent, stagingOffset, finalLayout);
+    *ticket = uploader->openTicket;
+    return VK_SUCCESS;
+}
+
+static VkImageSubresourceRange uploadRange (const ImageUpload& upload) {
+    return {
+        .aspectMask = upload.region.imageSubresource.aspectMask,
+        .baseMipLevel = upload.region.imageSubresource.mipLevel,
+        .levelCount = 1,
+        .baseArrayLayer = upload.region.imageSubresource.baseArrayLayer,
+        .layerCount = 1
+    };
+}
+
+static VkResult flushStaging (MemoryAllocator *allocator, Uploader *uploader) {
+    VkDeviceSize begin = uploader->stagingFlushed % uploader->stagingSize;
+    VkDeviceSize size = uploader->stagingHead - uploader->stagingFlushed;
+    VkResult res = VK_SUCCESS;
+    if (size > 0 && begin + size > uploader->stagingSize) {
+        res = flushAllocation(allocator, uploader->stagingMemory, begin, uploader->stagingSize - begin);
+        size -= uploader->stagingSize - begin;
+        begin = 0;
+    }
+    if (res == VK_SUCCESS && size > 0) {
+        res = flushAllocation(allocator, uploader->stagingMemory, begin, size);
+    }
+    uploader->stagingFlushed = uploader->stagingHead;
+    return res;
+}
+
+static bool nextBatchReady (Uploader *uploader) {
+    retireBatches(uploader, uploader->framesCompleted);
+    const UploadBatch& batch = uploader->batches[uploader->nextBatch];
+    // The release semaphore can only be signaled again once the frame that waited on it is done
+    return !batch.pending && uploader->framesCompleted >= batch.semaphoreFreeAt;
+}
+
+bool uploadBatchReady (Uploader *uploader) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    return nextBatchReady(uploader);
+}
+
+VkResult flushUploads (MemoryAllocator *allocator, Uploader *uploader) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    if (uploader->bufferUploads.empty() && uploader->imageUploads.empty()) {
+        return VK_SUCCESS;
+    }
+    if (!nextBatchReady(uploader)) {
+        return VK_NOT_READY;
+    }
+    UploadBatch& batch = uploader->batches[uploader->nextBatch];
+    bool ownershipTransfer = uploader->transferFamily != uploader->graphicsFamily;
+    uint32_t srcFamily = ownershipTransfer ? uploader->transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    uint32_t dstFamily = ownershipTransfer ? uploader->graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+
+    VkResult res = vkResetCommandPool(uploader->device, batch.cmdPool, 0);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = nullptr
+    };
+    if ((res = vkBeginCommandBuffer(batch.cmdBuffer, &beginInfo)) != VK_SUCCESS) {
+        return res;
+    }
+
+    // Grouping by destination turns the whole batch into one copy command per resource
+    std::stable_sort(uploader->bufferUploads.begin(), uploader->bufferUploads.end(), [] (const BufferUpload& a, const BufferUpload& b) {
+        return a.buffer < b.buffer;
+    });
+    std::stable_sort(uploader->imageUploads.begin(), uploader->imageUploads.end(), [] (const ImageUpload& a, const ImageUpload& b) {
+        return a.image < b.image;
+    });
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    for (const ImageUpload& upload : uploader->imageUploads) {
+        // Every upload overwrites a whole subresource, so its previous contents can be discarded
+        imageBarriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = upload.image,
+            .subresourceRange = uploadRange(upload)
+        });
+    }
+    if (!imageBarriers.empty()) {
+        vkCmdPipelineBarrier(batch.cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+
+    std::vector<VkBufferCopy> bufferRegions;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    for (size_t i = 0; i < uploader->bufferUploads.size(); i++) {
+        const BufferUpload& upload = uploader->bufferUploads[i];
+        bufferRegions.push_back(upload.region);
+        bufferBarriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = ownershipTransfer ? 0u : static_cast<VkAccessFlags>(VK_ACCESS_MEMORY_READ_BIT),
+            .srcQueueFamilyIndex = srcFamily,
+            .dstQueueFamilyIndex = dstFamily,
+            .buffer = upload.buffer,
+            .offset = upload.region.dstOffset,
+            .size = upload.region.size
+        });
+        if (i + 1 == uploader->bufferUploads.size() || uploader->bufferUploads[i + 1].buffer != upload.buffer) {
+            vkCmdCopyBuffer(batch.cmdBuffer, uploader->stagingBuffer, upload.buffer, static_cast<uint32_t>(bufferRegions.size()), bufferRegions.data());
+            bufferRegions.clear();
+        }
+    }
+
+    std::vector<VkBufferImageCopy> imageRegions;
+    imageBarriers.clear();
+    for (size_t i = 0; i < uploader->imageUploads.size(); i++) {
+        const ImageUpload& upload = uploader->imageUploads[i];
+        imageRegions.push_back(upload.region);
+        imageBarriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = ownershipTransfer ? 0u : static_cast<VkAccessFlags>(VK_ACCESS_MEMORY_READ_BIT),
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .newLayout = upload.finalLayout,
+            .srcQueueFamilyIndex = srcFamily,
+            .dstQueueFamilyIndex = dstFamily,
+            .image = upload.image,
+            .subresourceRange = uploadRange(upload)
+        });
+        if (i + 1 == uploader->imageUploads.size() || uploader->imageUploads[i + 1].image != upload.image) {
+            vkCmdCopyBufferToImage(batch.cmdBuffer, uploader->stagingBuffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    static_cast<uint32_t>(imageRegions.size()), imageRegions.data());
+            imageRegions.clear();
+        }
+    }
+
+    // Release to the graphics family, or make the writes visible to the graphics queue directly when it is the same queue
+    vkCmdPipelineBarrier(batch.cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, ownershipTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : UPLOAD_CONSUMER_STAGES,
+            0, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()),
+            imageBarriers.data());
+    if ((res = vkEndCommandBuffer(batch.cmdBuffer)) != VK_SUCCESS) {
+        return res;
+    }
+    if ((res = flushStaging(allocator, uploader)) != VK_SUCCESS) {
+        return res;
+    }
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = nullptr,
+        .pWaitDstStageMask = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch.cmdBuffer,
+        .signalSemaphoreCount = ownershipTransfer ? 1u : 0u,
+        .pSignalSemaphores = &batch.released
+    };
+    if ((res = vkResetFences(uploader->device, 1, &batch.fence)) != VK_SUCCESS) {
+        return res;
+    }
+    if ((res = vkQueueSubmit(uploader->transferQueue, 1, &submitInfo, batch.fence)) != VK_SUCCESS) {
+        return res;
+    }
+
+    if (ownershipTransfer) {
+        // The acquire half repeats the release barrier with the access masks on the other side
+        for (VkBufferMemoryBarrier barrier : bufferBarriers) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            uploader->bufferAcquires.push_back(barrier);
+        }
+        for (VkImageMemoryBarrier barrier : imageBarriers) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            uploader->imageAcquires.push_back(barrier);
+        }
+        uploader->acquireWaits.push_back(batch.released);
+    }
+
+    batch.semaphoreFreeAt = ownershipTransfer ? UINT64_MAX : 0;
+    batch.ticket = uploader->openTicket++;
+    batch.stagingEnd = uploader->stagingHead;
+    batch.pending = true;
+    uploader->nextBatch = (uploader->nextBatch + 1) % UPLOAD_BATCH_COUNT;
+    uploader->batchesSubmitted++;
+    uploader->bufferUploads.clear();
+    uploader->imageUploads.clear();
+    return VK_SUCCESS;
+}
+
+void retireUploads (Uploader *uploader, uint64_t framesCompleted) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    retireBatches(uploader, framesCompleted);
+}
+
+bool uploadComplete (const Uploader& uploader, UploadTicket ticket) {
+    std::lock_guard<std::mutex> lock(uploader.mutex);
+    return ticket <= uploader.completedTicket;
+}
+
+void recordUploadAcquires (Uploader *uploader, VkCommandBuffer cmdBuffer, uint64_t frameNumber, std::vector<VkSemaphore>& waitSemaphores,
+        std::vector<VkPipelineStageFlags>& waitStages) {
+    std::lock_guard<std::mutex> lock(uploader->mutex);
+    if (uploader->acquireWaits.empty()) {
+        return;
+    }
+    for (UploadBatch& batch : uploader->batches) {
+        if (batch.semaphoreFreeAt == UINT64_MAX) {
+            batch.semaphoreFreeAt = frameNumber + 1;
+        }
+    }
+    vkCmdPipelineBarrier(cmdBuffer, UPLOAD_CONSUMER_STAGES, UPLOAD_CONSUMER_STAGES, 0, 0, nullptr, static_cast<uint32_t>(uploader->bufferAcquires.size()),
+            uploader->bufferAcquires.data(), static_cast<uint32_t>(uploader->imageAcquires.size()), uploader->imageAcquires.data());
+    for (VkSemaphore semaphore : uploader->acquireWaits) {
+        waitSemaphores.push_back(semaphore);
+        waitStages.push_back(UPLOAD_CONSUMER_STAGES);
+    }
+    uploader->bufferAcquires.clear();
+    uploader->imageAcquires.clear();
+    uploader->acquireWaits.clear();
+}
@@ -1,12 +1,154 @@
+#include <fstream>
 #include <iostream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hostAllocator.h"
+#include "logger.h"
 #include "vulkanUtils.h"
 
-void panic (const char *msg) {
+[[noreturn]] void panic (const char *msg) {
+    // Everything logged before the panic is written out first, the panic itself goes last
+    stopLogger();
     std::cerr << "Panic! " << msg << std::endl;
     exit(-1);
 }
 
 void log (const char *msg) {
-    std::cerr << "Info: " << msg << std::endl;
+    logMessage(LOG_SEVERITY_INFO, msg);
+}
+
+VkResult createSemaphore (VkDevice device, VkSemaphore *semaphore) {
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0
+    };
+    return vkCreateSemaphore(device, &semaphoreCreateInfo, hostAllocator(), semaphore);
+}
+
+VkResult createFence (VkDevice device, VkFenceCreateFlags flags, VkFence *fence) {
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = flags
+    };
+    return vkCreateFence(device, &fenceCreateInfo, hostAllocator(), fence);
+}
+
+VkResult createCommandPool (VkDevice device, uint32_t queueIndex, VkCommandPool *pool) {
+    VkCommandPoolCreateInfo cmdPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queueIndex
+    };
+    return vkCreateCommandPool(device, &cmdPoolCreateInfo, hostAllocator(), pool);
+}
+
+VkResult allocateCommandBuffer (VkDevice device, VkCommandPool pool, VkCommandBuffer *buffer, VkCommandBufferLevel level) {
+    VkCommandBufferAllocateInfo cmdAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = pool,
+        .level = level,
+        .commandBufferCount = 1
+    };
+    return vkAllocateCommandBuffers(device, &cmdAllocInfo, buffer);
+}
+
+VkResult createImageView (VkDevice device, VkImage image, VkFormat format, VkImageView *view, uint32_t levelCount) {
+    VkImageViewCreateInfo viewCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .image = image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = levelCount,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+    return vkCreateImageView(device, &viewCreateInfo, hostAllocator(), view);
+}
+
+VkResult createFramebuffer (VkDevice device, VkRenderPass renderPass, VkImageView view, VkExtent2D extent, VkFramebuffer *framebuffer) {
+    VkFramebufferCreateInfo framebufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .renderPass = renderPass,
+        .attachmentCount = 1,
+        .pAttachments = &view,
+        .width = extent.width,
+        .height = extent.height,
+        .layers = 1
+    };
+    return vkCreateFramebuffer(device, &framebufferCreateInfo, hostAllocator(), framebuffer);
+}
+
+uint32_t findMemoryType (VkPhysicalDevice physicalDevice, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+uint64_t hashBytes (const void *data, size_t size, uint64_t seed) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool readFile (const std::string& path, std::vector<char>& contents) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return false;
+    }
+    std::streamsize size = in.tellg();
+    in.seekg(0, std::ios::beg);
+    contents.resize(static_cast<size_t>(size));
+    return static_cast<bool>(in.read(contents.data(), size));
+}
+
+const uint8_t *mapFile (const std::string& path, size_t *size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive on its own
+    close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    madvise(data, info.st_size, MADV_WILLNEED);
+    *size = static_cast<size_t>(info.st_size);
+    return static_cast<const uint8_t*>(data);
+}
+
+void unmapFile (const uint8_t *data, size_t size) {
+    munmap(const_cast<uint8_t*>(data), size);
 }
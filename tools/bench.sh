@@ -0,0 +1,113 @@
+#!/bin/sh
+# Renders a fixed set of scenes headless and compares the results against a stored baseline. Every scene runs the same
+# number of frames with the same size, thread count and simulation steps, validation off and without the pipeline cache,
+# so runs on one machine are comparable. Results are written to $RESULTS as JSON, one object per scene.
+#
+#   tools/bench.sh                    run and compare, exits with 1 if a metric regressed by more than $TOLERANCE percent
+#   tools/bench.sh --update-baseline  run and store the results as the new baseline
+#
+# Uses Mesa lavapipe when it is installed and VK_ICD_FILENAMES is not set, so the numbers do not depend on a GPU driver.
+# Extra arguments are passed on to every run.
+BINARY=${BINARY:-./vulkan}
+CONVERTER=${CONVERTER:-tools/meshConvert}
+DIR=${DIR:-bench}
+RESULTS=${RESULTS:-$DIR/results.json}
+BASELINE=${BASELINE:-$DIR/baseline.json}
+TOLERANCE=${TOLERANCE:-15}
+FRAMES=${FRAMES:-600}
+
+update=0
+if [ "$1" = "--update-baseline" ]; then
+    update=1
+    shift
+fi
+
+if [ -z "$VK_ICD_FILENAMES" ]; then
+    for icd in /usr/share/vulkan/icd.d/lvp_icd.*.json; do
+        if [ -f "$icd" ]; then
+            export VK_ICD_FILENAMES="$icd"
+            break
+        fi
+    done
+fi
+echo "ICD: ${VK_ICD_FILENAMES:-system default}"
+
+mkdir -p "$DIR" || exit 1
+mesh="$DIR/sphere1024.mesh"
+if [ ! -f "$mesh" ]; then
+    "$CONVERTER" --sphere 1024 "$mesh" > /dev/null || exit 1
+fi
+
+# name, then the scene's options
+scene () {
+    name=$1
+    shift
+    echo "== $name"
+    if ! "$BINARY" --headless --frames "$FRAMES" --size 1280x720 --threads 4 --validation off --no-pipeline-cache \
+            --bench-json "$DIR/$name.json" "$@" > "$DIR/$name.log" 2>&1; then
+        echo "Scene $name failed, see $DIR/$name.log"
+        exit 1
+    fi
+    sed -e 's/^/  /' -e '1s/^ *{/  "'"$name"'": {/' -e '$s/^ *}/  }/' "$DIR/$name.json" > "$DIR/$name.part"
+}
+
+scene clear --draws 0 "$@"
+scene draws --draws 10000 "$@"
+scene uploads --mesh "$mesh" --instances 100000 --move-instances "$@"
+scene compute --particles 1000000 "$@"
+
+{
+    echo "{"
+    first=1
+    for name in clear draws uploads compute; do
+        [ $first -eq 1 ] || echo ","
+        first=0
+        # The closing brace of the scene is printed without a newline so the comma can follow it
+        printf '%s' "$(cat "$DIR/$name.part")"
+        rm -f "$DIR/$name.part"
+    done
+    echo
+    echo "}"
+} > "$RESULTS"
+echo "Results written to $RESULTS"
+
+if [ $update -eq 1 ]; then
+    cp "$RESULTS" "$BASELINE" && echo "Baseline updated: $BASELINE"
+    exit
+fi
+if [ ! -f "$BASELINE" ]; then
+    echo "No baseline at $BASELINE, create one with 'make bench-baseline'"
+    exit
+fi
+
+# Throughput has to stay up, everything else has to stay down. Frame and run counts are not compared.
+awk -v tolerance="$TOLERANCE" '
+    /^  "[a-z_]+": \{/ { split($1, parts, "\""); scene = parts[2]; next }
+    /^    "[a-z0-9_]+": / {
+        split($1, parts, "\"")
+        key = scene "." parts[2]
+        value = $2 + 0
+        if (FNR == NR) {
+            baseline[key] = value
+            next
+        }
+        if (parts[2] == "frames" || parts[2] == "seconds" || !(key in baseline)) {
+            next
+        }
+        base = baseline[key]
+        change = base != 0 ? (value - base) / base * 100 : 0
+        worse = parts[2] == "fps" ? -change : change
+        status = worse > tolerance ? "REGRESSED" : "ok"
+        if (worse > tolerance) {
+            regressions++
+        }
+        printf "%-24s %12.3f -> %12.3f %+8.1f%%  %s\n", key, base, value, change, status
+    }
+    END {
+        if (regressions > 0) {
+            printf "%d metrics regressed by more than %s%%\n", regressions, tolerance
+            exit 1
+        }
+        printf "No regressions beyond %s%%\n", tolerance
+    }
+' "$BASELINE" "$RESULTS"
@@ -0,0 +1,9 @@
+#!/bin/sh
+# Renders the GPU driven scene headless at growing instance counts and prints the throughput and GPU frame times of each
+# run. Extra arguments are passed on to every run, e.g. --size 1920x1080.
+BINARY=${BINARY:-./vulkan}
+
+for instances in 1000 10000 100000 1000000; do
+    echo "== $instances instances"
+    "$BINARY" --headless --frames 300 --instances "$instances" "$@" 2>&1 | grep -E "Rendered|GPU times"
+done
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Converts UV spheres of growing density into mesh files and loads each one while rendering headless, printing the
+# loader's time to resident and throughput. The first load of a file is usually served from the page cache the
+# converter just filled, drop the caches in between (as root) to measure cold loads. Extra arguments are passed on to
+# every run.
+BINARY=${BINARY:-./vulkan}
+CONVERTER=${CONVERTER:-tools/meshConvert}
+DIR=${DIR:-/tmp}
+
+for segments in 256 512 1024 2048; do
+    mesh="$DIR/sphere$segments.mesh"
+    "$CONVERTER" --sphere "$segments" "$mesh" || exit 1
+    "$BINARY" --headless --frames 600 --mesh "$mesh" "$@" 2>&1 | grep -E "resident|still loading"
+done
@@ -0,0 +1,316 @@
+// Offline converter from Wavefront OBJ to the binary mesh container in inc/meshFile.h, so the renderer never parses text
+// at startup. Also generates UV spheres of any density for benchmarking the loader.
+//
+//     meshConvert model.obj model.mesh
+//     meshConvert --sphere SEGMENTS sphere.mesh
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "meshFile.h"
+
+struct MeshData {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Meshlet> meshlets;
+};
+
+static void fail (const std::string& message) {
+    fprintf(stderr, "meshConvert: %s\n", message.c_str());
+    exit(1);
+}
+
+// OBJ indices are 1 based, negative ones count back from the last element read so far
+static int32_t resolveIndex (const std::string& token, size_t count) {
+    if (token.empty()) {
+        return -1;
+    }
+    long index = strtol(token.c_str(), nullptr, 10);
+    if (index < 0) {
+        index += static_cast<long>(count);
+    } else {
+        index -= 1;
+    }
+    if (index < 0 || static_cast<size_t>(index) >= count) {
+        fail("index " + token + " out of range");
+    }
+    return static_cast<int32_t>(index);
+}
+
+static void computeNormals (MeshData *mesh) {
+    for (MeshVertex& vertex : mesh->vertices) {
+        vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+    }
+    for (size_t i = 0; i + 2 < mesh->indices.size(); i += 3) {
+        MeshVertex *v[3] = { &mesh->vertices[mesh->indices[i]], &mesh->vertices[mesh->indices[i + 1]], &mesh->vertices[mesh->indices[i + 2]] };
+        float a[3], b[3];
+        for (int k = 0; k < 3; k++) {
+            a[k] = v[1]->position[k] - v[0]->position[k];
+            b[k] = v[2]->position[k] - v[0]->position[k];
+        }
+        // Area weighted, the cross product is not normalized
+        float n[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+        for (MeshVertex *vertex : v) {
+            for (int k = 0; k < 3; k++) {
+                vertex->normal[k] += n[k];
+            }
+        }
+    }
+    for (MeshVertex& vertex : mesh->vertices) {
+        float length = std::sqrt(vertex.normal[0] * vertex.normal[0] + vertex.normal[1] * vertex.normal[1] + vertex.normal[2] * vertex.normal[2]);
+        for (int k = 0; k < 3 && length > 0.0f; k++) {
+            vertex.normal[k] /= length;
+        }
+    }
+}
+
+// Resolved position, uv and normal indices of a face corner, -1 where the corner has none
+struct Corner {
+    int32_t position;
+    int32_t uv;
+    int32_t normal;
+
+    bool operator== (const Corner& other) const {
+        return position == other.position && uv == other.uv && normal == other.normal;
+    }
+};
+
+struct CornerHash {
+    size_t operator() (const Corner& corner) const {
+        uint64_t hash = static_cast<uint32_t>(corner.position);
+        hash = hash * 0x9e3779b97f4a7c15ull + static_cast<uint32_t>(corner.uv);
+        hash = hash * 0x9e3779b97f4a7c15ull + static_cast<uint32_t>(corner.normal);
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+// Faces are triangulated as fans, every distinct position/uv/normal combination becomes one vertex
+static void loadObj (const std::string& path, MeshData *mesh) {
+    std::ifstream file(path);
+    if (!file) {
+        fail("failed to open \"" + path + "\"");
+    }
+    std::vector<float> positions, normals, uvs;
+    // Keyed on resolved indices, relative indices in the text refer to different vertices on every face
+    std::unordered_map<Corner, uint32_t, CornerHash> unique;
+    bool hasNormals = true;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string type;
+        stream >> type;
+        if (type == "v") {
+            float x = 0, y = 0, z = 0;
+            stream >> x >> y >> z;
+            positions.insert(positions.end(), { x, y, z });
+        } else if (type == "vn") {
+            float x = 0, y = 0, z = 0;
+            stream >> x >> y >> z;
+            normals.insert(normals.end(), { x, y, z });
+        } else if (type == "vt") {
+            float u = 0, v = 0;
+            stream >> u >> v;
+            uvs.insert(uvs.end(), { u, v });
+        } else if (type == "f") {
+            std::vector<uint32_t> face;
+            std::string corner;
+            while (stream >> corner) {
+                std::string parts[3];
+                size_t first = corner.find('/');
+                size_t second = first == std::string::npos ? std::string::npos : corner.find('/', first + 1);
+                parts[0] = corner.substr(0, first);
+                if (first != std::string::npos) {
+                    parts[1] = corner.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1);
+                }
+                if (second != std::string::npos) {
+                    parts[2] = corner.substr(second + 1);
+                }
+                int32_t p = resolveIndex(parts[0], positions.size() / 3);
+                int32_t t = resolveIndex(parts[1], uvs.size() / 2);
+                int32_t n = resolveIndex(parts[2], normals.size() / 3);
+                if (p < 0) {
+                    fail("face without a position in \"" + line + "\"");
+                }
+                auto found = unique.find({ p, t, n });
+                if (found != unique.end()) {
+                    face.push_back(found->second);
+                    continue;
+                }
+                MeshVertex vertex = {};
+                memcpy(vertex.position, &positions[p * 3], sizeof(vertex.position));
+                if (t >= 0) {
+                    memcpy(vertex.uv, &uvs[t * 2], sizeof(vertex.uv));
+                }
+                if (n >= 0) {
+                    memcpy(vertex.normal, &normals[n * 3], sizeof(vertex.normal));
+                } else {
+                    hasNormals = false;
+                }
+                uint32_t index = static_cast<uint32_t>(mesh->vertices.size());
+                mesh->vertices.push_back(vertex);
+                unique.emplace(Corner{ p, t, n }, index);
+                face.push_back(index);
+            }
+            for (size_t i = 2; i < face.size(); i++) {
+                mesh->indices.insert(mesh->indices.end(), { face[0], face[i - 1], face[i] });
+            }
+        }
+    }
+    if (mesh->indices.empty()) {
+        fail("\"" + path + "\" contains no faces");
+    }
+    if (!hasNormals) {
+        computeNormals(mesh);
+    }
+}
+
+static void generateSphere (uint32_t segments, MeshData *mesh) {
+    const float pi = 3.14159265358979f;
+    uint32_t rings = std::max(segments / 2, 2u);
+    for (uint32_t ring = 0; ring <= rings; ring++) {
+        float theta = pi * ring / rings;
+        for (uint32_t segment = 0; segment <= segments; segment++) {
+            float phi = 2.0f * pi * segment / segments;
+            MeshVertex vertex;
+            vertex.normal[0] = std::sin(theta) * std::cos(phi);
+            vertex.normal[1] = std::cos(theta);
+            vertex.normal[2] = std::sin(theta) * std::sin(phi);
+            memcpy(vertex.position, vertex.normal, sizeof(vertex.position));
+            vertex.uv[0] = static_cast<float>(segment) / segments;
+            vertex.uv[1] = static_cast<float>(ring) / rings;
+            mesh->vertices.push_back(vertex);
+        }
+    }
+    for (uint32_t ring = 0; ring < rings; ring++) {
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            uint32_t a = ring * (segments + 1) + segment;
+            uint32_t b = a + segments + 1;
+            mesh->indices.insert(mesh->indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+    }
+}
+
+static void boundingSphere (const MeshData& mesh, const uint32_t *indices, size_t count, float sphere[4]) {
+    float center[3] = {};
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < 3; k++) {
+            center[k] += mesh.vertices[indices[i]].position[k];
+        }
+    }
+    float radius = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        const float *position = mesh.vertices[indices[i]].position;
+        float dx = position[0] - center[0] / count, dy = position[1] - center[1] / count, dz = position[2] - center[2] / count;
+        radius = std::max(radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+    }
+    for (int k = 0; k < 3; k++) {
+        sphere[k] = center[k] / count;
+    }
+    sphere[3] = radius;
+}
+
+// Greedy in index order: a meshlet is closed as soon as the next triangle would exceed either limit
+static void buildMeshlets (MeshData *mesh) {
+    std::vector<uint32_t> meshletVertices;
+    uint32_t first = 0;
+    auto close = [&] (uint32_t end) {
+        Meshlet meshlet = { first, end - first, static_cast<uint32_t>(meshletVertices.size()), 0, {} };
+        boundingSphere(*mesh, meshletVertices.data(), meshletVertices.size(), meshlet.sphere);
+        mesh->meshlets.push_back(meshlet);
+        meshletVertices.clear();
+        first = end;
+    };
+    for (uint32_t i = 0; i + 2 < mesh->indices.size(); i += 3) {
+        uint32_t added = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t index = mesh->indices[i + k];
+            bool known = std::find(meshletVertices.begin(), meshletVertices.end(), index) != meshletVertices.end();
+            added += known || std::find(&mesh->indices[i], &mesh->indices[i + k], index) != &mesh->indices[i + k] ? 0 : 1;
+        }
+        if (meshletVertices.size() + added > MESHLET_MAX_VERTICES || (i - first) / 3 == MESHLET_MAX_TRIANGLES) {
+            close(i);
+        }
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t index = mesh->indices[i + k];
+            if (std::find(meshletVertices.begin(), meshletVertices.end(), index) == meshletVertices.end()) {
+                meshletVertices.push_back(index);
+            }
+        }
+    }
+    if (!meshletVertices.empty()) {
+        close(static_cast<uint32_t>(mesh->indices.size()));
+    }
+}
+
+static uint64_t alignSection (uint64_t offset) {
+    return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+static void writeMesh (const std::string& path, const MeshData& mesh) {
+    MeshFileHeader header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+    header.vertexStride = sizeof(MeshVertex);
+    for (int k = 0; k < 3; k++) {
+        header.boundsMin[k] = INFINITY;
+        header.boundsMax[k] = -INFINITY;
+    }
+    for (const MeshVertex& vertex : mesh.vertices) {
+        for (int k = 0; k < 3; k++) {
+            header.boundsMin[k] = std::min(header.boundsMin[k], vertex.position[k]);
+            header.boundsMax[k] = std::max(header.boundsMax[k], vertex.position[k]);
+        }
+    }
+    boundingSphere(mesh, mesh.indices.data(), mesh.indices.size(), header.sphere);
+    header.vertices = { alignSection(sizeof(MeshFileHeader)), mesh.vertices.size() * sizeof(MeshVertex) };
+    header.indices = { alignSection(header.vertices.offset + header.vertices.size), mesh.indices.size() * sizeof(uint32_t) };
+    header.meshlets = { alignSection(header.indices.offset + header.indices.size), mesh.meshlets.size() * sizeof(Meshlet) };
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        fail("failed to create \"" + path + "\"");
+    }
+    auto writeSection = [&file] (const MeshFileSection& section, const void *data) {
+        std::vector<char> padding(section.offset - static_cast<uint64_t>(file.tellp()), 0);
+        file.write(padding.data(), padding.size());
+        file.write(static_cast<const char*>(data), section.size);
+    };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(header.vertices, mesh.vertices.data());
+    writeSection(header.indices, mesh.indices.data());
+    writeSection(header.meshlets, mesh.meshlets.data());
+    if (!file) {
+        fail("failed to write \"" + path + "\"");
+    }
+    printf("%s: %u vertices, %u triangles, %u meshlets, %llu bytes\n", path.c_str(), header.vertexCount, header.indexCount / 3,
+            header.meshletCount, static_cast<unsigned long long>(header.meshlets.offset + header.meshlets.size));
+}
+
+int main (int argc, char **argv) {
+    MeshData mesh;
+    std::string output;
+    if (argc == 4 && strcmp(argv[1], "--sphere") == 0) {
+        generateSphere(std::max(atoi(argv[2]), 3), &mesh);
+        output = argv[3];
+    } else if (argc == 3) {
+        loadObj(argv[1], &mesh);
+        output = argv[2];
+    } else {
+        fprintf(stderr, "Usage: %s input.obj output.mesh\n       %s --sphere SEGMENTS output.mesh\n", argv[0], argv[0]);
+        return 1;
+    }
+    buildMeshlets(&mesh);
+    writeMesh(output, mesh);
+    return 0;
+}